@@ -0,0 +1,146 @@
+#!/usr/bin/env python
+#===- gen-flows-corpus.py - Generate LLVM IR for benchmarking FindFlows ---===#
+#
+#                          The Information Flow Compiler
+#
+# This file was developed by the LLVM research group and is distributed under
+# the University of Illinois Open Source License. See LICENSE.TXT for details.
+#
+#===----------------------------------------------------------------------===#
+#
+# Write a module of synthetic LLVM assembly exercising the paths of the flows
+# pass: stores of values computed from loads, arguments and calls, phi nodes,
+# direct calls, and indirect calls through a global table of function
+# pointers.  The output only depends on the options, so the same options
+# always produce the same module.
+#
+#===----------------------------------------------------------------------===#
+
+import optparse
+import sys
+
+FNTYPE = 'i32 (i32, i32*)'
+
+# DSA needs a data layout; use the one of x86-64 Linux.
+DATALAYOUT = ('e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-'
+              'f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-'
+              'f80:128:128-n8:16:32:64-S128')
+
+class Random(object):
+    """A linear congruential generator.  Python's own generator differs
+    between versions, which would change the corpus."""
+
+    def __init__(self, seed):
+        self.state = seed & 0xffffffffffffffff
+
+    def randrange(self, limit):
+        self.state = (self.state * 6364136223846793005 +
+                      1442695040888963407) & 0xffffffffffffffff
+        return (self.state >> 33) % limit
+
+def gen_function(out, rng, index, opts):
+    """Write the function with the given index."""
+    name = '@f%d' % index
+    out.write('define i32 %s(i32 %%a, i32* %%p) nounwind {\n' % name)
+    out.write('entry:\n')
+    out.write('  %x = alloca i32\n')
+    out.write('  store i32 %a, i32* %x\n')
+    out.write('  br label %seg0\n')
+
+    value = '%a'
+    for seg in range(opts.blocks):
+        glob = '@g%d' % rng.randrange(opts.globals)
+        slot = rng.randrange(opts.table)
+        out.write('seg%d:\n' % seg)
+        out.write('  %%l%d = load i32* %%p\n' % seg)
+        out.write('  %%v%d = add i32 %%l%d, %s\n' % (seg, seg, value))
+        out.write('  store i32 %%v%d, i32* %%x\n' % seg)
+        out.write('  %%c%d = icmp slt i32 %%v%d, %d\n' %
+                  (seg, seg, rng.randrange(100)))
+        out.write('  br i1 %%c%d, label %%direct%d, label %%indirect%d\n' %
+                  (seg, seg, seg))
+
+        #
+        # Call an earlier function directly, or the function itself if it is
+        # the first one.
+        #
+        out.write('direct%d:\n' % seg)
+        out.write('  %%d%d = call i32 @f%d(i32 %%v%d, i32* %%x)\n' %
+                  (seg, rng.randrange(index + 1), seg))
+        out.write('  br label %%join%d\n' % seg)
+
+        #
+        # Call a function through the table of function pointers.
+        #
+        out.write('indirect%d:\n' % seg)
+        out.write('  %%fp%d = load %s** getelementptr inbounds '
+                  '([%d x %s*]* @table, i32 0, i32 %d)\n' %
+                  (seg, FNTYPE, opts.table, FNTYPE, slot))
+        out.write('  %%i%d = call i32 %%fp%d(i32 %%l%d, i32* %s)\n' %
+                  (seg, seg, seg, glob))
+        out.write('  br label %%join%d\n' % seg)
+
+        out.write('join%d:\n' % seg)
+        out.write('  %%r%d = phi i32 [ %%d%d, %%direct%d ], '
+                  '[ %%i%d, %%indirect%d ]\n' % (seg, seg, seg, seg, seg))
+        out.write('  store i32 %%r%d, i32* %s\n' % (seg, glob))
+        value = '%%r%d' % seg
+        if seg + 1 < opts.blocks:
+            out.write('  br label %%seg%d\n' % (seg + 1))
+
+    out.write('  store i32 %s, i32* %%p\n' % value)
+    out.write('  %ret = load i32* %x\n')
+    out.write('  ret i32 %ret\n')
+    out.write('}\n\n')
+
+def main():
+    parser = optparse.OptionParser(usage='%prog [options]')
+    parser.add_option('-f', '--functions', type='int', default=100,
+                      help='number of functions to generate')
+    parser.add_option('-b', '--blocks', type='int', default=4,
+                      help='number of call diamonds in each function')
+    parser.add_option('-g', '--globals', type='int', default=16,
+                      help='number of global variables')
+    parser.add_option('-t', '--table', type='int', default=8,
+                      help='number of entries in the function pointer table')
+    parser.add_option('-s', '--seed', type='int', default=1,
+                      help='seed for the random choices')
+    parser.add_option('-o', '--output', default='-',
+                      help='file to write (default: standard output)')
+    opts, args = parser.parse_args()
+    if args:
+        parser.error('unexpected arguments')
+    if (opts.functions < 1 or opts.blocks < 1 or opts.globals < 1 or
+        opts.table < 1):
+        parser.error('sizes must be positive')
+
+    rng = Random(opts.seed)
+    out = sys.stdout if opts.output == '-' else open(opts.output, 'w')
+
+    out.write('; Generated by gen-flows-corpus.py -f %d -b %d -g %d -t %d '
+              '-s %d\n\n' % (opts.functions, opts.blocks, opts.globals,
+                             opts.table, opts.seed))
+    out.write('target datalayout = "%s"\n\n' % DATALAYOUT)
+    for index in range(opts.globals):
+        out.write('@g%d = global i32 0\n' % index)
+    targets = ['%s* @f%d' % (FNTYPE, rng.randrange(opts.functions))
+               for index in range(opts.table)]
+    out.write('@table = global [%d x %s*] [%s]\n\n' %
+              (opts.table, FNTYPE, ', '.join(targets)))
+
+    for index in range(opts.functions):
+        gen_function(out, rng, index, opts)
+
+    out.write('define i32 @main() nounwind {\n')
+    out.write('entry:\n')
+    out.write('  %%r = call i32 @f%d(i32 0, i32* @g0)\n' %
+              (opts.functions - 1))
+    out.write('  ret i32 %r\n')
+    out.write('}\n')
+
+    if out is not sys.stdout:
+        out.close()
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
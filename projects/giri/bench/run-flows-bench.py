@@ -0,0 +1,167 @@
+#!/usr/bin/env python
+#===- run-flows-bench.py - Measure the flows pass over a corpus -----------===#
+#
+#                          The Information Flow Compiler
+#
+# This file was developed by the LLVM research group and is distributed under
+# the University of Illinois Open Source License. See LICENSE.TXT for details.
+#
+#===----------------------------------------------------------------------===#
+#
+# Run opt -flows over each bitcode file given on the command line and record,
+# for every run, the wall time, the peak resident set size, the time of each
+# timer reported by -time-passes, and every statistic reported by -stats
+# (worklist pushes, values searched, result sizes, and so on).
+#
+# Each run is appended as one JSON object per line to the output file, tagged
+# with the git revision of the source tree, so that results of different
+# commits can be collected in one file and compared.  A table of the median
+# of each input is printed when all runs have finished.
+#
+#===----------------------------------------------------------------------===#
+
+import json
+import optparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# A line printed by -stats: "  <value> <debug type> - <description>"
+STAT_RE = re.compile(r'^\s*(\d+)\s+(\S+)\s+-\s+(.*?)\s*$')
+
+# A line printed by -time-passes.  The wall time is the last column before the
+# name of the timer.
+TIMER_RE = re.compile(r'([0-9.]+) \(\s*[0-9.]+%\)\s+([^0-9\s(].*?)\s*$')
+
+# The rule above and below the title of each report
+RULE_RE = re.compile(r'^===-+===$')
+
+def parse_output(text):
+    """Return the statistics and timers in the output of opt.  Timers are
+    named after their report, as several reports have a Total line."""
+    stats = {}
+    timers = {}
+    report = ''
+    title_next = False
+    for line in text.splitlines():
+        if RULE_RE.match(line.strip()):
+            title_next = not title_next
+            continue
+        if title_next:
+            report = line.strip().strip('. ')
+            continue
+        match = STAT_RE.match(line)
+        if match:
+            key = '%s: %s' % (match.group(2), match.group(3))
+            stats[key] = int(match.group(1))
+            continue
+        match = TIMER_RE.search(line)
+        if match:
+            timers['%s: %s' % (report, match.group(2))] = float(match.group(1))
+    return stats, timers
+
+def run_once(command):
+    """Run a command and return its exit status, wall time in seconds, peak
+    resident set size in kilobytes, and standard error."""
+    errors = tempfile.TemporaryFile()
+    start = time.time()
+    process = subprocess.Popen(command, stderr=errors)
+    pid, status, usage = os.wait4(process.pid, 0)
+    wall = time.time() - start
+    if os.WIFEXITED(status):
+        status = os.WEXITSTATUS(status)
+    else:
+        status = 128 + os.WTERMSIG(status)
+    # The process has been reaped; keep Popen from waiting for it again.
+    process.returncode = status
+    errors.seek(0)
+    text = errors.read().decode('utf-8', 'replace')
+    errors.close()
+    return status, wall, usage.ru_maxrss, text
+
+def git_revision(path):
+    """Return the git revision of the tree holding the given path."""
+    try:
+        process = subprocess.Popen(['git', 'rev-parse', 'HEAD'], cwd=path,
+                                   stdout=subprocess.PIPE,
+                                   stderr=subprocess.PIPE)
+        output = process.communicate()[0]
+        if process.returncode == 0:
+            return output.decode('ascii').strip()
+    except OSError:
+        pass
+    return 'unknown'
+
+def median(values):
+    values = sorted(values)
+    return values[len(values) // 2]
+
+def main():
+    parser = optparse.OptionParser(usage='%prog [options] bitcode...')
+    parser.add_option('--opt', default='opt', help='opt executable')
+    parser.add_option('--load', action='append', default=[],
+                      help='module to load into opt (repeatable)')
+    parser.add_option('--flows-arg', action='append', default=[],
+                      help='extra option for the flows pass (repeatable)')
+    parser.add_option('-r', '--repeat', type='int', default=3,
+                      help='number of runs of each input')
+    parser.add_option('-o', '--output', default='flows-bench.jsonl',
+                      help='file to which results are appended')
+    opts, inputs = parser.parse_args()
+    if not inputs:
+        parser.error('no input files')
+
+    revision = git_revision(os.path.dirname(os.path.abspath(__file__)))
+    stamp = time.strftime('%Y-%m-%dT%H:%M:%S')
+    out = open(opts.output, 'a')
+    summary = []
+    failed = False
+
+    for path in inputs:
+        command = [opts.opt]
+        for module in opts.load:
+            command += ['-load', module]
+        command += ['-flows'] + opts.flows_arg
+        command += ['-stats', '-time-passes', '-disable-output', path]
+
+        walls = []
+        rss = []
+        for run in range(opts.repeat):
+            status, wall, maxrss, text = run_once(command)
+            if status != 0:
+                sys.stderr.write('%s: opt failed (status %d)\n%s' %
+                                 (path, status, text))
+                failed = True
+                break
+            stats, timers = parse_output(text)
+            record = {
+                'revision': revision,
+                'date': stamp,
+                'input': os.path.basename(path),
+                'args': opts.flows_arg,
+                'run': run,
+                'wall_seconds': wall,
+                'max_rss_kb': maxrss,
+                'stats': stats,
+                'timers': timers,
+            }
+            out.write(json.dumps(record, sort_keys=True) + '\n')
+            walls.append(wall)
+            rss.append(maxrss)
+
+        if walls:
+            summary.append((os.path.basename(path), median(walls), max(rss)))
+
+    out.close()
+
+    sys.stdout.write('%-40s %12s %12s\n' % ('input', 'wall (s)', 'rss (KB)'))
+    for name, wall, maxrss in summary:
+        sys.stdout.write('%-40s %12.3f %12d\n' % (name, wall, maxrss))
+    sys.stdout.write('results appended to %s\n' % opts.output)
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,40 @@
+; Check that slicing from a load reaches the actual arguments of its callers.
+; The load at s.c:4 reads through %base and %i; the slice must follow them to
+; the pointer from malloc and the constant 9 passed by main, and must not
+; follow the called function.  'make check' runs opt -flows -stats on this file
+; with the options below and checks its statistics with FileCheck.
+;
+; FLOWS: -flows-file-name=s.c -flows-line-number=4
+;
+; CHECK: {{^ *}}2 giri{{ +}}- Number of call sites visited for arguments
+; CHECK: {{^ *}}2 giri{{ +}}- Number of function arguments needing labels
+; CHECK: {{^ *}}4 giri{{ +}}- Number of sources (per function) found
+; CHECK: {{^ *}}6 giri{{ +}}- Number of values (per function) searched
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define i32 @get(i32* %base, i64 %i) nounwind {
+  %p = getelementptr i32* %base, i64 %i
+  %v = load i32* %p, !dbg !5
+  ret i32 %v
+}
+
+define i32 @main() nounwind {
+  %m = call i8* @malloc(i64 16)
+  %b = bitcast i8* %m to i32*
+  %r = call i32 @get(i32* %b, i64 9)
+  ret i32 %r
+}
+
+declare i8* @malloc(i64)
+
+!llvm.dbg.sp = !{!0}
+
+!0 = metadata !{i32 589870, i32 0, metadata !1, metadata !"get", metadata !"get", metadata !"", metadata !1, i32 3, metadata !3, i1 false, i1 true, i32 0, i32 0, i32 0, i32 0, i1 false, i32 (i32*, i64)* @get} ; [ DW_TAG_subprogram ]
+!1 = metadata !{i32 589865, metadata !"s.c", metadata !"/tmp", metadata !2} ; [ DW_TAG_file_type ]
+!2 = metadata !{i32 589841, i32 0, i32 12, metadata !"s.c", metadata !"/tmp", metadata !"", i1 true, i1 false, metadata !"", i32 0} ; [ DW_TAG_compile_unit ]
+!3 = metadata !{i32 589845, metadata !1, metadata !"", metadata !1, i32 0, i64 0, i64 0, i32 0, i32 0, i32 0, metadata !4, i32 0, i32 0} ; [ DW_TAG_subroutine_type ]
+!4 = metadata !{null}
+!5 = metadata !{i32 4, i32 2, metadata !6, null}
+!6 = metadata !{i32 589835, metadata !0, i32 3, i32 12, metadata !1, i32 0} ; [ DW_TAG_lexical_block ]
@@ -18,14 +18,20 @@
 #define _CIF_FINDFLOWS_H_
 
 #include "giri/config.h"
+#include "giri/FlowDatabase.h"
 
 #include "llvm/Constant.h"
 #include "llvm/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/Type.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/Support/Atomic.h"
 
 #include "poolalloc/PoolAllocate.h"
 
+#include <iterator>
 #include <map>
 #include <set>
 #include <vector>
@@ -60,24 +66,18 @@ removeIncompatibleTargets (const CallInst * CI,
 
   //
   // Remove any function from the set of targets that has the wrong number of
-  // arguments.  Find all the functions to remove first and record them in a
-  // container so that we don't invalidate any iterators.
+  // arguments.  Move each compatible function down over the removed ones and
+  // then drop the leftover entries at the end, so that the list is only
+  // walked once.
   //
-  std::vector<const Function *>::iterator FI = Targets.begin();
-  std::vector<const Function *>::iterator FE = Targets.begin();
-  while (FI != FE) {
+  std::vector<const Function *>::iterator Kept = Targets.begin();
+  std::vector<const Function *>::iterator FI;
+  for (FI = Targets.begin(); FI != Targets.end(); ++FI) {
     const Function * F = *FI;
-    if ((F->getFunctionType()->getNumParams()) != (CI->getNumOperands() - 1)) {
-      if (FI == Targets.begin()) {
-        Targets.erase (Targets.begin());
-        FI = Targets.begin();
-      } else {
-        Targets.erase (FI--);
-      }
-    } else {
-      ++F;
-    }
+    if ((F->getFunctionType()->getNumParams()) == (CI->getNumArgOperands()))
+      *Kept++ = F;
   }
+  Targets.erase (Kept, Targets.end());
 
   return;
 }
@@ -112,63 +112,242 @@ struct FindFlows : public ModulePass {
     };
 
     virtual void releaseMemory () {
-      Sources.clear();
+      Results.clear();
+      CallTargets.clear();
+      CallTargetIndex.clear();
+      LoadStores.clear();
+      ValueIDs.clear();
+      Values.clear();
+      FunctionIDs.clear();
     }
 
     //////////////////////////////////////////////////////////////////////////
     // Public type definitions
     //////////////////////////////////////////////////////////////////////////
-    typedef std::set<const Value *> SourceSet;
-    typedef std::map<const Function *, SourceSet > SourceMap;
-    typedef SourceSet::iterator src_iterator;
+
+    //
+    // Class: id_iterator
+    //
+    // Description:
+    //  Iterate over a set of values held as a bitvector of value numbers.
+    //  Dereferencing the iterator yields the value with the current number.
+    //
+    template <typename ValueTy>
+    class id_iterator : public std::iterator<std::forward_iterator_tag,
+                                             const ValueTy *> {
+      public:
+        id_iterator (SparseBitVector<>::iterator I,
+                     const std::vector<const Value *> * Values) :
+          I (I), Values (Values) { }
+
+        const ValueTy * operator* () const {
+          return cast<ValueTy>((*Values)[*I]);
+        }
+
+        id_iterator & operator++ () { ++I; return *this; }
+        id_iterator operator++ (int) {
+          id_iterator tmp = *this; ++I; return tmp;
+        }
+
+        bool operator== (const id_iterator & RHS) const { return I == RHS.I; }
+        bool operator!= (const id_iterator & RHS) const { return I != RHS.I; }
+
+      private:
+        SparseBitVector<>::iterator I;
+        const std::vector<const Value *> * Values;
+    };
+
+    typedef SparseBitVector<> ValueSet;
+    typedef id_iterator<Value> src_iterator;
+    typedef id_iterator<PHINode> phi_iterator;
 
     //////////////////////////////////////////////////////////////////////////
     // Public, class specific methods
     //////////////////////////////////////////////////////////////////////////
-    src_iterator src_begin(const Function * F) {
-      return Sources[F].begin();
+    src_iterator src_begin(const Function * F) const {
+      return src_iterator (getSources (F).begin(), &Values);
+    }
+
+    src_iterator src_end(const Function * F) const {
+      return src_iterator (getSources (F).end(), &Values);
     }
 
-    src_iterator src_end(const Function * F) {
-      return Sources[F].end();
+    phi_iterator phi_begin (void) const {
+      return phi_iterator (Results.PhiNodes.begin(), &Values);
     }
 
-    const std::set<const PHINode *> & getPHINodes (void) {
-      return PhiNodes;
+    phi_iterator phi_end (void) const {
+      return phi_iterator (Results.PhiNodes.end(), &Values);
     }
 
     bool returnNeedsLabel (const ReturnInst & RI) {
-      return (Returns.find (&RI) != Returns.end());
+      return hasValue (Results.Returns, &RI);
     }
 
     bool argNeedsLabel (const Argument * Arg) {
-      return (Args.find (Arg) != Args.end());
+      return hasValue (Results.Args, Arg);
     }
 
+    void sliceFrom (const Instruction * I);
+
+    static void getLocalValues (const Function & F,
+                                std::vector<const Value *> & Locals);
+
   private:
     // Private typedefs
     typedef std::vector<std::pair<Value *, const Function * > > Worklist_t;
-    typedef std::set<const Value *> Processed_t;
+    typedef DenseMap<const LoadInst *, std::vector<StoreInst *> >
+            LoadStoreIndex_t;
+    typedef DenseMap<const CallInst *, std::pair<unsigned, unsigned> >
+            CallTargetIndex_t;
+
+    //
+    // Struct: FlowState
+    //
+    // Description:
+    //  The results of searching for information flows.  When the search runs
+    //  on several threads, each thread fills in its own FlowState, and these
+    //  are merged into the pass's results once all threads have finished.
+    //
+    struct FlowState {
+      // Map from the number of a function to the numbers of the sources from
+      // which the labels needed in that function derive
+      std::vector<ValueSet> Sources;
+
+      // Set of phi nodes that will need special processing
+      ValueSet PhiNodes;
+
+      // Set of return instructions that require labels
+      ValueSet Returns;
+
+      // Set of function arguments that require labels
+      ValueSet Args;
+
+      // Map from the number of a function to the values used in it whose
+      // sources have been found
+      std::vector<ValueSet> Resolved;
+
+      // Counters reported through the pass statistics
+      unsigned ResolvedHits;
+      unsigned ArgCallSites;
+      unsigned LoadStores;
+      unsigned WorklistItems;
+
+      FlowState () : ResolvedHits (0), ArgCallSites (0), LoadStores (0),
+                     WorklistItems (0) { }
+      void mergeInto (FlowState & Dest) const;
+      void clear (void);
+      void reset (unsigned NumFunctions);
+    };
+
+    //
+    // Struct: FlowThread
+    //
+    // Description:
+    //  The work of one thread searching for flows in parallel.  Threads take
+    //  the next unprocessed function from a shared list until none are left.
+    //
+    struct FlowThread {
+      FindFlows * Pass;
+      const std::vector<Function *> * Functions;
+      volatile sys::cas_flag * NextFunction;
+      FlowState State;
+    };
 
     // Private methods
-    void findSources (Function & F);
-    void findCallSources (CallInst * CI, Worklist_t & Wl, Processed_t & P);
-    void findArgSources (Argument * Arg, Worklist_t & Wl, Processed_t & P);
-    void findFlow (Value * V, const Function & F);
-    void addSource (const Value * V, const Function * F);
-    void findCallTargets (CallInst * CI, std::vector<const Function *> & Tgts);
+    void findSources (Function & F, FlowState & S);
+    void findTargetSources (Module & M);
+    void findSourcesInParallel (const std::vector<Function *> & Functions,
+                                unsigned NumThreads);
+    static void * runFlowThread (void * Arg);
+    void buildCallSiteIndex (Module & M);
+    void findCallSources (CallInst * CI, Worklist_t & Wl, FlowState & S);
+    void findArgSources (Argument * Arg, Worklist_t & Wl, FlowState & S);
+    void buildMemoryIndex (Module & M);
+    bool findLoadSources (LoadInst * LI, Worklist_t & Wl, FlowState & S);
+    void findFlow (Value * V, const Function & F, FlowState & S);
+    void processWorklist (Worklist_t & Worklist, FlowState & S);
+    void addSource (const Value * V, const Function * F, FlowState & S);
+    void computeCallTargets (CallInst * CI,
+                             std::vector<const Function *> & Tgts);
+    ArrayRef<const Function *> findCallTargets (const CallInst * CI) const;
+    void findCallers (const Function * F,
+                      SmallVectorImpl<CallInst *> & Callers) const;
+    void numberValues (Module & M);
+    void numberValue (const Value * V);
+    bool markResolved (const Value * V, const Function * F, FlowState & S);
+    const ValueSet & getSources (const Function * F) const;
+    void hashFunctions (Module & M,
+                        std::vector<uint64_t> & BodyHashes,
+                        std::vector<uint64_t> & DependencyHashes);
+    bool restoreFunction (const Function & F,
+                          const FlowDatabase & DB,
+                          const FlowDatabase::FunctionRecord & R);
+    void loadDatabase (Module & M,
+                       const std::vector<uint64_t> & BodyHashes,
+                       const std::vector<uint64_t> & DependencyHashes,
+                       std::vector<Function *> & Changed,
+                       std::vector<Function *> & Restored);
+    void findRestoredSources (const std::vector<Function *> & Restored);
+    void saveDatabase (Module & M,
+                       const std::vector<uint64_t> & BodyHashes,
+                       const std::vector<uint64_t> & DependencyHashes);
+
+    //
+    // Method: getValueID()
+    //
+    // Description:
+    //  Return the number given to the specified value by numberValues().
+    //
+    unsigned getValueID (const Value * V) const {
+      DenseMap<const Value *, unsigned>::const_iterator i = ValueIDs.find (V);
+      assert ((i != ValueIDs.end()) && "Value was not numbered!\n");
+      return i->second;
+    }
+
+    //
+    // Method: getFunctionID()
+    //
+    // Description:
+    //  Return the number given to the specified function by numberValues().
+    //
+    unsigned getFunctionID (const Function * F) const {
+      DenseMap<const Function *, unsigned>::const_iterator i;
+      i = FunctionIDs.find (F);
+      assert ((i != FunctionIDs.end()) && "Function was not numbered!\n");
+      return i->second;
+    }
+
+    //
+    // Method: hasValue()
+    //
+    // Description:
+    //  Determine whether the specified value is in a set of value numbers.
+    //  Values that were never numbered are in no set.
+    //
+    bool hasValue (ValueSet & Set, const Value * V) const {
+      DenseMap<const Value *, unsigned>::const_iterator i = ValueIDs.find (V);
+      if (i == ValueIDs.end())
+        return false;
+      return Set.test (i->second);
+    }
 
-    // Map from values needing labels to sources from which those labels derive
-    SourceMap Sources;
+    // Sources, returns, and arguments requiring labels
+    FlowState Results;
 
-    // Set of phi nodes that will need special processing
-    std::set<const PHINode *> PhiNodes;
+    // Targets of all call instructions, and the range of each call's targets
+    // within them
+    std::vector<const Function *> CallTargets;
+    CallTargetIndex_t CallTargetIndex;
 
-    // Set of return instructions that require labels
-    std::set<const ReturnInst *> Returns;
+    // Map from loads to the stores that may write the memory they read
+    LoadStoreIndex_t LoadStores;
 
-    // Set of function arguments that require labels
-    std::set<const Argument *> Args;
+    // Dense numbering of the values and functions in the module.  The results
+    // of the search hold value numbers instead of pointers.
+    DenseMap<const Value *, unsigned> ValueIDs;
+    std::vector<const Value *> Values;
+    DenseMap<const Function *, unsigned> FunctionIDs;
 
     // Worklist of return instructions to process
     std::map<Function *, std::set<Argument *> > ArgWorklist;
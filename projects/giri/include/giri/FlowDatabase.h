@@ -0,0 +1,133 @@
+//===- FlowDatabase.h - On-disk database of information flows ---------------//
+//
+//                          The Information Flow Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a file format for saving the results of the FindFlows
+// pass.  The file holds one record per function.  Each record holds hashes
+// identifying the function and the functions whose flows may reach it, and
+// the sets of values found by the pass.  Values are identified by their
+// index in a walk of the function (see FindFlows::getLocalValues()), so the
+// records remain valid as long as the function does not change.
+//
+// The file is read through a single memory mapping; nothing is copied or
+// decoded when it is loaded.  A new file is written beside the old one and
+// renamed over it, so a reader that has the old file mapped keeps seeing it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef _CIF_FLOWDATABASE_H_
+#define _CIF_FLOWDATABASE_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+//
+// Class: FlowDatabase
+//
+// Description:
+//  A read-only view of a file of FindFlows results, and the method that
+//  writes such a file.
+//
+//  The file begins with a Header, followed by one FunctionRecord per function
+//  sorted by function name, followed by the value index arrays and finally
+//  the function names.  All integers are in host byte order; a file written
+//  on a host of different byte order is rejected by its version number.
+//
+class FlowDatabase {
+  public:
+    // The sets of values recorded for each function
+    enum SetKind {
+      Sources,
+      Resolved,
+      PhiNodes,
+      Returns,
+      Args,
+      NumSetKinds
+    };
+
+    struct Header {
+      char Magic[8];
+      uint32_t Version;
+      uint32_t NumFunctions;
+    };
+
+    struct FunctionRecord {
+      uint32_t NameOffset;
+      uint32_t NameLength;
+      uint64_t BodyHash;
+      uint64_t DependencyHash;
+      uint32_t SetOffset[NumSetKinds];
+      uint32_t SetLength[NumSetKinds];
+    };
+
+    //
+    // Struct: FunctionEntry
+    //
+    // Description:
+    //  The results for one function, as handed to write().
+    //
+    struct FunctionEntry {
+      std::string Name;
+      uint64_t BodyHash;
+      uint64_t DependencyHash;
+      std::vector<uint32_t> Sets[NumSetKinds];
+
+      FunctionEntry () : BodyHash (0), DependencyHash (0) { }
+    };
+
+    static FlowDatabase * load (StringRef FileName, std::string & Error);
+    static bool write (StringRef FileName,
+                       std::vector<FunctionEntry> & Entries,
+                       std::string & Error);
+
+    const FunctionRecord * lookup (StringRef Name) const;
+
+    unsigned getNumFunctions (void) const {
+      return getHeader().NumFunctions;
+    }
+
+    const FunctionRecord & getFunction (unsigned index) const {
+      return getRecords()[index];
+    }
+
+    StringRef getName (const FunctionRecord & R) const {
+      return StringRef (Buffer->getBufferStart() + R.NameOffset, R.NameLength);
+    }
+
+    ArrayRef<uint32_t> getSet (const FunctionRecord & R, SetKind Kind) const {
+      const uint32_t * Start = (const uint32_t *)
+        (Buffer->getBufferStart() + R.SetOffset[Kind]);
+      return ArrayRef<uint32_t> (Start, R.SetLength[Kind]);
+    }
+
+  private:
+    explicit FlowDatabase (MemoryBuffer * Buffer) : Buffer (Buffer) { }
+    bool verify (std::string & Error) const;
+
+    const Header & getHeader (void) const {
+      return *((const Header *) Buffer->getBufferStart());
+    }
+
+    const FunctionRecord * getRecords (void) const {
+      return (const FunctionRecord *) (Buffer->getBufferStart() +
+                                       sizeof (Header));
+    }
+
+    // The mapped contents of the file
+    OwningPtr<MemoryBuffer> Buffer;
+};
+
+#endif
@@ -17,13 +17,28 @@
 #define DEBUG_TYPE "giri"
 
 #include "giri/FindFlows.h"
+#include "giri/FlowDatabase.h"
 
+#include "llvm/Constants.h"
+#include "llvm/DataLayout.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/InlineAsm.h"
+#include "llvm/Metadata.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/DebugInfo.h"
 #include "llvm/IntrinsicInst.h"
 #include "llvm/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/Timer.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include <pthread.h>
+
 using namespace llvm;
 
 // ID Variable to identify the pass
@@ -34,8 +49,64 @@ char FindFlows::ID = 0;
 //
 static RegisterPass<FindFlows> X ("flows", "Find Information Flows");
 
+// Command line options
+static cl::opt<unsigned>
+FlowThreads ("flows-threads",
+             cl::desc ("Number of threads used to find information flows"),
+             cl::init (1));
+
+static cl::opt<std::string>
+SliceFileName ("flows-file-name",
+               cl::desc ("Only find flows into the instructions at this "
+                         "source file name and line number"),
+               cl::init (""));
+
+static cl::opt<unsigned>
+SliceLineNumber ("flows-line-number",
+                 cl::desc ("Line number of the instructions whose flows "
+                           "should be found"),
+                 cl::init (0));
+
+static cl::opt<unsigned>
+SliceIndex ("flows-index",
+            cl::desc ("Index of the instruction with the matching file name "
+                      "and line number (0 selects all of them)"),
+            cl::init (0));
+
+static cl::opt<bool>
+FlowsThroughMemory ("flows-through-memory",
+                    cl::desc ("Follow loads to the stores that may write the "
+                              "memory they read"),
+                    cl::init (false));
+
+static cl::opt<unsigned>
+MemoryBudget ("flows-memory-budget",
+              cl::desc ("Most stores a load may be followed to; loads "
+                        "reading memory written by more stores are sources"),
+              cl::init (16));
+
+static cl::opt<std::string>
+FlowDatabaseName ("flows-db",
+                  cl::desc ("Save the flows found in this file and reuse "
+                            "them for unchanged functions in later runs"),
+                  cl::init (""));
+
 // Statistics
 //STATISTIC (NullChecks ,    "Poolchecks with NULL pool descriptor");
+STATISTIC (NumIndexedCalls, "Number of call sites in the call target index");
+STATISTIC (NumArgCallSites, "Number of call sites visited for arguments");
+STATISTIC (NumResolvedHits, "Number of values whose sources were already found");
+STATISTIC (NumValues,       "Number of values numbered for the flow results");
+STATISTIC (NumTracedLoads,  "Number of loads that may be followed to stores");
+STATISTIC (NumLoadStores,   "Number of stores reached by following loads");
+STATISTIC (NumReused,       "Number of functions whose saved flows were reused");
+STATISTIC (NumSearched,     "Number of functions searched for flows");
+STATISTIC (NumWorklist,     "Number of values pushed onto the flow worklist");
+STATISTIC (NumResolved,     "Number of values (per function) searched");
+STATISTIC (NumSources,      "Number of sources (per function) found");
+STATISTIC (NumPhiNodes,     "Number of phi nodes needing special processing");
+STATISTIC (NumReturns,      "Number of return instructions needing labels");
+STATISTIC (NumArgs,         "Number of function arguments needing labels");
 
 //
 // Function: isASource()
@@ -59,7 +130,7 @@ isASource (const Value * V) {
   // Call instructions are sources *unless* they are inline assembly.
   //
   if (const CallInst * CI = dyn_cast<CallInst>(V)) {
-    if (isa<InlineAsm>(CI->getOperand(0)))
+    if (isa<InlineAsm>(CI->getCalledValue()))
       return false;
     else
       return true;
@@ -84,22 +155,51 @@ isASource (const Value * V) {
 //
 // Inputs:
 //  V - A source that needs to be recorded.
+//  F - The function in which the source's label is needed.
+//
+// Outputs:
+//  S - The results into which the source is recorded.
 //
 void
-FindFlows::addSource (const Value * V, const Function * F) {
+FindFlows::addSource (const Value * V, const Function * F, FlowState & S) {
   //
   // Record the source in the set of sources.
   //
-  Sources[F].insert (V);
+  unsigned ID = getValueID (V);
+  S.Sources[getFunctionID (F)].set (ID);
 
   //
   // If the source is an argument, record it specially.
   //
-  if (const Argument * Arg = dyn_cast<Argument>(V))
-    Args.insert (Arg);
+  if (isa<Argument>(V))
+    S.Args.set (ID);
   return;
 }
 
+//
+// Method: markResolved()
+//
+// Description:
+//  Record that the sources of the specified value, as used in the specified
+//  function, are being found.
+//
+// Inputs:
+//  V - The value whose sources are being found.
+//  F - The function in which the value is used.
+//
+// Outputs:
+//  S - The results into which the value is recorded.
+//
+// Return value:
+//  true  - The value had not been recorded before.
+//  false - The value was already recorded; its sources need not be found
+//          again.
+//
+bool
+FindFlows::markResolved (const Value * V, const Function * F, FlowState & S) {
+  return S.Resolved[getFunctionID (F)].test_and_set (getValueID (V));
+}
+
 //
 // Method: findFlow()
 //
@@ -108,15 +208,48 @@ FindFlows::addSource (const Value * V, const Function * F) {
 //  labels of these values will combine together to form the label of the given
 //  value.
 //
+//  The sources of every value visited are recorded in the pass results, which
+//  only ever grow.  A value visited by an earlier call therefore already has
+//  its sources recorded, so it is remembered in Resolved and never walked
+//  again.  This makes the total work of all calls linear in the size of the
+//  flow graph instead of proportional to the number of stores reaching it.
+//
 void
-FindFlows::findFlow (Value * Initial, const Function & Fu) {
-  // Already processed values
-  Processed_t Processed;
+FindFlows::findFlow (Value * Initial, const Function & Fu, FlowState & S) {
+  //
+  // If the sources of this value have already been found, there is nothing
+  // new to learn from it.
+  //
+  if (!markResolved (Initial, &Fu, S)) {
+    ++S.ResolvedHits;
+    return;
+  }
 
   // Worklist
   Worklist_t Worklist;
   Worklist.push_back (std::make_pair(Initial, &Fu));
+  processWorklist (Worklist, S);
+  return;
+}
 
+//
+// Method: processWorklist()
+//
+// Description:
+//  Find the sources of every value on the worklist and of every value upon
+//  which they depend.  The values on the worklist must already be recorded in
+//  the Resolved set.
+//
+// Inputs:
+//  Worklist - The values, and the functions in which they are used, whose
+//             sources should be found.
+//
+// Outputs:
+//  Worklist - The worklist is emptied.
+//  S        - The results into which the sources found are recorded.
+//
+void
+FindFlows::processWorklist (Worklist_t & Worklist, FlowState & S) {
   while (Worklist.size()) {
     //
     // Pop an item off of the worklist.
@@ -124,14 +257,20 @@ FindFlows::findFlow (Value * Initial, const Function & Fu) {
     Value * V = Worklist.back().first;
     const Function * F = Worklist.back().second;
     Worklist.pop_back();
+    ++S.WorklistItems;
 
     //
-    // If the value is a source, add it to the set of sources.  Otherwise, add
-    // its operands to the worklist if they have not yet been processed.
+    // If the value is a load whose memory is written by known stores, the
+    // values stored are its sources.  If the value is any other source, add
+    // it to the set of sources.  Otherwise, add its operands to the worklist
+    // if they have not yet been processed.
     //
     //
-    if (isASource (V)) {
-      addSource (V, F);
+    LoadInst * LI = dyn_cast<LoadInst>(V);
+    if (LI && findLoadSources (LI, Worklist, S)) {
+      continue;
+    } else if (isASource (V)) {
+      addSource (V, F, S);
 
       //
       // Some sources imply that information flow must be traced inside another
@@ -141,19 +280,20 @@ FindFlows::findFlow (Value * Initial, const Function & Fu) {
       // we'll need the labels of any value passed into the function.
       //
       if (CallInst * CI = dyn_cast<CallInst>(V)) {
-        findCallSources (CI, Worklist, Processed);
+        findCallSources (CI, Worklist, S);
       } else if (Argument * Arg = dyn_cast<Argument>(V)) {
-        findArgSources (Arg, Worklist, Processed);
+        findArgSources (Arg, Worklist, S);
       }
     } else if (User * U = dyn_cast<User>(V)) {
       // Record any phi nodes located
-      if (PHINode * PHI = dyn_cast<PHINode>(V)) PhiNodes.insert (PHI);
+      if (isa<PHINode>(V)) S.PhiNodes.set (getValueID (V));
 
       for (unsigned index = 0; index < U->getNumOperands(); ++index) {
-        if (Processed.find (U->getOperand(index)) == Processed.end()) {
-          Worklist.push_back (std::make_pair(U->getOperand(index), F));
-          if (!(isa<Constant>(U->getOperand(index)))) Processed.insert (U->getOperand(index));
-        }
+        Value * Op = U->getOperand(index);
+        if (markResolved (Op, F, S))
+          Worklist.push_back (std::make_pair(Op, F));
+        else
+          ++S.ResolvedHits;
       }
     }
   }
@@ -172,8 +312,11 @@ FindFlows::findFlow (Value * Initial, const Function & Fu) {
 // Inputs:
 //  F - The function to analyze.
 //
+// Outputs:
+//  S - The results into which the sources found are recorded.
+//
 void
-FindFlows::findSources (Function & F) {
+FindFlows::findSources (Function & F, FlowState & S) {
   //
   // Iterate over all instructions in the program and process those that
   // need the information flow of their inputs.
@@ -185,7 +328,7 @@ FindFlows::findSources (Function & F) {
       // this information to the memory object to which they write.
       //
       if (StoreInst * SI = dyn_cast<StoreInst>(II)) {
-        findFlow (SI->getOperand(0), F);
+        findFlow (SI->getOperand(0), F, S);
         continue;
       }
 
@@ -193,7 +336,7 @@ FindFlows::findSources (Function & F) {
       // Certain intrinsic functions need the labels of their inputs.
       //
       if (MemSetInst * MSI = dyn_cast<MemSetInst>(II)) {
-        findFlow (MSI->getValue(), F);
+        findFlow (MSI->getValue(), F, S);
         continue;
       }
 
@@ -205,7 +348,7 @@ FindFlows::findSources (Function & F) {
         if (Function * CalledFunc = CI->getCalledFunction()) {
           std::string name = CalledFunc->getName().str();
           if (name == "memset") {
-            findFlow (CI->getOperand(3), F);
+            findFlow (CI->getArgOperand(1), F, S);
           }
         }
       }
@@ -216,10 +359,96 @@ FindFlows::findSources (Function & F) {
 }
 
 //
-// Method: findCallTargets()
+// Method: sliceFrom()
+//
+// Description:
+//  Find the sources of information for a single instruction.  Only the part of
+//  the flow graph reaching the instruction is searched.  The sources, returns,
+//  and arguments found are added to the results of this pass.  Since values
+//  already searched are remembered, repeated queries only search the part of
+//  the flow graph not reached by earlier queries.
+//
+//  The instruction is the one at which a failure is seen, so the slice must
+//  cover every value that the instruction uses.  For loads and stores that
+//  is the pointer to the memory accessed as well as, for stores, the value
+//  written; for calls (memset among them) it is the called value and each
+//  of the arguments; for allocas it is the number of elements allocated.
+//  Any other instruction is sliced through its own label, which is the join
+//  of the labels of its operands.
+//
+// Inputs:
+//  I - The instruction whose sources should be found.
+//
+void
+FindFlows::sliceFrom (const Instruction * I) {
+  Instruction * Inst = const_cast<Instruction *>(I);
+  const Function & F = *(Inst->getParent()->getParent());
+
+  if ((isa<LoadInst>(Inst)) ||
+      (isa<StoreInst>(Inst)) ||
+      (isa<CallInst>(Inst)) ||
+      (isa<AllocaInst>(Inst))) {
+    for (unsigned index = 0; index < Inst->getNumOperands(); ++index)
+      findFlow (Inst->getOperand (index), F, Results);
+    return;
+  }
+
+  findFlow (Inst, F, Results);
+  return;
+}
+
+//
+// Method: findTargetSources()
+//
+// Description:
+//  Find the sources of information for the instructions selected on the
+//  command line by source file name and line number.  If an index is given,
+//  only the instruction with that index (counting from one in program order)
+//  among those matching the file name and line number is used.
+//
+// Inputs:
+//  M - The module to search for the target instructions.
+//
+void
+FindFlows::findTargetSources (Module & M) {
+  unsigned Matches = 0;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
+      for (BasicBlock::iterator II = BB->begin(); II != BB->end(); ++II) {
+        //
+        // Skip instructions without a matching source location.
+        //
+        MDNode * N = II->getMetadata ("dbg");
+        if (!N) continue;
+        DILocation Loc (N);
+        if (Loc.getLineNumber() != SliceLineNumber) continue;
+        if ((Loc.getFilename() != SliceFileName) &&
+            ((Loc.getDirectory().str() + "/" + Loc.getFilename().str()) !=
+             SliceFileName))
+          continue;
+
+        ++Matches;
+        if ((SliceIndex == 0) || (SliceIndex == Matches))
+          sliceFrom (II);
+      }
+    }
+  }
+
+  if (Matches == 0) {
+    errs() << "FindFlows: No instructions found at " << SliceFileName
+           << ":" << SliceLineNumber << "\n";
+  }
+
+  return;
+}
+
+//
+// Method: computeCallTargets()
 //
 // Description:
 //  Find the set of functions that can be called by the given call instruction.
+//  This queries DSA; the search uses the targets recorded by
+//  buildCallSiteIndex() through findCallTargets() instead.
 //
 // Inputs:
 //  CI      - The call instruction to analyze.
@@ -228,8 +457,8 @@ FindFlows::findSources (Function & F) {
 //  Targets - A list of functions that can be called by the call instruction.
 //
 void
-FindFlows::findCallTargets (CallInst * CI,
-                            std::vector<const Function *> & Targets) {
+FindFlows::computeCallTargets (CallInst * CI,
+                               std::vector<const Function *> & Targets) {
   //
   // Check to see if the call instruction is a direct call.  If so, then add
   // the target to the set of known targets and return.
@@ -257,6 +486,30 @@ FindFlows::findCallTargets (CallInst * CI,
   return;
 }
 
+//
+// Method: findCallTargets()
+//
+// Description:
+//  Return the functions that can be called by the given call instruction, as
+//  recorded by buildCallSiteIndex().
+//
+// Inputs:
+//  CI - The call instruction to analyze.  It must not call inline assembly.
+//
+// Return value:
+//  The list of functions that can be called by the call instruction.  It
+//  remains valid until the pass releases its memory.
+//
+ArrayRef<const Function *>
+FindFlows::findCallTargets (const CallInst * CI) const {
+  CallTargetIndex_t::const_iterator i = CallTargetIndex.find (CI);
+  assert ((i != CallTargetIndex.end()) && "Call instruction not indexed!\n");
+  if (i->second.first == i->second.second)
+    return ArrayRef<const Function *>();
+  return ArrayRef<const Function *> (&(CallTargets[i->second.first]),
+                                     i->second.second - i->second.first);
+}
+
 //
 // Method: findCallSources()
 //
@@ -266,40 +519,40 @@ FindFlows::findCallTargets (CallInst * CI,
 //  return values.
 //
 // Inputs:
-//  CI        - The call instruction whose return value requires a label.
-//  Processed - The set of LLVM values that have already been identified as
-//              part of an information flow.
+//  CI       - The call instruction whose return value requires a label.
+//  S        - The results of the search so far.  Its Resolved set holds the
+//             LLVM values (and the functions in which they are used) that
+//             have already been identified as part of an information flow.
 //
 // Outputs:
-//  Worklist -  The return instructions that determine the value of the call
-//              instruction are added to the worklist.
-//  Processed - Items added to the worklist are also added to the Processed
-//              container to ensure that they are only identified once for
-//              information flow purposes.
+//  Worklist - The return instructions that determine the value of the call
+//             instruction are added to the worklist.
+//  S        - The return instructions are recorded as needing labels.  Items
+//             added to the worklist are also added to the Resolved set to
+//             ensure that they are only identified once for information flow
+//             purposes.
 //
 void
 FindFlows::findCallSources (CallInst * CI,
                             Worklist_t & Worklist,
-                            Processed_t & Processed) {
+                            FlowState & S) {
   //
   // Find the function called by this call instruction.
   //
-  std::vector<const Function *> Targets;
-  findCallTargets (CI, Targets);
+  ArrayRef<const Function *> Targets = findCallTargets (CI);
 
   //
   // Process each potential function call target.
   //
   const Type * VoidType = Type::getVoidTy(getGlobalContext());
-  while (Targets.size()) {
+  for (unsigned index = 0; index < Targets.size(); ++index) {
     // Set of return instructions needing labels discovered
     std::vector<ReturnInst *> NewReturns;
 
     //
     // Process one of the functions from the list of potential call targets.
     //
-    Function * F = const_cast<Function *>((Targets.back()));
-    Targets.pop_back ();
+    Function * F = const_cast<Function *>(Targets[index]);
 
     //
     // Ensure that the function's return value is not void.
@@ -317,21 +570,15 @@ FindFlows::findCallSources (CallInst * CI,
         NewReturns.push_back (RI);
 
     //
-    // Record the returns that require labels.
-    //
-    Returns.insert (NewReturns.begin(), NewReturns.end());
-
-    //
-    // Finally, add any return instructions that have not already been
-    // processed to the worklist.
+    // Record the returns that require labels, and add any return instructions
+    // that have not already been processed to the worklist.
     //
     std::vector<ReturnInst *>::iterator ri;
     for (ri = NewReturns.begin(); ri != NewReturns.end(); ++ri) {
       ReturnInst * RI = *ri;
-      if (Processed.find (RI) == Processed.end()) {
+      S.Returns.set (getValueID (RI));
+      if (markResolved (RI, F, S))
         Worklist.push_back (std::make_pair(RI, F));
-        Processed.insert (RI);
-      }
     }
   }
 
@@ -339,106 +586,197 @@ FindFlows::findCallSources (CallInst * CI,
 }
 
 //
-// Method: findArgSources()
+// Method: buildCallSiteIndex()
 //
 // Description:
-//  Find the label sources for every actual parameter in the worklist of formal
-//  parameters (i.e., arguments) that need labels.
+//  Record the targets of every call instruction, without duplicates, in one
+//  flat array, so that findCallTargets() only needs a hash lookup.
+//  findArgSources() finds the call instructions that may call a function
+//  through its uses and the callers kept by the DSA call graph, so no reverse
+//  map is needed here.
 //
 // Inputs:
-//  Arg       - The argument for which the actual parameters must be labeled.
-//  Processed - The set of LLVM values which have already been discovered as
-//              part of an information flow requiring labels.
-//
-// Outputs:
-//  Worklist  - This set is modified to contain the actual parameters that need
-//              to be processed when back-tracking an information flow.
-//  Processed - This set is updated to hold any new values that were added to
-//              the worklist.  This will prevent them from being added multiple
-//              times.
+//  M - The module to index.
 //
 void
-FindFlows::findArgSources (Argument * Arg,
-                           Worklist_t & Worklist,
-                           Processed_t & Processed) {
-  //
-  // Iterate over all functions in the program looking for call instructions.
-  // When we find a call instruction, we will check to see if the function
-  // has arguments that need labels.  If it does, we'll find the labels of
-  // all the actual parameters.
-  //
-  Module * M = Arg->getParent()->getParent();
-  for (Module::iterator F = M->begin(); F != M->end(); ++F) {
-    // Set of actual arguments needing labels
-    std::vector<Value *> ActualArgs;
-
-    //
-    // Scan the function looking for call instructions.
-    //
+FindFlows::buildCallSiteIndex (Module & M) {
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
     for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
       for (BasicBlock::iterator II = BB->begin(); II != BB->end(); ++II) {
         if (CallInst * CI = dyn_cast<CallInst>(II)) {
           //
           // Ignore inline assembly code.
           //
-          if (isa<InlineAsm>(CI->getOperand(0))) continue;
+          if (isa<InlineAsm>(CI->getCalledValue())) continue;
 
           //
-          // Find the set of functions called by this call instruction.
+          // Record the targets of this call instruction.  Direct calls have
+          // exactly one target; indirect calls get their targets from the DSA
+          // call graph.
           //
           std::vector <const Function *> Targets;
-          findCallTargets (CI, Targets);
-
-          //
-          // Skip this call site if it does not call the function to which the
-          // specified argument belongs.
-          //
-          Function * CalledFunc = Arg->getParent();
+          computeCallTargets (CI, Targets);
           std::set<const Function *> TargetSet;
-          TargetSet.insert (Targets.begin(), Targets.end());
-          if ((TargetSet.find (CalledFunc)) == (TargetSet.end())) continue;
-
-          //
-          // Assert that the call and the called function have the same number
-          // of arguments.
-          //
-          assert ((CalledFunc->getFunctionType()->getNumParams()) ==
-                  (CI->getNumOperands() - 1) &&
-                  "Number of arguments doesn't match function signature!\n");
-
-          //
-          // Walk the argument list of the call instruction and look for actual
-          // arguments needing labels.  Add them to our local worklist.
-          //
-          Function::arg_iterator FormalArg = CalledFunc->arg_begin();
-          for (unsigned index = 1;
-               index < CI->getNumOperands();
-               ++index, ++FormalArg) {
-            if (((Argument *)(FormalArg)) == Arg) {
-              if (Processed.find (CI->getOperand(index)) == Processed.end()) {
-                ActualArgs.push_back (CI->getOperand(index));
-              }
-            }
+          unsigned First = CallTargets.size();
+          for (unsigned index = 0; index < Targets.size(); ++index) {
+            if (TargetSet.insert (Targets[index]).second)
+              CallTargets.push_back (Targets[index]);
           }
+          CallTargetIndex[CI] = std::make_pair (First, CallTargets.size());
+          ++NumIndexedCalls;
         }
       }
     }
+  }
 
-    //
-    // Finally, find the sources for all the actual arguments needing labels.
-    //
-    std::vector<Value *>::iterator i;
-    for (i = ActualArgs.begin(); i != ActualArgs.end(); ++i) {
-      Value * V = *i;
-      Worklist.push_back (std::make_pair (V, F));
+  return;
+}
+
+//
+// Method: buildMemoryIndex()
+//
+// Description:
+//  Find the stores that may write the memory read by each load, so that the
+//  search for flows can continue through memory instead of stopping at
+//  loads.  Memory is identified by the DSNode and the range of offsets
+//  accessed in the EQTD graphs.
+//
+//  A load is only followed if every write to its memory is a store that
+//  refers to the same DSNode.  This excludes memory which DSA does not fully
+//  know (incomplete, unknown, external or integer-derived nodes), memory
+//  reachable from globals, and memory reachable from function arguments,
+//  return values, or call operands, since that can be written through
+//  another graph.  Loads reaching more stores than the memory budget allows
+//  also remain sources.
+//
+//  All DSA queries happen here, so threads searching in parallel only read
+//  the index.
+//
+// Inputs:
+//  M - The module to index.
+//
+void
+FindFlows::buildMemoryIndex (Module & M) {
+  typedef std::vector<std::pair<std::pair<unsigned, unsigned>, StoreInst *> >
+          NodeStores_t;
+  DenseMap<const DSNode *, NodeStores_t> Stores;
+  DenseSet<const DSNode *> Escaping;
+  std::set<DSGraph *> Graphs;
+  const DataLayout & TD = dsaPass->getDataLayout();
+
+  //
+  // Record the memory written by each store and the memory that escapes the
+  // graph of each function.
+  //
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration() || (!dsaPass->hasDSGraph (*F)))
+      continue;
+
+    DSGraph * G = dsaPass->getDSGraph (*F);
+    Graphs.insert (G);
+    for (Function::arg_iterator Arg = F->arg_begin(); Arg != F->arg_end();
+         ++Arg)
+      if (G->hasNodeForValue (Arg))
+        G->getNodeForValue (Arg).getNode()->markReachableNodes (Escaping);
+
+    for (inst_iterator I = inst_begin (F); I != inst_end (F); ++I) {
+      if (StoreInst * SI = dyn_cast<StoreInst>(&*I)) {
+        Value * Ptr = SI->getPointerOperand();
+        if (!(G->hasNodeForValue (Ptr)))
+          continue;
+        const DSNodeHandle & NH = G->getNodeForValue (Ptr);
+        if (!NH.getNode())
+          continue;
+        unsigned Size = TD.getTypeStoreSize (SI->getValueOperand()->getType());
+        Stores[NH.getNode()].push_back (
+          std::make_pair (std::make_pair (NH.getOffset(), Size), SI));
+        continue;
+      }
+
+      //
+      // Memory passed to or returned from a call may be written by the
+      // callee.  Atomic instructions write memory without a store.
+      //
+      if (isa<CallInst>(&*I) || isa<InvokeInst>(&*I) ||
+          isa<AtomicRMWInst>(&*I) || isa<AtomicCmpXchgInst>(&*I)) {
+        if (G->hasNodeForValue (&*I))
+          G->getNodeForValue (&*I).getNode()->markReachableNodes (Escaping);
+        for (unsigned index = 0; index < I->getNumOperands(); ++index) {
+          Value * Op = I->getOperand (index);
+          if (G->hasNodeForValue (Op))
+            G->getNodeForValue (Op).getNode()->markReachableNodes (Escaping);
+        }
+      }
     }
+  }
 
-    //
-    // Add the new items to process to the processed list.
-    //
-    for (unsigned index = 0; index < ActualArgs.size(); ++index) {
-      if (!(isa<Constant>(ActualArgs[index])))
-        Processed.insert (ActualArgs[index]);
+  for (std::set<DSGraph *>::iterator gi = Graphs.begin();
+       gi != Graphs.end();
+       ++gi) {
+    DSGraph * G = *gi;
+    for (DSGraph::retnodes_iterator ri = G->retnodes_begin();
+         ri != G->retnodes_end();
+         ++ri)
+      ri->second.getNode()->markReachableNodes (Escaping);
+    for (DSGraph::vanodes_iterator vi = G->vanodes_begin();
+         vi != G->vanodes_end();
+         ++vi)
+      vi->second.getNode()->markReachableNodes (Escaping);
+    for (DSGraph::node_iterator ni = G->node_begin();
+         ni != G->node_end();
+         ++ni)
+      if (ni->isGlobalNode())
+        ni->markReachableNodes (Escaping);
+  }
+
+  //
+  // Find the stores reaching each load of memory that does not escape.
+  //
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (F->isDeclaration() || (!dsaPass->hasDSGraph (*F)))
+      continue;
+
+    DSGraph * G = dsaPass->getDSGraph (*F);
+    for (inst_iterator I = inst_begin (F); I != inst_end (F); ++I) {
+      LoadInst * LI = dyn_cast<LoadInst>(&*I);
+      if (!LI) continue;
+
+      Value * Ptr = LI->getPointerOperand();
+      if (!(G->hasNodeForValue (Ptr)))
+        continue;
+      const DSNodeHandle & NH = G->getNodeForValue (Ptr);
+      const DSNode * N = NH.getNode();
+      if ((!N) ||
+          (N->isIncompleteNode()) ||
+          (N->isUnknownNode()) ||
+          (N->isExternalNode()) ||
+          (N->isIntToPtrNode()) ||
+          (Escaping.count (N)))
+        continue;
+
+      DenseMap<const DSNode *, NodeStores_t>::iterator NS = Stores.find (N);
+      if (NS == Stores.end())
+        continue;
+
+      //
+      // Collect the stores writing bytes that the load reads.  The offsets of
+      // a collapsed node are meaningless, so every store to it may write
+      // those bytes.
+      //
+      unsigned Start = NH.getOffset();
+      unsigned End = Start + TD.getTypeStoreSize (LI->getType());
+      std::vector<StoreInst *> Writers;
+      for (unsigned index = 0; index < NS->second.size(); ++index) {
+        unsigned StoreStart = NS->second[index].first.first;
+        unsigned StoreEnd = StoreStart + NS->second[index].first.second;
+        if (N->isCollapsedNode() || ((StoreStart < End) && (Start < StoreEnd)))
+          Writers.push_back (NS->second[index].second);
+      }
+
+      if (Writers.empty() || (Writers.size() > MemoryBudget))
+        continue;
+      LoadStores[LI] = Writers;
+      ++NumTracedLoads;
     }
   }
 
@@ -446,32 +784,1059 @@ FindFlows::findArgSources (Argument * Arg,
 }
 
 //
-// Method: runOnModule()
+// Method: findLoadSources()
 //
 // Description:
-//  Entry point for this LLVM pass.  Find statements that require the
-//  label of a piece of information and then find the sources of that
-//  information.
+//  If the memory read by the given load is only written by known stores, add
+//  the values those stores write to the worklist.
 //
 // Inputs:
-//  M - The module to analyze.
+//  LI       - The load whose label is needed.
+//  S        - The results of the search so far.
+//
+// Outputs:
+//  Worklist - The values written by the stores are added to the worklist.
+//  S        - The values added to the worklist are recorded in the Resolved
+//             set so that they are only identified once.
 //
 // Return value:
-//  false - The module was not modified.
+//  true  - The load was followed to the stores writing its memory.
+//  false - The load could not be followed and is a source.
 //
 bool
-FindFlows::runOnModule (Module & M) {
-  //
-  // Get prerequisite passes.
-  //
-  dsaPass = &getAnalysis<EQTDDataStructures>();
+FindFlows::findLoadSources (LoadInst * LI,
+                            Worklist_t & Worklist,
+                            FlowState & S) {
+  LoadStoreIndex_t::const_iterator Writers = LoadStores.find (LI);
+  if (Writers == LoadStores.end())
+    return false;
+
+  for (unsigned index = 0; index < Writers->second.size(); ++index) {
+    StoreInst * SI = Writers->second[index];
+    const Function * F = SI->getParent()->getParent();
+    Value * V = SI->getValueOperand();
+    ++S.LoadStores;
+    if (markResolved (V, F, S))
+      Worklist.push_back (std::make_pair (V, F));
+  }
+
+  return true;
+}
+
+//
+// Method: findCallers()
+//
+// Description:
+//  Find the call instructions that may call the specified function.  Direct
+//  calls are found among the uses of the function.  Indirect calls are found
+//  through the callers kept by the DSA call graph, which are the call sites
+//  that may call any function in the SCC of the function; only those whose
+//  recorded targets include the function are kept.
+//
+// Inputs:
+//  F       - The function whose callers are wanted.
+//
+// Outputs:
+//  Callers - The call instructions that may call F are appended to this list.
+//
+void
+FindFlows::findCallers (const Function * F,
+                        SmallVectorImpl<CallInst *> & Callers) const {
+  for (Value::const_use_iterator U = F->use_begin(); U != F->use_end(); ++U) {
+    CallInst * CI = dyn_cast<CallInst>(const_cast<User *>(*U));
+    if (CI && (CI->getCalledFunction() == F) &&
+        (U.getOperandNo() == CI->getNumArgOperands()))
+      Callers.push_back (CI);
+  }
+
+  const DSCallGraph & CallGraph = dsaPass->getCallGraph();
+  DSCallGraph::caller_iterator cs;
+  for (cs = CallGraph.caller_begin(F); cs != CallGraph.caller_end(F); ++cs) {
+    CallInst * CI = dyn_cast<CallInst>(cs->getInstruction());
+    if ((!CI) || (CI->getCalledFunction()) ||
+        (isa<InlineAsm>(CI->getCalledValue())))
+      continue;
+    ArrayRef<const Function *> Targets = findCallTargets (CI);
+    if (std::find (Targets.begin(), Targets.end(), F) != Targets.end())
+      Callers.push_back (CI);
+  }
+
+  return;
+}
 
+//
+// Method: findArgSources()
+//
+// Description:
+//  Find the label sources for every actual parameter in the worklist of formal
+//  parameters (i.e., arguments) that need labels.
+//
+// Inputs:
+//  Arg      - The argument for which the actual parameters must be labeled.
+//  S        - The results of the search so far.  Its Resolved set holds the
+//             LLVM values (and the functions in which they are used) which
+//             have already been discovered as part of an information flow
+//             requiring labels.
+//
+// Outputs:
+//  Worklist - This set is modified to contain the actual parameters that need
+//             to be processed when back-tracking an information flow.
+//  S        - The Resolved set is updated to hold any new values that were
+//             added to the worklist.  This will prevent them from being added
+//             multiple times.
+//
+void
+FindFlows::findArgSources (Argument * Arg,
+                           Worklist_t & Worklist,
+                           FlowState & S) {
   //
-  // Begin by finding the sources of all labels for store instructions.
+  // Look up the call instructions that may call the function to which the
+  // specified argument belongs.  If there are none, there is nothing to do.
   //
-  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
-    findSources (*F);
+  Function * CalledFunc = Arg->getParent();
+  SmallVector<CallInst *, 8> Callers;
+  findCallers (CalledFunc, Callers);
+
+  SmallVector<CallInst *, 8>::iterator ci;
+  for (ci = Callers.begin(); ci != Callers.end(); ++ci) {
+    CallInst * CI = *ci;
+    const Function * F = CI->getParent()->getParent();
+    ++S.ArgCallSites;
+
+    //
+    // Assert that the call passes an actual argument for every formal
+    // argument of the called function.
+    //
+    assert ((CalledFunc->getFunctionType()->getNumParams()) <=
+            (CI->getNumArgOperands()) &&
+            "Number of arguments doesn't match function signature!\n");
+
+    //
+    // Find the actual argument passed for the formal argument needing a
+    // label.  Add it to the worklist, and add it to the processed list so
+    // that it is only identified once.
+    //
+    Value * V = CI->getArgOperand (Arg->getArgNo());
+    if (markResolved (V, F, S))
+      Worklist.push_back (std::make_pair (V, F));
+  }
+
+  return;
+}
+
+//
+// Method: FlowState::mergeInto()
+//
+// Description:
+//  Add the results held in this object to another set of results.  Every
+//  result is kept as a set of value numbers, so the merged results do not
+//  depend on the order in which results are merged.  Both objects must have
+//  been reset for the same number of functions.
+//
+// Outputs:
+//  Dest - The results into which these results are merged.
+//
+void
+FindFlows::FlowState::mergeInto (FlowState & Dest) const {
+  assert ((Sources.size() == Dest.Sources.size()) &&
+          "Merging results of different modules!\n");
+  for (unsigned index = 0; index < Sources.size(); ++index) {
+    Dest.Sources[index] |= Sources[index];
+    Dest.Resolved[index] |= Resolved[index];
+  }
+  Dest.PhiNodes |= PhiNodes;
+  Dest.Returns |= Returns;
+  Dest.Args |= Args;
+  Dest.ResolvedHits += ResolvedHits;
+  Dest.ArgCallSites += ArgCallSites;
+  Dest.LoadStores += LoadStores;
+  Dest.WorklistItems += WorklistItems;
+  return;
+}
+
+//
+// Method: FlowState::clear()
+//
+// Description:
+//  Discard all results.
+//
+void
+FindFlows::FlowState::clear (void) {
+  Sources.clear();
+  PhiNodes.clear();
+  Returns.clear();
+  Args.clear();
+  Resolved.clear();
+  ResolvedHits = 0;
+  ArgCallSites = 0;
+  LoadStores = 0;
+  WorklistItems = 0;
+  return;
+}
+
+//
+// Method: FlowState::reset()
+//
+// Description:
+//  Discard all results and prepare to record the results for a module with
+//  the specified number of functions.
+//
+// Inputs:
+//  NumFunctions - The number of functions numbered in the module.
+//
+void
+FindFlows::FlowState::reset (unsigned NumFunctions) {
+  clear();
+  Sources.resize (NumFunctions);
+  Resolved.resize (NumFunctions);
+  return;
+}
+
+//
+// Method: numberValue()
+//
+// Description:
+//  Give the specified value the next unused number if it does not have one.
+//
+// Inputs:
+//  V - The value to number.
+//
+void
+FindFlows::numberValue (const Value * V) {
+  if (ValueIDs.insert (std::make_pair (V, Values.size())).second)
+    Values.push_back (V);
+  return;
+}
+
+//
+// Method: numberValues()
+//
+// Description:
+//  Number the functions of the module and every value that the search for
+//  flows can reach: global values, function arguments, instructions, and the
+//  operands of instructions.  The numbers are dense, so the results of the
+//  search can be held in bitvectors of value numbers.  All numbers are given
+//  before the search starts, so threads searching in parallel only read them.
+//
+// Inputs:
+//  M - The module whose values should be numbered.
+//
+void
+FindFlows::numberValues (Module & M) {
+  for (Module::global_iterator GV = M.global_begin(); GV != M.global_end();
+       ++GV)
+    numberValue (GV);
+
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    FunctionIDs.insert (std::make_pair (F, FunctionIDs.size()));
+    numberValue (F);
+    for (Function::arg_iterator Arg = F->arg_begin(); Arg != F->arg_end();
+         ++Arg)
+      numberValue (Arg);
+    for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
+      for (BasicBlock::iterator II = BB->begin(); II != BB->end(); ++II) {
+        numberValue (II);
+        for (unsigned index = 0; index < II->getNumOperands(); ++index)
+          numberValue (II->getOperand (index));
+      }
+    }
+  }
+
+  NumValues += Values.size();
+  return;
+}
+
+//
+// Method: getSources()
+//
+// Description:
+//  Return the numbers of the sources of the labels needed in the specified
+//  function.  A function without sources yields an empty set; no entry is
+//  created for it.
+//
+const FindFlows::ValueSet &
+FindFlows::getSources (const Function * F) const {
+  static const ValueSet NoSources;
+  DenseMap<const Function *, unsigned>::const_iterator i;
+  i = FunctionIDs.find (F);
+  if (i == FunctionIDs.end())
+    return NoSources;
+  return Results.Sources[i->second];
+}
+
+//
+// Method: runFlowThread()
+//
+// Description:
+//  Entry point for a thread searching for flows in parallel.  Repeatedly claim
+//  the next function that no thread has processed and find its sources.
+//
+// Inputs:
+//  Arg - The FlowThread describing the work of this thread.
+//
+// Return value:
+//  NULL is always returned.
+//
+void *
+FindFlows::runFlowThread (void * Arg) {
+  FlowThread * T = (FlowThread *) Arg;
+  const std::vector<Function *> & Functions = *(T->Functions);
+  while (true) {
+    unsigned index = sys::AtomicIncrement (T->NextFunction) - 1;
+    if (index >= Functions.size())
+      break;
+    T->Pass->findSources (*(Functions[index]), T->State);
+  }
+
+  return 0;
+}
+
+//
+// Method: findSourcesInParallel()
+//
+// Description:
+//  Find the sources for every function in a list using several threads.
+//  Each thread records its results separately; the results are merged in
+//  thread order once every thread has finished.  Since the merge is a union
+//  of ordered sets, the results are identical to those of a serial search.
+//
+// Inputs:
+//  Functions  - The functions to analyze.
+//  NumThreads - The number of threads to use.
+//
+void
+FindFlows::findSourcesInParallel (const std::vector<Function *> & Functions,
+                                  unsigned NumThreads) {
+  volatile sys::cas_flag NextFunction = 0;
+  std::vector<FlowThread> Threads (NumThreads);
+  std::vector<pthread_t> Handles (NumThreads);
+  std::vector<bool> Started (NumThreads, false);
+  for (unsigned index = 0; index < NumThreads; ++index) {
+    Threads[index].Pass = this;
+    Threads[index].Functions = &Functions;
+    Threads[index].NextFunction = &NextFunction;
+    Threads[index].State.reset (FunctionIDs.size());
+  }
+
+  //
+  // Start the worker threads.  If a thread cannot be created, the remaining
+  // work is done by the threads that could be, and by this thread below.
+  //
+  for (unsigned index = 1; index < NumThreads; ++index) {
+    Started[index] = (pthread_create (&Handles[index],
+                                      0,
+                                      runFlowThread,
+                                      &Threads[index]) == 0);
+  }
+  runFlowThread (&Threads[0]);
+
+  //
+  // Wait for all of the threads and merge their results.
+  //
+  for (unsigned index = 1; index < NumThreads; ++index) {
+    if (Started[index])
+      pthread_join (Handles[index], 0);
+  }
+  for (unsigned index = 0; index < NumThreads; ++index)
+    Threads[index].State.mergeInto (Results);
+
+  return;
+}
+
+//
+// Function: hashBytes()
+//
+// Description:
+//  Add bytes to a 64-bit FNV-1a hash.  The hash does not depend on the host or
+//  the run, so it can be compared with hashes saved by earlier runs.
+//
+static uint64_t
+hashBytes (uint64_t Hash, const void * Data, size_t Size) {
+  const unsigned char * Bytes = (const unsigned char *) Data;
+  for (size_t index = 0; index < Size; ++index) {
+    Hash ^= Bytes[index];
+    Hash *= 0x100000001b3ULL;
+  }
+  return Hash;
+}
+
+static uint64_t
+hashString (uint64_t Hash, StringRef Str) {
+  uint64_t Length = Str.size();
+  Hash = hashBytes (Hash, &Length, sizeof (Length));
+  return hashBytes (Hash, Str.data(), Str.size());
+}
+
+static const uint64_t InitialHash = 0xcbf29ce484222325ULL;
+
+//
+// Function: hashInteger()
+//
+// Description:
+//  Add an integer to a hash.
+//
+static uint64_t
+hashInteger (uint64_t Hash, uint64_t Value) {
+  return hashBytes (Hash, &Value, sizeof (Value));
+}
+
+//
+// Function: hashAPInt()
+//
+// Description:
+//  Add the width and bits of an arbitrary precision integer to a hash.
+//
+static uint64_t
+hashAPInt (uint64_t Hash, const APInt & Value) {
+  Hash = hashInteger (Hash, Value.getBitWidth());
+  return hashBytes (Hash,
+                    Value.getRawData(),
+                    Value.getNumWords() * sizeof (uint64_t));
+}
+
+//
+// Function: hashType()
+//
+// Description:
+//  Add the structure of a type to a hash.  Named structures are identified by
+//  their names, so recursive types are hashed without recursing forever.
+//
+static uint64_t
+hashType (uint64_t Hash, Type * T) {
+  Hash = hashInteger (Hash, T->getTypeID());
+  if (IntegerType * IT = dyn_cast<IntegerType>(T))
+    return hashInteger (Hash, IT->getBitWidth());
+  if (StructType * ST = dyn_cast<StructType>(T)) {
+    if (!ST->isLiteral())
+      return hashString (Hash, ST->getName());
+    Hash = hashInteger (Hash, ST->isPacked());
+  } else if (ArrayType * AT = dyn_cast<ArrayType>(T)) {
+    Hash = hashInteger (Hash, AT->getNumElements());
+  } else if (VectorType * VT = dyn_cast<VectorType>(T)) {
+    Hash = hashInteger (Hash, VT->getNumElements());
+  } else if (PointerType * PT = dyn_cast<PointerType>(T)) {
+    Hash = hashInteger (Hash, PT->getAddressSpace());
+  } else if (FunctionType * FT = dyn_cast<FunctionType>(T)) {
+    Hash = hashInteger (Hash, FT->isVarArg());
+  }
+
+  Hash = hashInteger (Hash, T->getNumContainedTypes());
+  for (Type::subtype_iterator ST = T->subtype_begin();
+       ST != T->subtype_end();
+       ++ST)
+    Hash = hashType (Hash, *ST);
+  return Hash;
+}
+
+//
+// Function: hashOperand()
+//
+// Description:
+//  Add the contents of an operand that is not an argument or instruction to a
+//  hash.  Global values are identified by name and constants by their
+//  contents.  Metadata is only identified as such, so that debug information
+//  does not change the hash.
+//
+static uint64_t
+hashOperand (uint64_t Hash, const Value * V) {
+  Hash = hashInteger (Hash, V->getValueID());
+  if (const GlobalValue * GV = dyn_cast<GlobalValue>(V))
+    return hashString (Hash, GV->getName());
+  if ((isa<MDNode>(V)) || (isa<MDString>(V)) || (isa<BasicBlock>(V)))
+    return Hash;
+  if (const InlineAsm * IA = dyn_cast<InlineAsm>(V)) {
+    Hash = hashString (Hash, IA->getAsmString());
+    return hashString (Hash, IA->getConstraintString());
+  }
+
+  Hash = hashType (Hash, V->getType());
+  if (const ConstantInt * CI = dyn_cast<ConstantInt>(V))
+    return hashAPInt (Hash, CI->getValue());
+  if (const ConstantFP * CFP = dyn_cast<ConstantFP>(V))
+    return hashAPInt (Hash, CFP->getValueAPF().bitcastToAPInt());
+  if (const ConstantDataSequential * CDS = dyn_cast<ConstantDataSequential>(V))
+    return hashString (Hash, CDS->getRawDataValues());
+  if (const ConstantExpr * CE = dyn_cast<ConstantExpr>(V)) {
+    Hash = hashInteger (Hash, CE->getOpcode());
+    if (CE->isCompare())
+      Hash = hashInteger (Hash, CE->getPredicate());
+  }
+
+  if (const User * U = dyn_cast<User>(V)) {
+    Hash = hashInteger (Hash, U->getNumOperands());
+    for (unsigned index = 0; index < U->getNumOperands(); ++index)
+      Hash = hashOperand (Hash, U->getOperand (index));
+  }
+  return Hash;
+}
+
+//
+// Function: compareNames()
+//
+// Description:
+//  Order functions by name.
+//
+static bool
+compareNames (const Function * A, const Function * B) {
+  return A->getName() < B->getName();
+}
+
+//
+// Method: getLocalValues()
+//
+// Description:
+//  List the values that the flows of a function may refer to: its arguments,
+//  its instructions, and the operands of its instructions, in the order in
+//  which they are first found walking the function.  The position of a value
+//  in this list identifies it in a flow database.  It does not depend on any
+//  other function, so it remains valid while the function does not change.
+//
+// Inputs:
+//  F - The function whose values should be listed.
+//
+// Outputs:
+//  Locals - The values of the function.
+//
+void
+FindFlows::getLocalValues (const Function & F,
+                           std::vector<const Value *> & Locals) {
+  SmallPtrSet<const Value *, 64> Seen;
+  for (Function::const_arg_iterator Arg = F.arg_begin(); Arg != F.arg_end();
+       ++Arg)
+    if (Seen.insert (Arg))
+      Locals.push_back (Arg);
+
+  for (Function::const_iterator BB = F.begin(); BB != F.end(); ++BB) {
+    for (BasicBlock::const_iterator II = BB->begin(); II != BB->end(); ++II) {
+      if (Seen.insert (II))
+        Locals.push_back (II);
+      for (unsigned index = 0; index < II->getNumOperands(); ++index) {
+        const Value * Op = II->getOperand (index);
+        if (Seen.insert (Op))
+          Locals.push_back (Op);
+      }
+    }
+  }
+
+  return;
+}
+
+//
+// Method: hashFunctions()
+//
+// Description:
+//  Compute the hashes identifying the version of each function in the module
+//  that a flow database is valid for.
+//
+//  The body hash covers the structure of the function: the types and opcodes
+//  of its instructions and the operands of each, with arguments and
+//  instructions identified by their position in getLocalValues() and other
+//  operands by their contents.  Debug information and the numbering of
+//  unnamed values do not change it.  It also covers the targets DSA finds for
+//  each call, the options for following flows through memory, and the stores
+//  found for each load.
+//
+//  The flows saved for a function are the values in that function which the
+//  search reaches, starting from any function.  A value flows from a function
+//  into another when a call whose result is used may call the other function,
+//  when the other function calls it and uses an argument, or when a load
+//  reads memory written by a store in the other function.  The dependency
+//  hash of a function covers the names and body hashes of the function and
+//  of every function from which flows may reach it, directly or through other
+//  functions.  Flows saved for a function are only valid if its dependency
+//  hash is unchanged.
+//
+// Inputs:
+//  M - The module whose functions should be hashed.
+//
+// Outputs:
+//  BodyHashes       - The body hash of each function, by function number.
+//  DependencyHashes - The dependency hash of each function, by function
+//                     number.
+//
+void
+FindFlows::hashFunctions (Module & M,
+                          std::vector<uint64_t> & BodyHashes,
+                          std::vector<uint64_t> & DependencyHashes) {
+  std::vector<Function *> Functions (FunctionIDs.size());
+  for (Module::iterator F = M.begin(); F != M.end(); ++F)
+    Functions[getFunctionID (F)] = F;
+
+  //
+  // Number the instructions of each function so that stores can be named
+  // without referring to the text of their functions.
+  //
+  DenseMap<const Instruction *, unsigned> InstIndex;
+  if (FlowsThroughMemory) {
+    for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+      unsigned Count = 0;
+      for (inst_iterator I = inst_begin (F); I != inst_end (F); ++I)
+        InstIndex[&*I] = Count++;
+    }
+  }
+
+  //
+  // Hash the body of each function, and find the functions from which flows
+  // may reach each function.
+  //
+  BodyHashes.assign (Functions.size(), InitialHash);
+  std::vector<std::vector<unsigned> > Preds (Functions.size());
+  for (unsigned index = 0; index < Functions.size(); ++index) {
+    Function * F = Functions[index];
+    uint64_t Hash = hashType (InitialHash, F->getFunctionType());
+
+    //
+    // Flows through memory depend on the options used to follow them.
+    //
+    unsigned MemoryOptions[2] = { FlowsThroughMemory, MemoryBudget };
+    Hash = hashBytes (Hash, MemoryOptions, sizeof (MemoryOptions));
+
+    std::vector<const Value *> Locals;
+    getLocalValues (*F, Locals);
+    DenseMap<const Value *, unsigned> LocalIndex;
+    for (unsigned local = 0; local < Locals.size(); ++local)
+      LocalIndex[Locals[local]] = local;
+
+    for (Function::iterator BB = F->begin(); BB != F->end(); ++BB) {
+      Hash = hashInteger (Hash, BB->size());
+      for (BasicBlock::iterator II = BB->begin(); II != BB->end(); ++II) {
+        Hash = hashInteger (Hash, II->getOpcode());
+        Hash = hashType (Hash, II->getType());
+        if (CmpInst * CI = dyn_cast<CmpInst>(II))
+          Hash = hashInteger (Hash, CI->getPredicate());
+        Hash = hashInteger (Hash, II->getNumOperands());
+        for (unsigned op = 0; op < II->getNumOperands(); ++op) {
+          const Value * Op = II->getOperand (op);
+          Hash = hashInteger (Hash, LocalIndex[Op]);
+          if ((!isa<Instruction>(Op)) && (!isa<Argument>(Op)))
+            Hash = hashOperand (Hash, Op);
+        }
+
+        //
+        // Hash the targets of calls.  Flows reach a target from the caller
+        // if the result of the call is used.
+        //
+        CallInst * CI = dyn_cast<CallInst>(II);
+        if (CI && (!isa<InlineAsm>(CI->getCalledValue()))) {
+          ArrayRef<const Function *> Callees = findCallTargets (CI);
+          std::vector<const Function *> Targets (Callees.begin(),
+                                                 Callees.end());
+          std::sort (Targets.begin(), Targets.end(), compareNames);
+          for (unsigned t = 0; t < Targets.size(); ++t) {
+            Hash = hashString (Hash, Targets[t]->getName());
+            if (!CI->use_empty())
+              Preds[getFunctionID (Targets[t])].push_back (index);
+          }
+          Hash = hashString (Hash, "");
+        }
+
+        //
+        // Hash the stores found for loads.  Flows reach the functions of the
+        // stores from the function of the load.
+        //
+        LoadInst * LI = dyn_cast<LoadInst>(II);
+        if (LI && FlowsThroughMemory) {
+          LoadStoreIndex_t::const_iterator Writers = LoadStores.find (LI);
+          std::vector<std::pair<StringRef, unsigned> > Stores;
+          if (Writers != LoadStores.end()) {
+            for (unsigned s = 0; s < Writers->second.size(); ++s) {
+              StoreInst * SI = Writers->second[s];
+              const Function * Writer = SI->getParent()->getParent();
+              Stores.push_back (std::make_pair (Writer->getName(),
+                                                InstIndex[SI]));
+              Preds[getFunctionID (Writer)].push_back (index);
+            }
+            std::sort (Stores.begin(), Stores.end());
+          }
+          Hash = hashInteger (Hash, Writers != LoadStores.end());
+          Hash = hashInteger (Hash, Stores.size());
+          for (unsigned s = 0; s < Stores.size(); ++s) {
+            Hash = hashString (Hash, Stores[s].first);
+            Hash = hashInteger (Hash, Stores[s].second);
+          }
+        }
+      }
+    }
+
+    //
+    // Flows reach the callers of the function from the function if it uses
+    // one of its arguments.
+    //
+    bool UsesArgs = false;
+    for (Function::arg_iterator Arg = F->arg_begin(); Arg != F->arg_end();
+         ++Arg)
+      if (!Arg->use_empty())
+        UsesArgs = true;
+    if (UsesArgs) {
+      SmallVector<CallInst *, 8> Callers;
+      findCallers (F, Callers);
+      for (unsigned c = 0; c < Callers.size(); ++c) {
+        const Function * Caller = Callers[c]->getParent()->getParent();
+        Preds[getFunctionID (Caller)].push_back (index);
+      }
+    }
+
+    BodyHashes[index] = Hash;
+  }
+
+  //
+  // Combine the hashes of every function from which flows may reach each
+  // function.  The hashes are added so that the result does not depend on
+  // the order in which the functions are found.
+  //
+  DependencyHashes.assign (Functions.size(), InitialHash);
+  std::vector<unsigned> Visited (Functions.size(), 0);
+  std::vector<unsigned> Stack;
+  for (unsigned index = 0; index < Functions.size(); ++index) {
+    unsigned Epoch = index + 1;
+    uint64_t Sum = 0;
+    uint64_t Count = 0;
+    Visited[index] = Epoch;
+    Stack.push_back (index);
+    while (!Stack.empty()) {
+      unsigned Current = Stack.back();
+      Stack.pop_back();
+      uint64_t Member = hashString (InitialHash,
+                                    Functions[Current]->getName());
+      Sum += hashInteger (Member, BodyHashes[Current]);
+      ++Count;
+      for (unsigned p = 0; p < Preds[Current].size(); ++p) {
+        unsigned Pred = Preds[Current][p];
+        if (Visited[Pred] != Epoch) {
+          Visited[Pred] = Epoch;
+          Stack.push_back (Pred);
+        }
+      }
+    }
+    DependencyHashes[index] = hashInteger (hashInteger (InitialHash, Sum),
+                                           Count);
+  }
+
+  return;
+}
+
+//
+// Method: restoreFunction()
+//
+// Description:
+//  Add the flows saved for a function to the results of this pass.
+//
+// Inputs:
+//  F  - The function whose flows should be restored.
+//  DB - The flow database.
+//  R  - The record of the function in the database.
+//
+// Return value:
+//  true  - The flows were restored.
+//  false - The record does not fit the function; nothing was restored.
+//
+bool
+FindFlows::restoreFunction (const Function & F,
+                            const FlowDatabase & DB,
+                            const FlowDatabase::FunctionRecord & R) {
+  std::vector<const Value *> Locals;
+  getLocalValues (F, Locals);
+
+  //
+  // Check every index before restoring anything.
+  //
+  for (unsigned kind = 0; kind < FlowDatabase::NumSetKinds; ++kind) {
+    ArrayRef<uint32_t> Set = DB.getSet (R, (FlowDatabase::SetKind) kind);
+    for (unsigned index = 0; index < Set.size(); ++index) {
+      if (Set[index] >= Locals.size())
+        return false;
+      const Value * V = Locals[Set[index]];
+      if (((kind == FlowDatabase::PhiNodes) && (!isa<PHINode>(V))) ||
+          ((kind == FlowDatabase::Returns) && (!isa<ReturnInst>(V))) ||
+          ((kind == FlowDatabase::Args) && (!isa<Argument>(V))))
+        return false;
+    }
+  }
+
+  unsigned FID = getFunctionID (&F);
+  ValueSet * Sets[FlowDatabase::NumSetKinds] = {
+    &(Results.Sources[FID]),
+    &(Results.Resolved[FID]),
+    &(Results.PhiNodes),
+    &(Results.Returns),
+    &(Results.Args)
+  };
+  for (unsigned kind = 0; kind < FlowDatabase::NumSetKinds; ++kind) {
+    ArrayRef<uint32_t> Set = DB.getSet (R, (FlowDatabase::SetKind) kind);
+    for (unsigned index = 0; index < Set.size(); ++index)
+      Sets[kind]->set (getValueID (Locals[Set[index]]));
+  }
+
+  return true;
+}
+
+//
+// Method: loadDatabase()
+//
+// Description:
+//  Restore the flows saved by an earlier run for every function whose body
+//  and dependency hashes are unchanged.
+//
+// Inputs:
+//  M                - The module being analyzed.
+//  BodyHashes       - The body hash of each function, by function number.
+//  DependencyHashes - The dependency hash of each function, by function
+//                     number.
+//
+// Outputs:
+//  Changed  - The functions whose flows were not restored and must be
+//             searched.
+//  Restored - The functions whose flows were restored.
+//
+void
+FindFlows::loadDatabase (Module & M,
+                         const std::vector<uint64_t> & BodyHashes,
+                         const std::vector<uint64_t> & DependencyHashes,
+                         std::vector<Function *> & Changed,
+                         std::vector<Function *> & Restored) {
+  std::string Error;
+  OwningPtr<FlowDatabase> DB (FlowDatabase::load (FlowDatabaseName, Error));
+  if (!DB) {
+    for (Module::iterator F = M.begin(); F != M.end(); ++F)
+      Changed.push_back (F);
+    return;
+  }
+
+  //
+  // Restore the functions with a matching record.  If a record cannot be
+  // restored, search its function again along with the rest of the module.
+  //
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    unsigned FID = getFunctionID (F);
+    const FlowDatabase::FunctionRecord * R = 0;
+    if (F->hasName())
+      R = DB->lookup (F->getName());
+    if ((R) &&
+        (R->BodyHash == BodyHashes[FID]) &&
+        (R->DependencyHash == DependencyHashes[FID]) &&
+        (restoreFunction (*F, *DB, *R))) {
+      Restored.push_back (F);
+      ++NumReused;
+    } else {
+      Changed.push_back (F);
+    }
+  }
+
+  return;
+}
+
+//
+// Method: findRestoredSources()
+//
+// Description:
+//  Continue the flows restored for the specified functions into the
+//  functions that were searched again.  The saved flows of a function only
+//  hold the values in that function, so the values that flows reach in other
+//  functions from a restored function are found again here.  Values in
+//  restored functions are already recorded in the Resolved set, so the
+//  search stops when it reaches them.
+//
+// Inputs:
+//  Restored - The functions whose flows were restored.
+//
+void
+FindFlows::findRestoredSources (const std::vector<Function *> & Restored) {
+  Worklist_t Worklist;
+  for (unsigned index = 0; index < Restored.size(); ++index) {
+    //
+    // Take a copy of the values, as following them may add to the set.
+    //
+    ValueSet Resolved = Results.Resolved[getFunctionID (Restored[index])];
+    for (ValueSet::iterator ID = Resolved.begin(); ID != Resolved.end(); ++ID) {
+      Value * V = const_cast<Value *>(Values[*ID]);
+      LoadInst * LI = dyn_cast<LoadInst>(V);
+      if (LI && findLoadSources (LI, Worklist, Results)) {
+        continue;
+      } else if (isASource (V)) {
+        if (CallInst * CI = dyn_cast<CallInst>(V)) {
+          findCallSources (CI, Worklist, Results);
+        } else if (Argument * Arg = dyn_cast<Argument>(V)) {
+          findArgSources (Arg, Worklist, Results);
+        }
+      }
+    }
+  }
+
+  processWorklist (Worklist, Results);
+  return;
+}
+
+//
+// Method: saveDatabase()
+//
+// Description:
+//  Save the flows of every named function in the module so that later runs
+//  can reuse them.
+//
+// Inputs:
+//  M                - The module being analyzed.
+//  BodyHashes       - The body hash of each function, by function number.
+//  DependencyHashes - The dependency hash of each function, by function
+//                     number.
+//
+void
+FindFlows::saveDatabase (Module & M,
+                         const std::vector<uint64_t> & BodyHashes,
+                         const std::vector<uint64_t> & DependencyHashes) {
+  std::vector<FlowDatabase::FunctionEntry> Entries;
+  for (Module::iterator F = M.begin(); F != M.end(); ++F) {
+    if (!F->hasName())
+      continue;
+
+    unsigned FID = getFunctionID (F);
+    Entries.push_back (FlowDatabase::FunctionEntry());
+    FlowDatabase::FunctionEntry & E = Entries.back();
+    E.Name = F->getName();
+    E.BodyHash = BodyHashes[FID];
+    E.DependencyHash = DependencyHashes[FID];
+
+    ValueSet * Sets[FlowDatabase::NumSetKinds] = {
+      &(Results.Sources[FID]),
+      &(Results.Resolved[FID]),
+      &(Results.PhiNodes),
+      &(Results.Returns),
+      &(Results.Args)
+    };
+    std::vector<const Value *> Locals;
+    getLocalValues (*F, Locals);
+    for (unsigned local = 0; local < Locals.size(); ++local) {
+      unsigned ID = getValueID (Locals[local]);
+      for (unsigned kind = 0; kind < FlowDatabase::NumSetKinds; ++kind)
+        if (Sets[kind]->test (ID))
+          E.Sets[kind].push_back (local);
+    }
+  }
+
+  std::string Error;
+  if (!FlowDatabase::write (FlowDatabaseName, Entries, Error)) {
+    errs() << "FindFlows: Cannot save flows to " << FlowDatabaseName
+           << ": " << Error << "\n";
+  }
+
+  return;
+}
+
+//
+// Method: runOnModule()
+//
+// Description:
+//  Entry point for this LLVM pass.  Find statements that require the
+//  label of a piece of information and then find the sources of that
+//  information.
+//
+// Inputs:
+//  M - The module to analyze.
+//
+// Return value:
+//  false - The module was not modified.
+//
+bool
+FindFlows::runOnModule (Module & M) {
+  //
+  // Get prerequisite passes.
+  //
+  dsaPass = &getAnalysis<EQTDDataStructures>();
+
+  //
+  // Number the values of the module so that the results can be held in
+  // bitvectors.
+  //
+  {
+    NamedRegionTimer T ("Number values", "Find Flows", TimePassesIsEnabled);
+    numberValues (M);
+    Results.reset (FunctionIDs.size());
+  }
+
+  //
+  // Build the reverse call graph once so that backtracking through function
+  // arguments does not need to rescan the module.
+  //
+  {
+    NamedRegionTimer T ("Build call site index", "Find Flows",
+                        TimePassesIsEnabled);
+    buildCallSiteIndex (M);
+  }
+
+  //
+  // If the user asked to follow flows through memory, find the stores that
+  // may write the memory read by each load.
+  //
+  if (FlowsThroughMemory) {
+    NamedRegionTimer T ("Build memory index", "Find Flows",
+                        TimePassesIsEnabled);
+    buildMemoryIndex (M);
+  }
+
+  //
+  // If the user asked for the flows into a single source line, only find the
+  // sources for the instructions on that line.  Otherwise, begin by finding
+  // the sources of all labels for store instructions.  Saved flows are only
+  // used for the latter, as they hold the results of searching every
+  // function.
+  //
+  if (SliceFileName != "") {
+    NamedRegionTimer T ("Find target sources", "Find Flows",
+                        TimePassesIsEnabled);
+    findTargetSources (M);
+  } else {
+    //
+    // If the flows of an earlier run were saved, reuse those of the
+    // functions that have not changed and only search the others.
+    //
+    std::vector<Function *> Functions;
+    std::vector<Function *> Restored;
+    std::vector<uint64_t> BodyHashes;
+    std::vector<uint64_t> DependencyHashes;
+    if (FlowDatabaseName != "") {
+      NamedRegionTimer T ("Load flow database", "Find Flows",
+                          TimePassesIsEnabled);
+      hashFunctions (M, BodyHashes, DependencyHashes);
+      loadDatabase (M, BodyHashes, DependencyHashes, Functions, Restored);
+    } else {
+      for (Module::iterator F = M.begin(); F != M.end(); ++F)
+        Functions.push_back (F);
+    }
+    NumSearched += Functions.size();
+
+    {
+      NamedRegionTimer T ("Find sources", "Find Flows", TimePassesIsEnabled);
+      if (FlowThreads > 1) {
+        findSourcesInParallel (Functions, FlowThreads);
+      } else {
+        for (unsigned index = 0; index < Functions.size(); ++index) {
+          findSources (*(Functions[index]), Results);
+        }
+      }
+      findRestoredSources (Restored);
+    }
+
+    if (FlowDatabaseName != "") {
+      NamedRegionTimer T ("Save flow database", "Find Flows",
+                          TimePassesIsEnabled);
+      saveDatabase (M, BodyHashes, DependencyHashes);
+    }
+  }
+
+  NumResolvedHits += Results.ResolvedHits;
+  NumArgCallSites += Results.ArgCallSites;
+  NumLoadStores += Results.LoadStores;
+  NumWorklist += Results.WorklistItems;
+
+  //
+  // Report the size of the results.
+  //
+  for (unsigned index = 0; index < Results.Sources.size(); ++index) {
+    NumSources += Results.Sources[index].count();
+    NumResolved += Results.Resolved[index].count();
   }
+  NumPhiNodes += Results.PhiNodes.count();
+  NumReturns += Results.Returns.count();
+  NumArgs += Results.Args.count();
 
   //
   // This is an analysis pass, so always return false.
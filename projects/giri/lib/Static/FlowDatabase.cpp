@@ -0,0 +1,259 @@
+//===- FlowDatabase.cpp - On-disk database of information flows ------------//
+//
+//                          The Information Flow Compiler
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements reading and writing the files in which the FindFlows
+// pass saves its results between runs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "giri/FlowDatabase.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/system_error.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+
+// Magic number and version identifying a flow database file
+static const char FlowMagic[8] = { 'G', 'I', 'R', 'I', 'F', 'L', 'O', 'W' };
+static const uint32_t FlowVersion = 2;
+
+//
+// Function: compareEntries()
+//
+// Description:
+//  Order function entries by name so that records can be found by binary
+//  search.
+//
+static bool
+compareEntries (const FlowDatabase::FunctionEntry * A,
+                const FlowDatabase::FunctionEntry * B) {
+  return A->Name < B->Name;
+}
+
+//
+// Method: load()
+//
+// Description:
+//  Map a flow database file into memory.
+//
+// Inputs:
+//  FileName - The name of the file to load.
+//
+// Outputs:
+//  Error - A description of the problem if the file could not be loaded.
+//
+// Return value:
+//  NULL - The file could not be read or is not a valid flow database.
+//  Otherwise, a pointer to the database is returned.  The caller owns it.
+//
+FlowDatabase *
+FlowDatabase::load (StringRef FileName, std::string & Error) {
+  OwningPtr<MemoryBuffer> Buffer;
+  if (error_code ec = MemoryBuffer::getFile (FileName, Buffer, -1, false)) {
+    Error = ec.message();
+    return 0;
+  }
+
+  FlowDatabase * DB = new FlowDatabase (Buffer.take());
+  if (!DB->verify (Error)) {
+    delete DB;
+    return 0;
+  }
+
+  return DB;
+}
+
+//
+// Method: verify()
+//
+// Description:
+//  Check that the mapped file is a flow database and that every offset in it
+//  lies within the file.
+//
+// Outputs:
+//  Error - A description of the problem if the file is not valid.
+//
+// Return value:
+//  true  - The file is valid.
+//  false - The file is not valid and must not be used.
+//
+bool
+FlowDatabase::verify (std::string & Error) const {
+  size_t Size = Buffer->getBufferSize();
+  if ((Size < sizeof (Header)) ||
+      (memcmp (getHeader().Magic, FlowMagic, sizeof (FlowMagic)) != 0)) {
+    Error = "not a flow database";
+    return false;
+  }
+
+  if (getHeader().Version != FlowVersion) {
+    Error = "unsupported flow database version";
+    return false;
+  }
+
+  uint64_t NumFunctions = getHeader().NumFunctions;
+  if (sizeof (Header) + NumFunctions * sizeof (FunctionRecord) > Size) {
+    Error = "truncated flow database";
+    return false;
+  }
+
+  for (unsigned index = 0; index < NumFunctions; ++index) {
+    const FunctionRecord & R = getRecords()[index];
+    if ((uint64_t) R.NameOffset + R.NameLength > Size) {
+      Error = "function name out of range";
+      return false;
+    }
+
+    for (unsigned kind = 0; kind < NumSetKinds; ++kind) {
+      if ((R.SetOffset[kind] % sizeof (uint32_t)) ||
+          ((uint64_t) R.SetOffset[kind] +
+           (uint64_t) R.SetLength[kind] * sizeof (uint32_t) > Size)) {
+        Error = "value set out of range";
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+//
+// Method: lookup()
+//
+// Description:
+//  Find the record for the function with the specified name.
+//
+// Return value:
+//  NULL - The database has no record for the function.
+//  Otherwise, a pointer to the record is returned.
+//
+const FlowDatabase::FunctionRecord *
+FlowDatabase::lookup (StringRef Name) const {
+  unsigned Low = 0;
+  unsigned High = getNumFunctions();
+  while (Low < High) {
+    unsigned Mid = Low + (High - Low) / 2;
+    int Result = getName (getRecords()[Mid]).compare (Name);
+    if (Result == 0)
+      return &(getRecords()[Mid]);
+    if (Result < 0)
+      Low = Mid + 1;
+    else
+      High = Mid;
+  }
+
+  return 0;
+}
+
+//
+// Method: write()
+//
+// Description:
+//  Write a flow database holding the specified function entries.
+//
+// Inputs:
+//  FileName - The name of the file to write.
+//  Entries  - The results for each function.  Entries must have unique
+//             names.
+//
+// Outputs:
+//  Error - A description of the problem if the file could not be written.
+//
+// Return value:
+//  true  - The file was written.
+//  false - The file could not be written.
+//
+bool
+FlowDatabase::write (StringRef FileName,
+                     std::vector<FunctionEntry> & Entries,
+                     std::string & Error) {
+  //
+  // Sort the entries by name; the records must be in this order.
+  //
+  std::vector<const FunctionEntry *> Sorted;
+  for (unsigned index = 0; index < Entries.size(); ++index)
+    Sorted.push_back (&(Entries[index]));
+  std::sort (Sorted.begin(), Sorted.end(), compareEntries);
+
+  //
+  // Lay out the records, then the value sets, then the names.
+  //
+  uint64_t Offset = sizeof (Header) + Sorted.size() * sizeof (FunctionRecord);
+  std::vector<FunctionRecord> Records (Sorted.size());
+  for (unsigned index = 0; index < Sorted.size(); ++index) {
+    FunctionRecord & R = Records[index];
+    R.BodyHash = Sorted[index]->BodyHash;
+    R.DependencyHash = Sorted[index]->DependencyHash;
+    for (unsigned kind = 0; kind < NumSetKinds; ++kind) {
+      R.SetOffset[kind] = Offset;
+      R.SetLength[kind] = Sorted[index]->Sets[kind].size();
+      Offset += R.SetLength[kind] * sizeof (uint32_t);
+    }
+  }
+
+  for (unsigned index = 0; index < Sorted.size(); ++index) {
+    Records[index].NameOffset = Offset;
+    Records[index].NameLength = Sorted[index]->Name.size();
+    Offset += Sorted[index]->Name.size();
+  }
+
+  if (Offset > UINT32_MAX) {
+    Error = "flow database too large";
+    return false;
+  }
+
+  //
+  // Write the file beside the old one and then move it into place, as the
+  // old one may still be mapped into memory by this or another process.
+  //
+  std::string TempName = FileName.str() + ".tmp";
+  {
+    raw_fd_ostream Out (TempName.c_str(), Error, raw_fd_ostream::F_Binary);
+    if (!Error.empty())
+      return false;
+
+    Header H;
+    memcpy (H.Magic, FlowMagic, sizeof (FlowMagic));
+    H.Version = FlowVersion;
+    H.NumFunctions = Sorted.size();
+    Out.write ((const char *) &H, sizeof (H));
+    if (!Records.empty())
+      Out.write ((const char *) &(Records[0]),
+                 Records.size() * sizeof (FunctionRecord));
+    for (unsigned index = 0; index < Sorted.size(); ++index) {
+      for (unsigned kind = 0; kind < NumSetKinds; ++kind) {
+        const std::vector<uint32_t> & Set = Sorted[index]->Sets[kind];
+        if (!Set.empty())
+          Out.write ((const char *) &(Set[0]), Set.size() * sizeof (uint32_t));
+      }
+    }
+    for (unsigned index = 0; index < Sorted.size(); ++index)
+      Out << Sorted[index]->Name;
+
+    Out.close();
+    if (Out.has_error()) {
+      Out.clear_error();
+      Error = "could not write " + TempName;
+      return false;
+    }
+  }
+
+  if (error_code ec = sys::fs::rename (TempName, FileName)) {
+    Error = "could not rename " + TempName + ": " + ec.message();
+    bool Existed;
+    sys::fs::remove (TempName, Existed);
+    return false;
+  }
+
+  return true;
+}
@@ -18,17 +18,21 @@
 #include "keyiterator.h"
 
 #include <cstddef>
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/EquivalenceClasses.h"
 #include "llvm/Support/CallSite.h"
 
 #include <cassert>
 #include <map>
+#include <vector>
 
 class DSCallGraph {
 public:
   typedef svset<const llvm::Function*> FuncSet;
   typedef std::map<llvm::CallSite, FuncSet> ActualCalleesTy;
   typedef std::map<const llvm::Function*, FuncSet> SimpleCalleesTy;
+  typedef svset<llvm::CallSite> CallSiteSet;
+  typedef std::map<const llvm::Function*, CallSiteSet> ActualCallersTy;
 
 private:
   // ActualCallees contains CallSite -> set of Function mappings
@@ -37,9 +41,14 @@ private:
   // SimpleCallees contains Function -> set of Functions mappings
   SimpleCalleesTy SimpleCallees;
 
+  // ActualCallers contains the reverse of ActualCallees: the SCC leader of
+  // each callee -> set of CallSites that may call into its SCC
+  ActualCallersTy ActualCallers;
+
   // These are used for returning empty sets when the caller has no callees
   FuncSet EmptyActual;
   FuncSet EmptySimple;
+  CallSiteSet EmptyCallers;
 
   // An equivalence class is exactly an SCC
   llvm::EquivalenceClasses<const llvm::Function*> SCCs;
@@ -53,8 +62,27 @@ private:
 
   svset<llvm::CallSite> completeCS;
 
+  // The frozen form of the graph that buildSCCs leaves behind.  Call sites
+  // and functions are numbered, and the callees of call site N are
+  // CalleeList[CalleeStart[N]] up to CalleeList[CalleeStart[N+1]], and so on
+  // for the flat callees and callers of each function.  Lookups use it while
+  // Frozen is set; any change to the graph clears it.
+  bool Frozen;
+  llvm::DenseMap<const llvm::Instruction*, unsigned> CallSiteNumbers;
+  std::vector<unsigned> CalleeStart;
+  std::vector<const llvm::Function*> CalleeList;
+  llvm::DenseMap<const llvm::Function*, unsigned> FunctionNumbers;
+  std::vector<unsigned> FlatStart;
+  std::vector<const llvm::Function*> FlatList;
+  std::vector<unsigned> CallerStart;
+  std::vector<const llvm::Function*> CallerList;
+  std::vector<unsigned> CallSiteStart;
+  std::vector<llvm::CallSite> CallSiteList;
+  std::vector<const llvm::Function*> Leaders;
+  unsigned NumCallees;
+
   // Types for SCC construction
-  typedef std::map<const llvm::Function*, unsigned> TFMap;
+  typedef llvm::DenseMap<const llvm::Function*, unsigned> TFMap;
   typedef std::vector<const llvm::Function*> TFStack;
 
   // Tarjan's SCC algorithm
@@ -63,14 +91,39 @@ private:
 
   void removeECFunctions();
 
+  // Return the function under which the callers of F are kept: the leader
+  // of its SCC, if it has one.
+  const llvm::Function* getCallerKey(const llvm::Function* F) const {
+    if (SCCs.findValue(F) == SCCs.end())
+      return F;
+    return SCCs.getLeaderValue(F);
+  }
+
+  void freeze();
+  void thaw();
+
+  // Return the number of F in the frozen graph, or ~0U if it has none.
+  unsigned getFunctionNumber(const llvm::Function* F) const {
+    llvm::DenseMap<const llvm::Function*, unsigned>::const_iterator ii =
+      FunctionNumbers.find(F);
+    return ii == FunctionNumbers.end() ? ~0U : ii->second;
+  }
+
+  // Return the number of the SCC leader of F in the frozen graph, or ~0U.
+  unsigned getCallerNumber(const llvm::Function* F) const {
+    unsigned N = getFunctionNumber(F);
+    return N == ~0U ? N : getFunctionNumber(Leaders[N]);
+  }
+
 public:
 
-  DSCallGraph() {}
+  DSCallGraph() : Frozen(false), NumCallees(0) {}
 
   typedef ActualCalleesTy::mapped_type::const_iterator callee_iterator;
   typedef KeyIterator<ActualCalleesTy::const_iterator> callee_key_iterator;
   typedef SimpleCalleesTy::mapped_type::const_iterator flat_iterator;
   typedef KeyIterator<SimpleCalleesTy::const_iterator> flat_key_iterator;
+  typedef CallSiteSet::const_iterator                  caller_iterator;
   typedef FuncSet::const_iterator                      root_iterator;
   typedef llvm::EquivalenceClasses<const llvm::Function*>::member_iterator scc_iterator;
 
@@ -85,6 +138,13 @@ public:
   }
 
   callee_iterator callee_begin(llvm::CallSite CS) const {
+    if (Frozen) {
+      llvm::DenseMap<const llvm::Instruction*, unsigned>::const_iterator ii =
+        CallSiteNumbers.find(CS.getInstruction());
+      if (ii == CallSiteNumbers.end())
+        return EmptyActual.end();
+      return CalleeList.begin() + CalleeStart[ii->second];
+    }
     ActualCalleesTy::const_iterator ii = ActualCallees.find(CS);
     if (ii == ActualCallees.end())
       return EmptyActual.end();
@@ -92,6 +152,13 @@ public:
   }
 
   callee_iterator callee_end(llvm::CallSite CS) const {
+    if (Frozen) {
+      llvm::DenseMap<const llvm::Instruction*, unsigned>::const_iterator ii =
+        CallSiteNumbers.find(CS.getInstruction());
+      if (ii == CallSiteNumbers.end())
+        return EmptyActual.end();
+      return CalleeList.begin() + CalleeStart[ii->second + 1];
+    }
     ActualCalleesTy::const_iterator ii = ActualCallees.find(CS);
     if (ii == ActualCallees.end())
       return EmptyActual.end();
@@ -107,6 +174,12 @@ public:
   }
 
   flat_iterator flat_callee_begin(const llvm::Function* F) const {
+    if (Frozen) {
+      unsigned N = getFunctionNumber(F);
+      if (N == ~0U)
+        return EmptySimple.end();
+      return FlatList.begin() + FlatStart[N];
+    }
     SimpleCalleesTy::const_iterator ii = SimpleCallees.find(F);
     if (ii == SimpleCallees.end())
       return EmptySimple.end();
@@ -114,12 +187,64 @@ public:
   }
 
   flat_iterator flat_callee_end(const llvm::Function* F) const {
+    if (Frozen) {
+      unsigned N = getFunctionNumber(F);
+      if (N == ~0U)
+        return EmptySimple.end();
+      return FlatList.begin() + FlatStart[N + 1];
+    }
     SimpleCalleesTy::const_iterator ii = SimpleCallees.find(F);
     if (ii == SimpleCallees.end())
       return EmptySimple.end();
     return ii->second.end();
   }
 
+  // The call sites that may call F, or another function in the SCC of F,
+  // as the callees of call sites only name SCC leaders.
+  caller_iterator caller_begin(const llvm::Function* F) const {
+    if (Frozen) {
+      unsigned N = getCallerNumber(F);
+      if (N == ~0U)
+        return EmptyCallers.end();
+      return CallSiteList.begin() + CallSiteStart[N];
+    }
+    ActualCallersTy::const_iterator ii = ActualCallers.find(getCallerKey(F));
+    if (ii == ActualCallers.end())
+      return EmptyCallers.end();
+    return ii->second.begin();
+  }
+
+  caller_iterator caller_end(const llvm::Function* F) const {
+    if (Frozen) {
+      unsigned N = getCallerNumber(F);
+      if (N == ~0U)
+        return EmptyCallers.end();
+      return CallSiteList.begin() + CallSiteStart[N + 1];
+    }
+    ActualCallersTy::const_iterator ii = ActualCallers.find(getCallerKey(F));
+    if (ii == ActualCallers.end())
+      return EmptyCallers.end();
+    return ii->second.end();
+  }
+
+  // The SCC leaders with a call into the SCC led by F.  These are only
+  // known once buildSCCs has been run, and until the graph changes again.
+  flat_iterator flat_caller_begin(const llvm::Function* F) const {
+    assert(Frozen && "Callers are only known after buildSCCs!");
+    unsigned N = getFunctionNumber(F);
+    if (N == ~0U)
+      return EmptySimple.end();
+    return CallerList.begin() + CallerStart[N];
+  }
+
+  flat_iterator flat_caller_end(const llvm::Function* F) const {
+    assert(Frozen && "Callers are only known after buildSCCs!");
+    unsigned N = getFunctionNumber(F);
+    if (N == ~0U)
+      return EmptySimple.end();
+    return CallerList.begin() + CallerStart[N + 1];
+  }
+
   flat_key_iterator flat_key_begin() const {
     return flat_key_iterator(SimpleCallees.begin());
   }
@@ -147,9 +272,16 @@ public:
   }
   
   const llvm::Function* sccLeader(const llvm::Function*F) const {
+    if (Frozen) {
+      unsigned N = getFunctionNumber(F);
+      if (N != ~0U)
+        return Leaders[N];
+    }
     return SCCs.getLeaderValue(F);
   }
   unsigned callee_size(llvm::CallSite CS) const {
+    if (Frozen)
+      return callee_end(CS) - callee_begin(CS);
     ActualCalleesTy::const_iterator ii = ActualCallees.find(CS);
     if (ii == ActualCallees.end())
       return 0;
@@ -169,6 +301,8 @@ public:
   }
 
   unsigned size() const {
+    if (Frozen)
+      return NumCallees;
     unsigned sum = 0;
     for (ActualCalleesTy::const_iterator ii = ActualCallees.begin(),
             ee = ActualCallees.end(); ii != ee; ++ii)
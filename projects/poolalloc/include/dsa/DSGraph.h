@@ -17,9 +17,12 @@
 
 #include "DSNode.h"
 #include "DSCallGraph.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/EquivalenceClasses.h"
 #include "llvm/Function.h"
+#include "llvm/Support/Allocator.h"
 
+#include <deque>
 #include <list>
 #include <map>
 #include <set>
@@ -41,13 +44,93 @@ class GlobalValue;
 /// globals or unique node handles active in the function.
 ///
 class DSScalarMap {
-  typedef std::map<const Value*, DSNodeHandle> ValueMapTy;
+public:
+  typedef std::pair<const Value*, DSNodeHandle> value_type;
+
+private:
+  // Entries - One entry for each value in the map, numbered densely.  A deque
+  // keeps entries at fixed addresses, so the handle references handed out by
+  // operator[] stay valid as the map grows.  Erased entries have a null value
+  // and their numbers are reused by the next values added.
+  typedef std::deque<value_type> EntryListTy;
+  EntryListTy Entries;
+  std::vector<unsigned> FreeEntries;
+
+  // ValueMap - The number of the entry for each value.
+  typedef DenseMap<const Value*, unsigned> ValueMapTy;
   ValueMapTy ValueMap;
 
   typedef std::set<const GlobalValue*> GlobalSetTy;
   GlobalSetTy GlobalSet;
 
   EquivalenceClasses<const GlobalValue*> &GlobalECs;
+
+  /// entry_iterator - Walk the entries that hold a value.  Like the iterators
+  /// of a DenseMap, these are invalidated by adding a value to the map, but
+  /// not by erasing one.
+  template<typename EntryTy, typename MapTy>
+  class entry_iterator
+    : public std::iterator<std::forward_iterator_tag, EntryTy> {
+    friend class DSScalarMap;
+    MapTy *Map;
+    unsigned Idx;
+
+    void skipErased() {
+      while (Idx < Map->Entries.size() && !Map->Entries[Idx].first)
+        ++Idx;
+    }
+  public:
+    entry_iterator() : Map(0), Idx(0) {}
+    entry_iterator(MapTy *M, unsigned I) : Map(M), Idx(I) { skipErased(); }
+    template<typename OtherEntryTy, typename OtherMapTy>
+    entry_iterator(const entry_iterator<OtherEntryTy, OtherMapTy> &I)
+      : Map(I.Map), Idx(I.Idx) {}
+
+    EntryTy &operator*() const { return Map->Entries[Idx]; }
+    EntryTy *operator->() const { return &Map->Entries[Idx]; }
+
+    entry_iterator &operator++() {
+      ++Idx;
+      skipErased();
+      return *this;
+    }
+    entry_iterator operator++(int) {
+      entry_iterator tmp = *this; ++*this; return tmp;
+    }
+
+    bool operator==(const entry_iterator &I) const { return Idx == I.Idx; }
+    bool operator!=(const entry_iterator &I) const { return Idx != I.Idx; }
+
+    // Let a const_iterator be built from an iterator.
+    template<typename, typename> friend class entry_iterator;
+  };
+
+  /// addEntry - Add an entry for V, which must not be in the map yet.
+  DSNodeHandle &addEntry(const Value *V) {
+    unsigned Idx;
+    if (FreeEntries.empty()) {
+      Idx = Entries.size();
+      Entries.push_back(value_type(V, DSNodeHandle()));
+    } else {
+      Idx = FreeEntries.back();
+      FreeEntries.pop_back();
+      Entries[Idx].first = V;
+    }
+    ValueMap[V] = Idx;
+    return Entries[Idx].second;
+  }
+
+  typedef entry_iterator<value_type, DSScalarMap> raw_iterator;
+  typedef entry_iterator<const value_type, const DSScalarMap> raw_const_iterator;
+
+  raw_iterator findRaw(const Value *V) {
+    ValueMapTy::iterator I = ValueMap.find(V);
+    return I == ValueMap.end() ? end() : raw_iterator(this, I->second);
+  }
+  raw_const_iterator findRaw(const Value *V) const {
+    ValueMapTy::const_iterator I = ValueMap.find(V);
+    return I == ValueMap.end() ? end() : raw_const_iterator(this, I->second);
+  }
 public:
   DSScalarMap(EquivalenceClasses<const GlobalValue*> &ECs) : GlobalECs(ECs) {}
 
@@ -55,12 +138,12 @@ public:
 
   // Compatibility methods: provide an interface compatible with a map of
   // Value* to DSNodeHandle's.
-  typedef ValueMapTy::const_iterator const_iterator;
-  typedef ValueMapTy::iterator iterator;
-  iterator begin() { return ValueMap.begin(); }
-  iterator end()   { return ValueMap.end(); }
-  const_iterator begin() const { return ValueMap.begin(); }
-  const_iterator end() const { return ValueMap.end(); }
+  typedef raw_const_iterator const_iterator;
+  typedef raw_iterator iterator;
+  iterator begin() { return iterator(this, 0); }
+  iterator end()   { return iterator(this, Entries.size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, Entries.size()); }
 
   const GlobalValue *getLeaderForGlobal(const GlobalValue *GV) const {
     EquivalenceClasses<const GlobalValue*>::iterator ECI = GlobalECs.findValue(GV);
@@ -71,29 +154,29 @@ public:
 
   iterator find(const Value *V) {
     assert(V);
-    iterator I = ValueMap.find(V);
-    if (I != ValueMap.end()) return I;
+    iterator I = findRaw(V);
+    if (I != end()) return I;
 
     if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
       // If this is a global, check to see if it is equivalenced to something
       // in the map.
       const GlobalValue *Leader = getLeaderForGlobal(GV);
       if (Leader != GV)
-        I = ValueMap.find((const Value*)Leader);
+        I = findRaw((const Value*)Leader);
     }
     return I;
   }
   const_iterator find(const Value *V) const {
     assert(V);
-    const_iterator I = ValueMap.find(V);
-    if (I != ValueMap.end()) return I;
+    const_iterator I = findRaw(V);
+    if (I != end()) return I;
 
     if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
       // If this is a global, check to see if it is equivalenced to something
       // in the map.
       const GlobalValue *Leader = getLeaderForGlobal(GV);
       if (Leader != GV)
-        I = ValueMap.find((const Value*)Leader);
+        I = findRaw((const Value*)Leader);
     }
     return I;
   }
@@ -101,17 +184,18 @@ public:
   /// getRawEntryRef - This method can be used by clients that are aware of the
   /// global value equivalence class in effect.
   DSNodeHandle &getRawEntryRef(const Value *V) {
-    std::pair<iterator,bool> IP =
-      ValueMap.insert(std::make_pair(V, DSNodeHandle()));
-     if (IP.second)   // Inserted the new entry into the map.
-       if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
-         GlobalSet.insert(GV);
-     return IP.first->second;
+    ValueMapTy::iterator I = ValueMap.find(V);
+    if (I != ValueMap.end())
+      return Entries[I->second].second;
+    // Insert the new entry into the map.
+    if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
+      GlobalSet.insert(GV);
+    return addEntry(V);
   }
 
-  unsigned count(const Value *V) const { return ValueMap.find(V) != ValueMap.end(); }
+  unsigned count(const Value *V) const { return ValueMap.count(V); }
 
-  void erase(const Value *V) { erase(ValueMap.find(V)); }
+  void erase(const Value *V) { erase(findRaw(V)); }
 
   void eraseIfExists(const Value *V) {
     iterator I = find(V);
@@ -124,7 +208,8 @@ public:
   void replaceScalar(const Value *Old, const Value *New) {
     iterator I = find(Old);
     assert(I != end() && "Old value is not in the map!");
-    ValueMap.insert(std::make_pair(New, I->second));
+    if (!ValueMap.count(New))
+      addEntry(New) = I->second;
     erase(I);
   }
 
@@ -132,29 +217,31 @@ public:
   /// whatever Old did.
   void copyScalarIfExists(const Value *Old, const Value *New) {
     iterator I = find(Old);
-    if (I != end())
-      ValueMap.insert(std::make_pair(New, I->second));
+    if (I != end() && !ValueMap.count(New))
+      addEntry(New) = I->second;
   }
 
   /// operator[] - Return the DSNodeHandle for the specified value, creating a
   /// new null handle if there is no entry yet.
   DSNodeHandle &operator[](const Value *V) {
     assert(V);
-    iterator I = ValueMap.find(V);
+    ValueMapTy::iterator I = ValueMap.find(V);
     if (I != ValueMap.end())
-      return I->second;   // Return value if already exists.
+      return Entries[I->second].second;   // Return value if already exists.
 
     if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
       return AddGlobal(GV);
 
-    return ValueMap.insert(std::make_pair(V, DSNodeHandle())).first->second;
+    return addEntry(V);
   }
 
   void erase(iterator I) {
-    assert(I != ValueMap.end() && "Cannot erase end!");
+    assert(I != end() && "Cannot erase end!");
     if (const GlobalValue *GV = dyn_cast<GlobalValue>(I->first))
       GlobalSet.erase(GV);
-    ValueMap.erase(I);
+    ValueMap.erase(I->first);
+    *I = value_type(0, DSNodeHandle());
+    FreeEntries.push_back(I.Idx);
   }
 
   void clear_scalars() {
@@ -169,6 +256,8 @@ public:
   }
 
   void clear() {
+    Entries.clear();
+    FreeEntries.clear();
     ValueMap.clear();
     GlobalSet.clear();
   }
@@ -188,6 +277,47 @@ private:
   DSNodeHandle &AddGlobal(const GlobalValue *GV);
 };
 
+//===----------------------------------------------------------------------===//
+/// DSNodeArena - The memory that the nodes of a graph are allocated from.
+///
+/// Nodes are carved out of large slabs, and the memory of a deleted node is
+/// kept on a free list for the next node allocated here.  The slabs are freed
+/// together once the owning graph and every node allocated here are gone;
+/// nodes may outlive their graph, since they can be spliced into another graph
+/// or linger as forwarding nodes.  Like its graph, an arena must only be used
+/// by one thread at a time.
+///
+class DSNodeArena {
+  // Each block starts with the arena it came from, or the next free block.
+  union BlockHeader {
+    DSNodeArena *Arena;
+    BlockHeader *NextFree;
+  };
+
+  BumpPtrAllocator Allocator;
+  BlockHeader *FreeList;
+
+  // Users - The owning graph plus one for each live node.
+  unsigned Users;
+
+  DSNodeArena(const DSNodeArena &);       // DO NOT IMPLEMENT
+  void operator=(const DSNodeArena &);    // DO NOT IMPLEMENT
+public:
+  DSNodeArena() : Allocator(16 * 1024, 16 * 1024), FreeList(0), Users(1) {}
+
+  /// allocate - Allocate Size bytes for a node from the specified arena, or
+  /// from the heap if A is null.
+  static void *allocate(DSNodeArena *A, size_t Size);
+
+  /// deallocate - Return the memory of a node to the place it came from.
+  static void deallocate(void *P);
+
+  /// release - Drop the owning graph's reference to the arena.
+  void release() {
+    if (--Users == 0) delete this;
+  }
+};
+
 //===----------------------------------------------------------------------===//
 /// DSGraph - The graph that represents a function.
 ///
@@ -223,6 +353,10 @@ private:
   NodeListTy Nodes;
   ScalarMapTy ScalarMap;
 
+  // NodeArena - The memory for the nodes created in this graph.
+  //
+  DSNodeArena *NodeArena;
+
   // ReturnNodes - A return value for every function merged into this graph.
   // Each DSGraph may have multiple functions merged into it at any time, which
   // is used for representing SCCs.
@@ -261,7 +395,7 @@ public:
           SuperSet<Type*>& tss,
           DSGraph *GG = 0) 
     :GlobalsGraph(GG), UseAuxCalls(false), 
-     ScalarMap(ECs), TD(td), TypeSS(tss)
+     ScalarMap(ECs), NodeArena(new DSNodeArena()), TD(td), TypeSS(tss)
   { }
 
   // Copy ctor - If you want to capture the node mapping between the source and
@@ -278,6 +412,7 @@ public:
   ~DSGraph();
 
   DSGraph *getGlobalsGraph() const { return GlobalsGraph; }
+  DSNodeArena *getNodeArena() const { return NodeArena; }
   void setGlobalsGraph(DSGraph *G) { GlobalsGraph = G; }
 
   /// getGlobalECs - Return the set of equivalence classes that the global
@@ -627,6 +762,13 @@ public:
   /// removeDeadNodes.
   ///
   void removeTriviallyDeadNodes();
+
+  /// compactForwarding - Point every handle in the graph (node links, scalar
+  /// map, return and vararg nodes, and call sites) straight at its node,
+  /// freeing the forwarding nodes left behind by merges.  This is done as
+  /// part of removeDeadNodes.
+  ///
+  void compactForwarding();
 };
 
 
@@ -647,12 +789,32 @@ class ReachabilityCloner {
 
   bool createDest;
 
-  // NodeMap - A mapping from nodes in the source graph to the nodes that
-  // represent them in the destination graph.
-  // We cannot use a densemap here as references into it are not stable across
-  // insertion
-  typedef std::map<const DSNode*, DSNodeHandle> RCNodeMap;
-  RCNodeMap NodeMap;
+  // NodeIndex - A mapping from nodes in the source graph to the position in
+  // NodeMap of the handle that represents them in the destination graph.
+  // The handles are kept in a deque, as references to them must stay valid
+  // while more nodes are mapped.
+  DenseMap<const DSNode*, unsigned> NodeIndex;
+  std::deque<DSNodeHandle> NodeMap;
+
+  /// CloneFrame - A source node that getClonedNH has copied into the
+  /// destination graph, and the next of its links to copy.
+  struct CloneFrame {
+    const DSNodeHandle *SrcNH;
+    DSNodeHandle *NH;
+    DSNode::const_edge_iterator I, E;
+  };
+
+  DSNodeHandle &getMappedNH(const DSNode *SN) {
+    std::pair<DenseMap<const DSNode*, unsigned>::iterator, bool> Entry =
+      NodeIndex.insert(std::make_pair(SN, unsigned(NodeMap.size())));
+    if (Entry.second)
+      NodeMap.push_back(DSNodeHandle());
+    return NodeMap[Entry.first->second];
+  }
+
+  bool findClonedNH(const DSNodeHandle &SrcNH, DSNodeHandle &Result);
+  void addClonedEdge(CloneFrame &Frame, const DSNodeHandle &DestEdge);
+  DSNodeHandle finishClonedNode(CloneFrame &Frame);
 
 public:
   ReachabilityCloner(DSGraph* dest, const DSGraph* src, unsigned cloneFlags,
@@ -677,6 +839,14 @@ public:
   ///
   void mergeCallSite(DSCallSite &DestCS, const DSCallSite &SrcCS);
 
+  /// mergeCallSites - Merge the nodes reachable from each of the src call
+  /// sites into the nodes reachable from the dest call site at the same
+  /// position, in order.  The node map is sized for the whole source graph
+  /// up front.
+  ///
+  void mergeCallSites(std::vector<DSCallSite> &DestCSs,
+                      const std::vector<const DSCallSite*> &SrcCSs);
+
   DSCallSite cloneCallSite(const DSCallSite& SrcCS);
 
   bool clonedAnyNodes() const { return !NodeMap.empty(); }
@@ -684,10 +854,10 @@ public:
   /// hasClonedNode - Return true if the specified node has been cloned from
   /// the source graph into the destination graph.
   bool hasClonedNode(const DSNode *N) {
-    return NodeMap.count(N);
+    return NodeIndex.count(N);
   }
 
-  void destroy() { NodeMap.clear(); }
+  void destroy() { NodeIndex.clear(); NodeMap.clear(); }
 };
 
 //
@@ -0,0 +1,255 @@
+//===- DSGraphImage.h - Saved copies of DSGraphs ----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This header defines DSGraphImage, a copy of a DSGraph that refers to LLVM
+// values by name and position instead of by address, the fingerprints used
+// to decide whether a saved graph still describes the code, and the cache in
+// which the DSA passes keep saved graphs for their incremental mode.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ANALYSIS_DSGRAPHIMAGE_H
+#define LLVM_ANALYSIS_DSGRAPHIMAGE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+class BasicBlock;
+class Constant;
+class DSGraph;
+class Function;
+class GlobalValue;
+class Module;
+class raw_ostream;
+class Type;
+class Value;
+
+//===----------------------------------------------------------------------===//
+/// DSValueTable - Number the values of a module that a DSGraph can refer to,
+/// and compute the fingerprints of functions, global values and types.
+///
+/// A global value is known by its name.  Any other value is known by the
+/// function it appears in and its position in that function: the arguments
+/// come first, then the instructions, then the constants other than global
+/// values in the order that their first use is found.  Two functions with the
+/// same fingerprint number their values the same way.
+///
+class DSValueTable {
+  struct FunctionTable {
+    std::vector<const Value*> Values;
+    DenseMap<const Value*, unsigned> Positions;
+    uint64_t Fingerprint;
+  };
+
+  const Module &M;
+  DenseMap<const Function*, FunctionTable*> Functions;
+  DenseMap<const GlobalValue*, uint64_t> GlobalFingerprints;
+  DenseMap<Type*, uint64_t> TypeFingerprints;
+  DenseMap<uint64_t, Type*> TypesByFingerprint;
+
+  FunctionTable &getTable(const Function &F);
+  void addType(Type *Ty);
+  void addTypesOf(const Value *V, SmallPtrSet<const Constant*, 32> &Seen);
+  void addConstant(FunctionTable &T, const Constant *C);
+  uint64_t hashOperand(FunctionTable &T, const Value *V,
+                       const DenseMap<const BasicBlock*, unsigned> &Blocks);
+
+  DSValueTable(const DSValueTable &);   // DO NOT IMPLEMENT
+  void operator=(const DSValueTable &); // DO NOT IMPLEMENT
+public:
+  explicit DSValueTable(const Module &M) : M(M) {}
+  ~DSValueTable();
+
+  const Module &getModule() const { return M; }
+
+  /// getFingerprint - Return a hash of the body of F, of the names and
+  /// fingerprints of the global values it uses, and of its type and linkage.
+  /// Names of local values and debug information are not part of it.
+  uint64_t getFingerprint(const Function &F);
+
+  /// getFingerprint - Return a hash of the name, type and linkage of GV.
+  uint64_t getFingerprint(const GlobalValue &GV);
+
+  /// getFingerprint - Return a hash of the structure of Ty.
+  uint64_t getFingerprint(Type *Ty);
+
+  /// getType - Return the type of the module with the given fingerprint, or
+  /// null if there is none.
+  Type *getType(uint64_t Fingerprint);
+
+  /// getPosition - Find the position of V among the values of F.  Return
+  /// false if V does not appear in F.
+  bool getPosition(const Function &F, const Value *V, unsigned &Position);
+
+  /// getValue - Return the value at Position in F, or null if F does not
+  /// have that many values.
+  const Value *getValue(const Function &F, unsigned Position);
+};
+
+//===----------------------------------------------------------------------===//
+/// DSGraphImage - A copy of a DSGraph that can be restored into another
+/// DSGraph for the same code, even after the module has been changed or
+/// rebuilt.
+///
+/// The nodes are numbered in the order in which they are reached from the
+/// scalar map, return nodes, var-arg nodes and call sites, each in a fixed
+/// order, so equal graphs give equal images and the fingerprint of an image
+/// identifies the graph.  Nodes that cannot be reached are not copied.
+///
+class DSGraphImage {
+  /// Names - The names of the global values the image refers to.
+  std::vector<std::string> Names;
+
+  /// Values - The values the image refers to, as an index into Names and a
+  /// position in that function, or ~0U for the global value itself.
+  std::vector<std::pair<unsigned, unsigned> > Values;
+
+  /// Types - The fingerprints of the types the image refers to.
+  std::vector<uint64_t> Types;
+
+  /// Words - The nodes, scalar map, return and var-arg nodes and call lists.
+  /// Nodes are numbered from 1; a null handle is node 0.
+  std::vector<uint32_t> Words;
+
+  /// NodeOrder - The nodes in the order of their addresses, and CallOrder,
+  /// the place each call in Words had in its list.  These decide some of the
+  /// arbitrary choices DSA makes later, and are not part of the fingerprint.
+  std::vector<uint32_t> NodeOrder;
+  std::vector<uint32_t> CallOrder;
+
+  uint64_t Fingerprint;
+
+  class Reader;
+
+public:
+  DSGraphImage() : Fingerprint(0) {}
+
+  bool empty() const { return Words.empty(); }
+
+  /// getFingerprint - Return the fingerprint of the graph that was captured,
+  /// which includes the fingerprints of the functions and global values that
+  /// it refers to.
+  uint64_t getFingerprint() const { return Fingerprint; }
+
+  /// capture - Make this an image of G.  If Roots is given, only the nodes
+  /// of those globals, and the nodes reachable from them, are copied.  Return
+  /// false, leaving the image empty, if G refers to a value that cannot be
+  /// named.
+  bool capture(DSGraph &G, DSValueTable &VT,
+               const std::vector<const GlobalValue*> *Roots = 0);
+
+  /// restore - Add the graph in this image to G.  Return false, without
+  /// changing G, if the image refers to a value that is no longer in the
+  /// module.
+  bool restore(DSGraph &G, DSValueTable &VT) const;
+
+  /// write - Write the image to OS in the form it has in a cache file.
+  void write(raw_ostream &OS) const;
+
+  /// read - Make this the image that write wrote to Data.  Return false,
+  /// leaving the image empty, if Data does not hold one.
+  bool read(StringRef Data);
+
+  void clear();
+  void swap(DSGraphImage &Other);
+
+  /// getRepresentative - Return the global value with the smallest name in
+  /// the equivalence class of GV.  The leader of the class depends on the
+  /// addresses of the globals; this does not.
+  static const GlobalValue *
+  getRepresentative(const EquivalenceClasses<const GlobalValue*> &ECs,
+                    const GlobalValue *GV);
+
+};
+
+//===----------------------------------------------------------------------===//
+/// DSGraphCache - The graphs that one DSA pass saved in its incremental mode
+/// so that a later run of the pass can reuse them.  A cache is kept for the
+/// life of the process, and can be loaded from and saved to a file so that
+/// later processes can use it too.
+///
+/// Each entry holds the graph of a group of functions (one function, or the
+/// functions of an SCC), the fingerprint of everything the graph was
+/// computed from, and the graphs of other functions that were inlined into
+/// it along with their fingerprints at the time.
+///
+/// The file is mapped into memory when it is loaded, and only the keys of
+/// its entries are read then.  The image of an entry is read the first time
+/// it is restored.
+///
+class DSGraphCache {
+public:
+  struct Entry {
+    uint64_t Key;
+    std::vector<std::string> Functions;
+    std::vector<std::pair<std::string, uint64_t> > Callees;
+    DSGraphImage Image;
+
+    /// Data - The image as it is stored in the cache file, if it has not
+    /// been read yet.
+    StringRef Data;
+
+    Entry() : Key(0) {}
+
+    /// restore - Add the saved graph to G, reading it from the cache file
+    /// first if need be.
+    bool restore(DSGraph &G, DSValueTable &VT);
+  };
+
+private:
+  std::list<Entry> Entries;
+  StringMap<Entry*> ByFunction;
+  OwningPtr<MemoryBuffer> File;
+  bool Loaded;
+
+  void erase(Entry *E);
+
+  DSGraphCache(const DSGraphCache &);   // DO NOT IMPLEMENT
+  void operator=(const DSGraphCache &); // DO NOT IMPLEMENT
+public:
+  DSGraphCache() : Loaded(false) {}
+
+  /// get - Return the cache of the pass with the given name.
+  static DSGraphCache &get(StringRef PassName);
+
+  /// lookup - Return the entry holding the graph of the named function.
+  Entry *lookup(StringRef Function) const;
+
+  /// insert - Add an entry, replacing the entries of any of its functions.
+  /// The contents of E are moved into the cache.
+  void insert(Entry &E);
+
+  unsigned size() const { return Entries.size(); }
+
+  /// load - Add the entries of the cache file at Path, unless a file was
+  /// loaded before.  A file that is missing, damaged or written by another
+  /// version of this code is ignored.
+  void load(StringRef Path);
+
+  /// save - Write the entries of the functions defined in M to the cache
+  /// file at Path.  Return false, and set Error, if it cannot be written.
+  bool save(StringRef Path, const Module &M, std::string &Error) const;
+};
+
+}
+
+#endif
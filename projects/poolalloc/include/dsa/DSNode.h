@@ -19,6 +19,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "svset.h"
+#include "svmap.h"
 #include "super_set.h"
 #include "keyiterator.h"
 #include "DSGraph.h"
@@ -42,13 +43,16 @@ class DSNodeIterator;          // Data structure graph traversal iterator
 ///
 class DSNode : public ilist_node<DSNode> {
 public:
-  typedef std::map<unsigned, SuperSet<Type*>::setPtr> TyMapTy;
-  typedef std::map<unsigned, DSNodeHandle> LinkMapTy;
+  // Most nodes hold only a handful of types and links, so both are kept in
+  // sorted vectors with inline storage.  Iterators and references into them
+  // do not survive an insertion.
+  typedef svmap<unsigned, SuperSet<Type*>::setPtr> TyMapTy;
+  typedef svmap<unsigned, DSNodeHandle> LinkMapTy;
 
 private:
   friend struct ilist_sentinel_traits<DSNode>;
   //Sentinel
-  DSNode() : NumReferrers(0), Size(0), NodeType(0) {}
+  DSNode() : NumReferrers(0), Size(0), NodeType(0), Epoch(0), Index(0) {}
   
   /// NumReferrers - The number of DSNodeHandles pointing to this node... if
   /// this is a forwarding node, then this is the number of node handles which
@@ -124,6 +128,13 @@ public:
   ///
 private:
   unsigned short NodeType;
+
+  /// Epoch, Index - The liveness walk of DSGraph::removeDeadNodes that last
+  /// numbered this node, and the number it was given.  Index means nothing
+  /// unless Epoch is the walk in progress.
+  ///
+  unsigned Epoch;
+  unsigned Index;
 public:
 
   /// DSNode ctor - Create a node of the specified type, inserting it into the
@@ -137,6 +148,14 @@ public:
   /// links are just going to be clobbered anyway.
   ///
   DSNode(const DSNode &, DSGraph *G, bool NullLinks = false);
+
+  /// operator new - Nodes created for a graph live in the graph's node arena.
+  /// Nodes created without one, such as the node list sentinel, come from the
+  /// heap.
+  static void *operator new(size_t Size, DSGraph *G);
+  static void *operator new(size_t Size);
+  static void operator delete(void *P);
+  static void operator delete(void *P, DSGraph *G);
   ~DSNode();
 
   // Iterator for graph interface... Defined in DSGraphTraits.h
@@ -222,7 +241,8 @@ public:
     return Links.find(Offset) != Links.end();
   }
 
-  /// getLink - Return the link at the specified offset.
+  /// getLink - Return the link at the specified offset.  The returned reference
+  /// is invalidated by adding a link at another offset of this node.
   ///
   DSNodeHandle &getLink(unsigned Offset) {
     assert(Offset < getSize() && "Link index is out of range!");
@@ -285,7 +305,13 @@ public:
   ///
   void setLink(unsigned Offset, const DSNodeHandle &NH) {
     assert(Offset < getSize() && "Link index is out of range!");
-    Links[Offset] = NH;
+    // NH may refer to one of our own links, so do not look it up with
+    // operator[], which could move it before it is read.
+    LinkMapTy::iterator I = Links.find(Offset);
+    if (I != Links.end())
+      I->second = NH;
+    else
+      Links.insert(std::make_pair(Offset, NH));
   }
 
   /// addEdgeTo - Add an edge from the current node to the specified node.  This
@@ -450,6 +476,8 @@ public:
   void checkOffsetFoldIfNeeded(int Offset);
 private:
   friend class DSNodeHandle;
+  friend class DSGraphImage;
+  friend class LiveNodeWalk;
 
   // static mergeNodes - Helper for mergeWith()
   static void MergeNodes(DSNodeHandle& CurNodeH, DSNodeHandle& NH);
@@ -192,6 +192,7 @@ private:
 
 
   DSCallSite();                         // DO NOT IMPLEMENT
+  friend class DSGraphImage;
 public:
   /// Constructor.  Note - This ctor destroys the argument vector passed in.  On
   /// exit, the argument vector is empty.
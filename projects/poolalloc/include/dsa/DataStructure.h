@@ -35,6 +35,7 @@ class Instruction;
 class GlobalValue;
 class DSGraph;
 class DSCallSite;
+class DSGraphCache;
 class DSNode;
 class DSNodeHandle;
 
@@ -98,6 +99,15 @@ protected:
   
   void formGlobalFunctionList();
 
+  /// getGraphCache - Return the graphs saved by this kind of pass in the
+  /// incremental mode, loading them from the cache directory the first time
+  /// if there is one.
+  DSGraphCache &getGraphCache() const;
+
+  /// saveGraphCache - Write the graphs saved by this kind of pass for the
+  /// functions of M to the cache directory, if there is one.
+  void saveGraphCache(const Module &M) const;
+
   DataStructures(char & id, const char* name) 
     : ModulePass(id), TD(0), GraphSource(0), printname(name), GlobalsGraph(0) {  
     // For now, the graphs are owned by this pass
@@ -231,16 +241,27 @@ protected:
   // from the CallGraph.  This is useful while doing original BU,
   // but might be undesirable in other passes such as CBU/EQBU.
   bool filterCallees;
+
+  // Scheduler -- The state shared by the threads calculating graphs in
+  // parallel, or null when graphs are calculated by this thread alone.
+  struct SCCScheduler;
+  SCCScheduler *Scheduler;
+
+  // Incremental -- The graphs saved by earlier runs and what is known about
+  // the graphs of this run, or null when the incremental mode is off.
+  struct IncrementalState;
+  IncrementalState *Incremental;
 public:
   static char ID;
   //Child constructor (CBU)
   BUDataStructures(char & CID, const char* name, const char* printname,
       bool filter)
-    : DataStructures(CID, printname), debugname(name), filterCallees(filter) {}
+    : DataStructures(CID, printname), debugname(name), filterCallees(filter),
+      Scheduler(0), Incremental(0) {}
   //main constructor
   BUDataStructures()
     : DataStructures(ID, "bu."), debugname("dsa-bu"),
-    filterCallees(true) {}
+    filterCallees(true), Scheduler(0), Incremental(0) {}
   ~BUDataStructures() { releaseMemory(); }
 
   virtual bool runOnModule(Module &M);
@@ -255,17 +276,23 @@ protected:
 
 private:
   // Private typedefs
-  typedef std::map<const Function*, unsigned> TarjanMap;
-  typedef std::vector<const Function*>        TarjanStack;
   typedef svset<const Function*>              FuncSet;
 
+  // State of the Tarjan SCC walk over the call graph (see BottomUpClosure.cpp)
+  struct TarjanState;
+
   void postOrderInline (Module & M);
-  unsigned calculateGraphs (const Function *F,
-                            TarjanStack & Stack,
-                            unsigned & NextID,
-                            TarjanMap & ValMap);
+  unsigned calculateGraphs (const Function *F, TarjanState & State);
+  bool beginVisit (const Function *F, TarjanState & State, unsigned & ID);
+  bool finishVisit (TarjanState & State, unsigned & Result);
+  bool reuseGraph (const Function *F, TarjanState & State);
+  void saveGraph (const Function *F, DSGraph *G);
 
-  void calculateGraph(DSGraph* G);
+  void inlineInParallel (Module & M, TarjanState & State, unsigned NumThreads);
+  static void *runSCCThread (void * Arg);
+  bool calculateSCC (unsigned SCC);
+
+  bool calculateGraph(DSGraph* G);
 
   void CloneAuxIntoGlobal(DSGraph* G);
 
@@ -358,10 +385,21 @@ class TDDataStructures : public DataStructures {
 
   bool useEQBU;
 
+  // Scheduler - The state shared by the threads inlining callers in
+  // parallel, or null when graphs are processed by this thread alone.
+  struct GraphScheduler;
+  GraphScheduler *Scheduler;
+
+  // Incremental - The graphs saved by earlier runs and the fingerprints of
+  // the graphs of this run, or null when the incremental mode is off.
+  struct IncrementalState;
+  IncrementalState *Incremental;
+
 public:
   static char ID;
   TDDataStructures(char & CID = ID, const char* printname = "td.", bool useEQ = false)
-    : DataStructures(CID, printname), useEQBU(useEQ) {}
+    : DataStructures(CID, printname), useEQBU(useEQ), Scheduler(0),
+      Incremental(0) {}
   ~TDDataStructures();
 
   virtual bool runOnModule(Module &M);
@@ -385,6 +423,15 @@ private:
   void InlineCallersIntoGraph(DSGraph* G);
   void ComputePostOrder(const Function &F, DenseSet<DSGraph*> &Visited,
                         std::vector<DSGraph*> &PostOrder);
+
+  bool getGraphKey(DSGraph* DSG, const std::vector<CallerCallEdge> &Edges,
+                   bool isExternallyCallable, uint64_t &Key);
+  DSGraph* reuseGraph(DSGraph* DSG, uint64_t Key);
+  void saveGraph(DSGraph* DSG, bool Save, uint64_t Key);
+
+  void getCalleeGraphs(DSGraph* G, std::vector<DSGraph*> &Callees);
+  void inlineInParallel(std::vector<DSGraph*> &PostOrder, unsigned NumThreads);
+  static void *runGraphThread(void *Arg);
 };
 
 /// EQTDDataStructures - Analysis that computes new data structure graphs
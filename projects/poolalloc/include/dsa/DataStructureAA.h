@@ -0,0 +1,105 @@
+//===- DataStructureAA.h - Data Structure Based Alias Analysis --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This header defines DSAA, an alias analysis that answers queries from the
+// top-down data structure graphs and remembers its answers for each graph.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_ANALYSIS_DATA_STRUCTURE_AA_H
+#define LLVM_ANALYSIS_DATA_STRUCTURE_AA_H
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+
+namespace llvm {
+
+class DSGraph;
+class TDDataStructures;
+
+//===----------------------------------------------------------------------===//
+/// DSAA - An alias analysis that uses the top-down DSGraphs.  Two pointers
+/// cannot alias if one of them points to a complete node and the other
+/// points to another node, or to a range of the same node that does not
+/// overlap.  Anything else is passed on to the next alias analysis.
+///
+/// The first query about a graph numbers its nodes and records the node and
+/// offset of each pointer in its scalar map, and the answers for each pair
+/// of (node, offset, size) are kept until the graph is changed, so queries
+/// that are asked again do not look at the graph.
+///
+class DSAA : public ModulePass, public AliasAnalysis {
+  TDDataStructures *TD;
+
+  /// Pointer - Where a pointer points in the graph of a query: the cache of
+  /// that graph, and the node number and offset, or no cache if DSA does not
+  /// know the pointer.
+  struct Pointer;
+
+  /// GraphCache - The node numbers, pointers and answers of one graph.
+  struct GraphCache;
+  DenseMap<const DSGraph*, GraphCache*> Caches;
+
+  GraphCache *getCache(DSGraph *G);
+  DSGraph *getGraphForValues(const Location *Locs, unsigned NumLocs);
+  void findPointer(DSGraph *G, const Location &Loc, Pointer &P);
+  void findPointers(DSGraph *G, ArrayRef<Location> Locs,
+                    SmallVectorImpl<Pointer> &InGraph,
+                    SmallVectorImpl<Pointer> &InGlobals);
+  bool isNoAlias(const Pointer &P1, const Pointer &P2);
+
+  void invalidateCache(const Value *V);
+  void invalidateCaches();
+
+public:
+  static char ID;
+  DSAA() : ModulePass(ID), TD(0) {}
+  ~DSAA() { invalidateCaches(); }
+
+  virtual bool runOnModule(Module &M);
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+  virtual void releaseMemory() { invalidateCaches(); }
+
+  /// getAdjustedAnalysisPointer - This method is used when a pass implements
+  /// an analysis interface through multiple inheritance.
+  virtual void *getAdjustedAnalysisPointer(AnalysisID PI) {
+    if (PI == &AliasAnalysis::ID)
+      return (AliasAnalysis*)this;
+    return this;
+  }
+
+  //------------------------------------------------
+  // Implement the AliasAnalysis API
+  //
+
+  virtual AliasResult alias(const Location &LocA, const Location &LocB);
+
+  virtual ModRefResult getModRefInfo(ImmutableCallSite CS,
+                                     const Location &Loc);
+  virtual ModRefResult getModRefInfo(ImmutableCallSite CS1,
+                                     ImmutableCallSite CS2) {
+    return AliasAnalysis::getModRefInfo(CS1, CS2);
+  }
+
+  virtual void deleteValue(Value *V);
+  virtual void copyValue(Value *From, Value *To);
+
+  /// aliasMany - Answer alias(LocsA[i], LocsB[j]) for every pair, storing it
+  /// in Results[i * LocsB.size() + j].  Each pointer is looked up in the
+  /// graph once.  All of the pointers must be in the same function.
+  void aliasMany(ArrayRef<Location> LocsA, ArrayRef<Location> LocsB,
+                 SmallVectorImpl<AliasResult> &Results);
+};
+
+}
+
+#endif
@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   super_set.h
  * Author: andrew
  *
@@ -9,35 +9,139 @@
 #define	_SUPER_SET_H
 
 #include "svset.h"
-#include <set>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/RWMutex.h"
+#include <deque>
 
 // Contains stable references to a set
 // The sets can be grown.
+// Sets are interned: equal sets are always the same object, so they can be
+// compared by pointer.  Lookups go through a hash table of the sets, and the
+// results of adding an element to a set or of joining two sets are cached.
+// Sets may be created by several threads at the same time once LLVM is in
+// multithreaded mode (see llvm_start_multithreaded()).
 
 template<typename Ty>
 class SuperSet {
-  //std::set provides stable iterators, and that matters a lot
   typedef svset<Ty> InnerSetTy;
-  typedef std::set<InnerSetTy> OuterSetTy;
-  OuterSetTy container;
 public:
-  typedef const typename OuterSetTy::value_type* setPtr;
+  typedef const InnerSetTy* setPtr;
 
+private:
+  // Hash and compare sets by their contents
+  struct SetInfo {
+    static setPtr getEmptyKey() {
+      return llvm::DenseMapInfo<setPtr>::getEmptyKey();
+    }
+    static setPtr getTombstoneKey() {
+      return llvm::DenseMapInfo<setPtr>::getTombstoneKey();
+    }
+    static unsigned getHashValue(setPtr S) {
+      return llvm::hash_combine_range(S->begin(), S->end());
+    }
+    static bool isEqual(setPtr L, setPtr R) {
+      if (L == R) return true;
+      if (L == getEmptyKey() || L == getTombstoneKey() ||
+          R == getEmptyKey() || R == getTombstoneKey())
+        return false;
+      return *L == *R;
+    }
+  };
+
+  //std::deque provides stable references, and that matters a lot
+  std::deque<InnerSetTy> container;
+  llvm::DenseSet<setPtr, SetInfo> Sets;
+
+  // Results of adding an element to a set, and of joining two sets
+  llvm::DenseMap<std::pair<setPtr, Ty>, setPtr> AddCache;
+  llvm::DenseMap<std::pair<setPtr, setPtr>, setPtr> UnionCache;
+
+  llvm::sys::SmartRWMutex<true> Lock;
+
+  static llvm::Statistic NumSets;
+  static llvm::Statistic NumLookups;
+  static llvm::Statistic NumCacheHits;
+
+  // Find or add S; the writer lock must be held.
+  setPtr intern(const InnerSetTy& S) {
+    typename llvm::DenseSet<setPtr, SetInfo>::iterator I = Sets.find(&S);
+    if (I != Sets.end()) return *I;
+    container.push_back(S);
+    setPtr P = &container.back();
+    Sets.insert(P);
+    ++NumSets;
+    return P;
+  }
+
+public:
   setPtr getOrCreate(svset<Ty>& S) {
     if (S.empty()) return 0;
-    return &(*container.insert(S).first);
+    ++NumLookups;
+    llvm::sys::SmartScopedWriter<true> Guard(Lock);
+    return intern(S);
   }
 
   setPtr getOrCreate(setPtr P, Ty t) {
+    if (P && P->count(t)) return P;
+    ++NumLookups;
+    std::pair<setPtr, Ty> Key(P, t);
+    {
+      llvm::sys::SmartScopedReader<true> Guard(Lock);
+      typename llvm::DenseMap<std::pair<setPtr, Ty>, setPtr>::iterator I =
+        AddCache.find(Key);
+      if (I != AddCache.end()) {
+        ++NumCacheHits;
+        return I->second;
+      }
+    }
     svset<Ty> s;
     if (P)
       s.insert(P->begin(), P->end());
     s.insert(t);
-    return getOrCreate(s);
+    llvm::sys::SmartScopedWriter<true> Guard(Lock);
+    return AddCache[Key] = intern(s);
   }
-};
 
+  // Return the union of two sets
+  setPtr getOrCreate(setPtr P, setPtr Q) {
+    if (!P || P == Q) return Q;
+    if (!Q) return P;
+    ++NumLookups;
+    if (Q < P) std::swap(P, Q);
+    std::pair<setPtr, setPtr> Key(P, Q);
+    {
+      llvm::sys::SmartScopedReader<true> Guard(Lock);
+      typename llvm::DenseMap<std::pair<setPtr, setPtr>, setPtr>::iterator I =
+        UnionCache.find(Key);
+      if (I != UnionCache.end()) {
+        ++NumCacheHits;
+        return I->second;
+      }
+    }
+    svset<Ty> s(*P);
+    s.insert(Q->begin(), Q->end());
+    llvm::sys::SmartScopedWriter<true> Guard(Lock);
+    return UnionCache[Key] = intern(s);
+  }
 
+  // Number of distinct sets created so far
+  unsigned size() {
+    llvm::sys::SmartScopedReader<true> Guard(Lock);
+    return container.size();
+  }
+};
 
-#endif	/* _SUPER_SET_H */
+template<typename Ty>
+llvm::Statistic SuperSet<Ty>::NumSets =
+  { "dsa", "Number of unique type sets", 0, 0 };
+template<typename Ty>
+llvm::Statistic SuperSet<Ty>::NumLookups =
+  { "dsa", "Number of type set lookups", 0, 0 };
+template<typename Ty>
+llvm::Statistic SuperSet<Ty>::NumCacheHits =
+  { "dsa", "Number of type set lookups answered by the cache", 0, 0 };
 
+#endif	/* _SUPER_SET_H */
@@ -0,0 +1,153 @@
+#ifndef _SV_ORDERED_MAP_HH_
+#define _SV_ORDERED_MAP_HH_ 1
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <algorithm>
+#include <utility>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// A map implemented atop a sorted small vector.  The first N entries are
+/// stored inline, so small maps need no heap allocation at all.
+/// Iterators and references are not stable accross insert or delete
+template< typename Key, typename T, unsigned N = 4 >
+class svmap {
+  typedef llvm::SmallVector<std::pair<Key, T>, N> internal_type;
+
+// Types
+public:
+
+  typedef Key                  key_type;
+  typedef T                    mapped_type;
+  typedef std::pair<Key, T>    value_type;
+  typedef value_type&          reference;
+  typedef const value_type&    const_reference;
+  typedef typename internal_type::const_iterator const_iterator;
+  typedef typename internal_type::iterator iterator;
+  typedef typename internal_type::size_type size_type;
+
+private:
+
+  internal_type container_;
+
+  /// Order entries by key only; keys are unique.
+  struct key_less {
+    bool operator()(const value_type& lhs, const Key& rhs) const {
+      return lhs.first < rhs;
+    }
+  };
+
+public:
+  /// Empty constructor.
+  svmap()
+  : container_() { }
+
+  /// Copy-constructor.
+  svmap(const svmap& rhs)
+  : container_(rhs.container_)
+  {}
+
+  svmap & operator=(const svmap& rhs) {
+    if (&rhs != this) {
+      this->container_ = rhs.container_;
+    }
+    return *this;
+  }
+
+  const_iterator begin() const {
+    return container_.begin();
+  }
+
+  const_iterator end() const {
+    return container_.end();
+  }
+
+  iterator begin() {
+    return container_.begin();
+  }
+
+  iterator end() {
+    return container_.end();
+  }
+
+  bool empty() const {
+    return container_.empty();
+  }
+
+  size_type size() const {
+    return container_.size();
+  }
+
+  /// Returns the first entry whose key is not less than k.
+  const_iterator lower_bound(const key_type& k) const {
+    return std::lower_bound(container_.begin(), container_.end(), k,
+                            key_less());
+  }
+
+  iterator lower_bound(const key_type& k) {
+    return std::lower_bound(container_.begin(), container_.end(), k,
+                            key_less());
+  }
+
+  /// Find the key k.
+  const_iterator find(const key_type& k) const {
+    const_iterator i = lower_bound(k);
+    if (i != container_.end() && i->first == k) return i;
+    return container_.end();
+  }
+
+  iterator find(const key_type& k) {
+    iterator i = lower_bound(k);
+    if (i != container_.end() && i->first == k) return i;
+    return container_.end();
+  }
+
+  size_type count(const key_type& k) const {
+    return find(k) != end();
+  }
+
+  /// Insert a value if its key is not already present.  The value is copied
+  /// before the vector is touched, so it may refer into this map.
+  std::pair<iterator,bool>
+  insert(const value_type& x) {
+    iterator i = lower_bound(x.first);
+    if (i != container_.end() && i->first == x.first)
+      return std::make_pair(i, false);
+    value_type Copy(x);
+    return std::make_pair(container_.insert(i, Copy), true);
+  }
+
+  /// Return the value for key k, inserting a default one if needed.
+  mapped_type& operator[](const key_type& k) {
+    iterator i = lower_bound(k);
+    if (i == container_.end() || i->first != k)
+      i = container_.insert(i, value_type(k, mapped_type()));
+    return i->second;
+  }
+
+  iterator erase(iterator position) {
+    return container_.erase(position);
+  }
+
+  size_type erase(const key_type& k) {
+    iterator i = find(k);
+    if (i != end()) {
+      erase(i);
+      return 1;
+    }
+    return 0;
+  }
+
+  void swap(svmap& s) {
+    container_.swap(s.container_);
+  }
+
+  void clear() {
+    container_.clear();
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // _SV_ORDERED_MAP_HH_
@@ -18,10 +18,22 @@
 #include "llvm/Constants.h"
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
+#include "dsa/DSGraphImage.h"
 #include "llvm/Module.h"
+#include "llvm/TypeFinder.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Threading.h"
+
+#include <algorithm>
+#include <pthread.h>
 
 using namespace llvm;
 
@@ -35,11 +47,20 @@ namespace {
   STATISTIC (NumEmptyCalls, "Number of calls we know nothing about");
   STATISTIC (NumRecalculations, "Number of DSGraph recalculations");
   STATISTIC (NumRecalculationsSkipped, "Number of DSGraph recalculations skipped");
+  STATISTIC (NumReusedGraphs, "Number of SCC graphs reused");
 
   RegisterPass<BUDataStructures>
   X("dsa-bu", "Bottom-up Data Structure Analysis");
 }
 
+cl::opt<unsigned> DSAThreads("dsa-threads",
+                             cl::desc("Number of threads used to calculate "
+                                      "interprocedural DSGraphs"),
+                             cl::init(1));
+
+// Defined in Local.cpp
+extern cl::opt<bool> DSAIncremental;
+
 char BUDataStructures::ID;
 
 // run - Calculate the bottom up data structure graphs for each function in the
@@ -219,6 +240,336 @@ getAllAuxCallees (DSGraph* G, FuncSet & Callees) {
     getAllCallees(*I, Callees);
 }
 
+//
+// Function: hasNewCallees()
+//
+// Description:
+//  Determine whether the set of callees New holds any function that is not in
+//  the sorted range of old callees [OldBegin, OldEnd).
+//
+static bool hasNewCallees(svset<const Function*> &New,
+                          std::vector<const Function*>::const_iterator OldBegin,
+                          std::vector<const Function*>::const_iterator OldEnd) {
+  if (New.size() > (size_t)(OldEnd - OldBegin)) return true;
+
+  svset<const Function*>::iterator NI = New.begin(), NE = New.end();
+
+  for (; NI != NE; ++NI)
+    if (!std::binary_search(OldBegin, OldEnd, *NI)) return true;
+
+  return false;
+}
+
+//
+// Struct: TarjanState
+//
+// Description:
+//  This is the state of the Tarjan SCC-finding algorithm used by
+//  calculateGraphs().  The walk keeps its own stack of frames instead of
+//  recursing so that deep call chains cannot overflow the program stack.
+//
+//  Functions are numbered densely once per module; the Tarjan ID of each
+//  function is kept in a vector indexed by that number.  An ID of zero means
+//  that the function has not been visited, and an ID of ~0U means that the
+//  graph for the function's SCC has been calculated.
+//
+struct BUDataStructures::TarjanState {
+  // A function whose callees are being visited
+  struct Frame {
+    const Function *F;
+    unsigned MyID;
+    unsigned Min;
+    // Index of the function's first callee in Callees
+    unsigned CalleeBegin;
+    // Index of the next callee to visit in Callees
+    unsigned NextCallee;
+  };
+
+  // Dense number of each function in the module
+  DenseMap<const Function*, unsigned> FunctionNumbers;
+
+  // Tarjan ID of each function, indexed by function number
+  std::vector<unsigned> ValMap;
+
+  // Functions whose SCC has not yet been completed
+  std::vector<const Function*> Stack;
+
+  // Functions being visited, innermost last
+  std::vector<Frame> Frames;
+
+  // Sorted callees of each frame, stored back to back.  The callees of the
+  // innermost frame extend to the end of the vector.
+  std::vector<const Function*> Callees;
+
+  unsigned NextID;
+
+  // If not null, completed SCCs are handed to this scheduler instead of
+  // being calculated as they are found
+  SCCScheduler *Scheduler;
+
+  explicit TarjanState (Module & M) : NextID (1), Scheduler (0) {
+    unsigned NumFunctions = 0;
+    for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
+      FunctionNumbers[I] = NumFunctions++;
+    ValMap.resize (NumFunctions, 0);
+  }
+
+  unsigned getNumber (const Function *F) const {
+    DenseMap<const Function*, unsigned>::const_iterator It =
+      FunctionNumbers.find(F);
+    assert (It != FunctionNumbers.end() && "Function not in module!");
+    return It->second;
+  }
+
+  unsigned & getID (const Function *F) {
+    return ValMap[getNumber(F)];
+  }
+
+  bool isVisited (const Function *F) {
+    return getID(F) != 0;
+  }
+};
+
+//
+// Class: SchedulerLock
+//
+// Description:
+//  Hold one of the locks of the SCC scheduler for the life of the object.
+//  Nothing is locked when graphs are not being calculated in parallel.
+//
+class SchedulerLock {
+  sys::Mutex *M;
+public:
+  explicit SchedulerLock (sys::Mutex *M) : M (M) {
+    if (M) M->acquire();
+  }
+  ~SchedulerLock () {
+    if (M) M->release();
+  }
+};
+
+//
+// Struct: SCCScheduler
+//
+// Description:
+//  This holds the SCCs of the call graph while their graphs are calculated
+//  by several threads.  An SCC is ready once the graphs of all the SCCs that
+//  it calls are finished.  Ready SCCs do not depend on each other, so their
+//  graphs can be calculated at the same time.
+//
+//  The threads share the globals graph, the call graph, and the graphs of
+//  finished SCCs, which are read whenever they are inlined into a caller.
+//  Each of these is guarded by a lock here.  Type sets are guarded by the
+//  lock in SuperSet.
+//
+struct BUDataStructures::SCCScheduler {
+  // Number of locks guarding the graphs of finished SCCs
+  enum { NumGraphLocks = 64 };
+
+  // Members of each SCC, stored back to back in the order in which they were
+  // popped from the Tarjan stack
+  std::vector<const Function*> Members;
+  std::vector<unsigned> MemberBegin;
+
+  // Callees of the root of each SCC when it was visited, stored back to back.
+  // As in the serial walk, a graph is recalculated only if it gains callees
+  // that are not among these.
+  std::vector<const Function*> RootCallees;
+  std::vector<unsigned> RootCalleeBegin;
+
+  // SCC of each function, indexed by function number.  This is ~0U for
+  // functions whose graphs were finished before the SCCs were scheduled.
+  std::vector<unsigned> SCCOf;
+
+  // SCCs waiting for each SCC (its callers, and the next SCC sharing its
+  // graph), and the number of unfinished SCCs that each SCC is waiting for
+  std::vector<std::vector<unsigned> > Callers;
+  std::vector<unsigned> Pending;
+
+  // Functions that each SCC has been found to call.  Each list is only
+  // updated by the thread calculating the SCC.
+  std::vector<std::vector<const Function*> > Calls;
+
+  // Whether the graph of each SCC has been finished
+  std::vector<char> Done;
+
+  // SCCs that are ready, and the number of SCCs being calculated
+  std::vector<unsigned> Ready;
+  unsigned Running;
+
+  // Guards Done, Pending, Ready and Running
+  pthread_mutex_t QueueLock;
+  pthread_cond_t QueueChanged;
+
+  sys::Mutex GlobalsLock;
+  sys::Mutex CallGraphLock;
+  sys::Mutex GraphLocks[NumGraphLocks];
+
+  TarjanState & State;
+
+  explicit SCCScheduler (TarjanState & State) : Running (0), State (State) {
+    MemberBegin.push_back(0);
+    RootCalleeBegin.push_back(0);
+    pthread_mutex_init(&QueueLock, 0);
+    pthread_cond_init(&QueueChanged, 0);
+  }
+
+  ~SCCScheduler () {
+    pthread_cond_destroy(&QueueChanged);
+    pthread_mutex_destroy(&QueueLock);
+  }
+
+  unsigned getNumSCCs () const {
+    return MemberBegin.size() - 1;
+  }
+
+  unsigned getSCC (const Function *F) const {
+    return SCCOf[State.getNumber(F)];
+  }
+
+  //
+  // Method: canInline()
+  //
+  // Description:
+  //  Determine whether the graphs of the specified callees can be inlined
+  //  into graph G now: each must be G itself or the graph of a finished SCC.
+  //
+  bool canInline (const DSGraph *G,
+                  const FuncSet & Callees,
+                  const BUDataStructures & Pass) {
+    bool Result = true;
+    pthread_mutex_lock(&QueueLock);
+    for (FuncSet::const_iterator I = Callees.begin(), E = Callees.end();
+         I != E; ++I) {
+      if (Pass.getDSGraph(**I) == G)
+        continue;
+      unsigned SCC = getSCC(*I);
+      if (SCC != ~0U && !Done[SCC]) {
+        Result = false;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&QueueLock);
+    return Result;
+  }
+
+  static sys::Mutex *getGlobalsLock (SCCScheduler *S) {
+    return S ? &S->GlobalsLock : 0;
+  }
+
+  static sys::Mutex *getCallGraphLock (SCCScheduler *S) {
+    return S ? &S->CallGraphLock : 0;
+  }
+
+  //
+  // Method: getGraphLock()
+  //
+  // Description:
+  //  Return the lock to hold while graph GI is inlined into graph G, or null
+  //  if no lock is needed.  Inlining a graph updates the reference counts of
+  //  its nodes, so a graph must not be inlined by two threads at once.
+  //
+  static sys::Mutex *getGraphLock (SCCScheduler *S,
+                                   const DSGraph *GI,
+                                   const DSGraph *G) {
+    if (!S || GI == G)
+      return 0;
+    return &S->GraphLocks[(reinterpret_cast<uintptr_t>(GI) / sizeof(DSGraph))
+                          % NumGraphLocks];
+  }
+};
+
+//
+// Struct: IncrementalState
+//
+// Description:
+//  This is the state of the incremental mode of postOrderInline().  The graph
+//  of an SCC is restored from the cache if the input graphs of its functions
+//  are the same as when it was saved, and so are the graphs of the callees
+//  that were inlined into it.  Only the other SCCs are calculated again, so
+//  a change to a function is followed up its callers and no further.
+//
+//  Inlining a graph is recorded in the graph that it is inlined into, along
+//  with the fingerprint of the inlined graph.  The fingerprints of graphs are
+//  remembered until the graphs change.
+//
+struct BUDataStructures::IncrementalState {
+  // The key of an SCC, and the sorted names of its functions
+  struct SCCKey {
+    bool Valid;
+    uint64_t Hash;
+    std::vector<std::string> Members;
+  };
+
+  DSValueTable Values;
+  DSGraphCache & Cache;
+
+  // Hash of what every graph of this run depends on besides its own code
+  uint64_t Context;
+
+  // Fingerprints of graphs that have not changed since they were taken.  A
+  // graph that could not be fingerprinted has the fingerprint 0.
+  DenseMap<const DSGraph*, uint64_t> Fingerprints;
+
+  // Callees inlined into each graph, with the fingerprints of their graphs
+  std::map<const DSGraph*,
+           std::vector<std::pair<std::string, uint64_t> > > Inlined;
+
+  // Keys of the SCC roots that have been looked up in the cache
+  std::map<const Function*, SCCKey> Keys;
+
+  // Graphs that moved dead aux calls to the globals graph while they were
+  // calculated.  A restored graph would not move them again, so these graphs
+  // are not saved.
+  SmallPtrSet<const DSGraph*, 16> MovedCalls;
+
+  IncrementalState (Module & M, DSGraphCache & Cache)
+    : Values (M), Cache (Cache), Context (0) {}
+
+  uint64_t getFingerprint (DSGraph *G) {
+    DenseMap<const DSGraph*, uint64_t>::iterator It = Fingerprints.find(G);
+    if (It != Fingerprints.end())
+      return It->second;
+    DSGraphImage Image;
+    uint64_t FP = Image.capture(*G, Values) ? Image.getFingerprint() : 0;
+    return Fingerprints[G] = FP;
+  }
+
+  //
+  // Method: forget()
+  //
+  // Description:
+  //  Drop what is known about graph G, which is about to be changed or
+  //  deleted.  If it is being merged into graph Into, the callees inlined
+  //  into it are now inlined into Into.
+  //
+  void forget (const DSGraph *G, const DSGraph *Into = 0) {
+    Fingerprints.erase(G);
+    if (Into) {
+      std::vector<std::pair<std::string, uint64_t> > & Callees = Inlined[G];
+      Inlined[Into].insert(Inlined[Into].end(), Callees.begin(), Callees.end());
+      Inlined.erase(G);
+      if (MovedCalls.erase(G))
+        MovedCalls.insert(Into);
+    }
+  }
+
+  //
+  // Method: removeDeadNodes()
+  //
+  // Description:
+  //  Remove the dead nodes of graph G, noting whether any of its aux calls
+  //  were moved to the globals graph GG.
+  //
+  void removeDeadNodes (DSGraph *G, DSGraph *GG) {
+    DSGraph::FunctionListTy & GGCalls = GG->getAuxFunctionCalls();
+    const DSCallSite *Last = GGCalls.empty() ? 0 : &GGCalls.back();
+    G->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+    if ((GGCalls.empty() ? 0 : &GGCalls.back()) != Last)
+      MovedCalls.insert(G);
+  }
+};
+
 //
 // Method: postOrderInline()
 //
@@ -228,11 +579,24 @@ getAllAuxCallees (DSGraph* G, FuncSet & Callees) {
 //
 void
 BUDataStructures::postOrderInline (Module & M) {
-  // Variables used for Tarjan SCC-finding algorithm.  These are passed into
-  // the recursive function used to find SCCs.
-  std::vector<const Function*> Stack;
-  std::map<const Function*, unsigned> ValMap;
-  unsigned NextID = 1;
+  // State of the Tarjan SCC-finding algorithm.  This is shared by all of the
+  // traversals below so that no function is visited twice.
+  TarjanState State (M);
+
+  //
+  // In the incremental mode, the graphs of SCCs whose code and callees have
+  // not changed are restored from the cache.  The SCCs are found in one walk
+  // so that each graph is calculated after the graphs that it depends on.
+  //
+  OwningPtr<IncrementalState> Inc;
+  if (DSAIncremental) {
+    Inc.reset(new IncrementalState(M, getGraphCache()));
+    hash_code Context = hash_combine(filterCallees);
+    for (unsigned i = 0, e = GlobalFunctionList.size(); i != e; ++i)
+      Context = hash_combine(Context, GlobalFunctionList[i]->getName());
+    Inc->Context = Context;
+    Incremental = Inc.get();
+  }
 
 
   // Do post order traversal on the global ctors. Use this information to update
@@ -256,8 +620,8 @@ BUDataStructures::postOrderInline (Module & M) {
             if (CE->isCast())
               FP = CE->getOperand(0);
           Function *F = dyn_cast<Function>(FP);
-          if (F && !F->isDeclaration() && !ValMap.count(F)) {
-            calculateGraphs(F, Stack, NextID, ValMap);
+          if (F && !F->isDeclaration() && !State.isVisited(F)) {
+            calculateGraphs(F, State);
             CloneAuxIntoGlobal(getDSGraph(*F));
           }
         }
@@ -276,6 +640,8 @@ BUDataStructures::postOrderInline (Module & M) {
       formGlobalECs();
       // propogte information calculated 
       // from the globals graph to the other graphs.
+      if (Incremental)
+        Incremental->Fingerprints.clear();
       for (Module::iterator F = M.begin(); F != M.end(); ++F) {
         if (!(F->isDeclaration())){
           DSGraph *Graph  = getDSGraph(*F);
@@ -292,14 +658,22 @@ BUDataStructures::postOrderInline (Module & M) {
     }
   }
  
+  //
+  // If several threads may be used, calculate the graphs of as many SCCs as
+  // possible in parallel.  Any graphs left are calculated serially below.
+  //
+  if (DSAThreads > 1 && !Incremental &&
+      (llvm_is_multithreaded() || llvm_start_multithreaded()))
+    inlineInParallel(M, State, DSAThreads);
+
   //
   // Start the post order traversal with the main() function.  If there is no
   // main() function, don't worry; we'll have a separate traversal for inlining
   // graphs for functions not reachable from main().
   //
   Function *MainFunc = M.getFunction ("main");
-  if (MainFunc && !MainFunc->isDeclaration()) {
-    calculateGraphs(MainFunc, Stack, NextID, ValMap);
+  if (MainFunc && !MainFunc->isDeclaration() && !State.isVisited(MainFunc)) {
+    calculateGraphs(MainFunc, State);
     CloneAuxIntoGlobal(getDSGraph(*MainFunc));
   }
 
@@ -307,11 +681,11 @@ BUDataStructures::postOrderInline (Module & M) {
   // Calculate the graphs for any functions that are unreachable from main...
   //
   for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
-    if (!I->isDeclaration() && !ValMap.count(I)) {
+    if (!I->isDeclaration() && !State.isVisited(I)) {
       if (MainFunc)
         DEBUG(errs() << debugname << ": Function unreachable from main: "
         << I->getName() << "\n");
-      calculateGraphs(I, Stack, NextID, ValMap);     // Calculate all graphs.
+      calculateGraphs(I, State);     // Calculate all graphs.
       CloneAuxIntoGlobal(getDSGraph(*I));
 
       // Mark this graph as processed.  Do this by finding all functions
@@ -322,52 +696,112 @@ BUDataStructures::postOrderInline (Module & M) {
       for(DSGraph::retnodes_iterator RI = G->retnodes_begin(),
           RE = G->retnodes_end(); RI != RE; ++RI) {
         if (getDSGraph(*RI->first) == G) {
-          if (!ValMap.count(RI->first))
-            ValMap[RI->first] = ~0U;
+          if (!State.isVisited(RI->first))
+            State.getID(RI->first) = ~0U;
           else
-            assert(ValMap[RI->first] == ~0U);
+            assert(State.getID(RI->first) == ~0U);
         }
       }
     }
-  return;
-}
 
-static bool hasNewCallees(svset<const Function*> &New,
-                          svset<const Function*> &Old) {
-  if (New.size() > Old.size()) return true;
-
-  svset<const Function*>::iterator NI = New.begin(), NE = New.end();
-
-  for (; NI != NE; ++NI)
-    if (!Old.count(*NI)) return true;
-
-  return false;
+  if (Incremental)
+    saveGraphCache(M);
+  Incremental = 0;
+  return;
 }
 
 //
 // Method: calculateGraphs()
 //
 // Description:
-//  Perform recursive bottom-up inlining of DSGraphs from callee to caller.
+//  Perform bottom-up inlining of DSGraphs from callee to caller.  This is a
+//  post-order walk of the call graph using Tarjan's SCC-finding algorithm;
+//  the graph of each SCC is calculated once all the SCCs that it calls have
+//  been calculated.
 //
 // Inputs:
 //  F - The function which should have its callees' DSGraphs merged into its
 //      own DSGraph.
-//  Stack - The stack used for Tarjan's SCC-finding algorithm.
-//  NextID - The nextID value used for Tarjan's SCC-finding algorithm.
-//  ValMap - The map used for Tarjan's SCC-finding algorithm.
+//  State - The state of the Tarjan SCC-finding algorithm.
 //
 // Return value:
+//  The minimum Tarjan ID reachable from F that was on the SCC stack when F
+//  was visited.
 //
 unsigned
-BUDataStructures::calculateGraphs (const Function *F,
-                                   TarjanStack & Stack,
-                                   unsigned & NextID,
-                                   TarjanMap & ValMap) {
-  assert(!ValMap.count(F) && "Shouldn't revisit functions!");
-  unsigned Min = NextID++, MyID = Min;
-  ValMap[F] = Min;
-  Stack.push_back(F);
+BUDataStructures::calculateGraphs (const Function *F, TarjanState & State) {
+  assert(State.Frames.empty() && "Tarjan walk already in progress!");
+
+  unsigned Result;
+  if (!beginVisit(F, State, Result))
+    return Result;
+
+  bool HaveResult = false;
+  while (!State.Frames.empty()) {
+    //
+    // If a callee of the innermost function has just been finished, record
+    // the ID that it found if it is smaller than the minimum found so far.
+    //
+    if (HaveResult) {
+      TarjanState::Frame & Top = State.Frames.back();
+      if (Result < Top.Min) Top.Min = Result;
+      HaveResult = false;
+    }
+
+    //
+    // Iterate through each call target (these are the edges out of the
+    // current node (i.e., the current function) in Tarjan graph parlance).
+    // Find the minimum assigned ID.  Stop at the first callee that has not
+    // been visited and visit it now (this is the post-order component of the
+    // Bottom-Up algorithm).
+    //
+    bool Descended = false;
+    while (State.Frames.back().NextCallee != State.Callees.size()) {
+      TarjanState::Frame & Top = State.Frames.back();
+      const Function *Callee = State.Callees[Top.NextCallee++];
+      unsigned M = State.getID(Callee);
+      if (M == 0 && beginVisit(Callee, State, M)) {
+        Descended = true;
+        break;
+      }
+
+      //
+      // If we've found a function with a smaller ID than this funtion, record
+      // that ID as the minimum ID.
+      //
+      if (M < Top.Min) Top.Min = M;
+    }
+
+    if (!Descended)
+      HaveResult = finishVisit(State, Result);
+  }
+
+  assert(HaveResult && "Tarjan walk ended without a result!");
+  return Result;
+}
+
+//
+// Method: beginVisit()
+//
+// Description:
+//  Assign a Tarjan ID to the specified function and push it onto the SCC
+//  stack.  If the function has callees to visit, push a frame for it.
+//
+// Outputs:
+//  ID - The ID assigned to the function.
+//
+// Return value:
+//  true  - A frame was pushed for the function.
+//  false - The function has no body; it has been finished already.
+//
+bool
+BUDataStructures::beginVisit (const Function *F,
+                              TarjanState & State,
+                              unsigned & ID) {
+  assert(!State.isVisited(F) && "Shouldn't revisit functions!");
+  ID = State.NextID++;
+  State.getID(F) = ID;
+  State.Stack.push_back(F);
 
   //
   // FIXME: This test should be generalized to be any function that we have
@@ -376,9 +810,9 @@ BUDataStructures::calculateGraphs (const Function *F,
   //
   if (F->isDeclaration()) {   // sprintf, fprintf, sscanf, etc...
     // No callees!
-    Stack.pop_back();
-    ValMap[F] = ~0;
-    return Min;
+    State.Stack.pop_back();
+    State.getID(F) = ~0U;
+    return false;
   }
 
   //
@@ -393,79 +827,110 @@ BUDataStructures::calculateGraphs (const Function *F,
   FuncSet CalleeFunctions;
   getAllAuxCallees(Graph, CalleeFunctions);
 
+  TarjanState::Frame Frame;
+  Frame.F = F;
+  Frame.MyID = ID;
+  Frame.Min = ID;
+  Frame.CalleeBegin = State.Callees.size();
+  Frame.NextCallee = Frame.CalleeBegin;
+  State.Callees.insert(State.Callees.end(),
+                       CalleeFunctions.begin(), CalleeFunctions.end());
+  State.Frames.push_back(Frame);
+  return true;
+}
+
+//
+// Method: finishVisit()
+//
+// Description:
+//  Finish visiting the innermost function once all of its callees have been
+//  visited.  If the function is the root of an SCC, calculate the graph for
+//  the SCC.  If that graph has call sites to callees that were not known
+//  before, visit the function again.
+//
+// Outputs:
+//  Result - The minimum ID reachable from the function, if it was finished.
+//
+// Return value:
+//  true  - The function was finished and its frame removed.
+//  false - The function is being visited again; a new frame was pushed for it.
+//
+bool
+BUDataStructures::finishVisit (TarjanState & State, unsigned & Result) {
+  const TarjanState::Frame Top = State.Frames.back();
+  const Function *F = Top.F;
+  unsigned MyID = Top.MyID;
+  assert(State.getID(F) == MyID && "SCC construction assumption wrong!");
+
   //
-  // Iterate through each call target (these are the edges out of the current
-  // node (i.e., the current function) in Tarjan graph parlance).  Find the
-  // minimum assigned ID.
+  // If the minimum ID found is not this function's ID, then this function is
+  // part of a larger SCC.
   //
-  for (FuncSet::iterator I = CalleeFunctions.begin(), E = CalleeFunctions.end();
-       I != E; ++I) {
-    const Function *Callee = *I;
-    unsigned M;
-    //
-    // If we have not visited this callee before, visit it now (this is the
-    // post-order component of the Bottom-Up algorithm).  Otherwise, look up
-    // the assigned ID value from the Tarjan Value Map.
-    //
-    TarjanMap::iterator It = ValMap.find(Callee);
-    if (It == ValMap.end())  // No, visit it now.
-      M = calculateGraphs(Callee, Stack, NextID, ValMap);
-    else                    // Yes, get it's number.
-      M = It->second;
-
-    //
-    // If we've found a function with a smaller ID than this funtion, record
-    // that ID as the minimum ID.
-    //
-    if (M < Min) Min = M;
+  if (Top.Min != MyID) {
+    State.Callees.resize(Top.CalleeBegin);
+    State.Frames.pop_back();
+    Result = Top.Min;
+    return true;
   }
 
-  assert(ValMap[F] == MyID && "SCC construction assumption wrong!");
+  //
+  // When graphs are calculated in parallel, only record the SCC now.  The
+  // scheduler calculates its graph once the graphs of its callees are done.
+  //
+  if (State.Scheduler) {
+    SCCScheduler & S = *(State.Scheduler);
+    const Function *NF;
+    do {
+      NF = State.Stack.back();
+      State.Stack.pop_back();
+      State.getID(NF) = ~0U;
+      S.Members.push_back(NF);
+    } while (NF != F);
+    S.MemberBegin.push_back(S.Members.size());
+    S.RootCallees.insert(S.RootCallees.end(),
+                         State.Callees.begin() + Top.CalleeBegin,
+                         State.Callees.end());
+    S.RootCalleeBegin.push_back(S.RootCallees.size());
+
+    State.Callees.resize(Top.CalleeBegin);
+    State.Frames.pop_back();
+    Result = MyID;
+    return true;
+  }
 
   //
-  // If the minimum ID found is not this function's ID, then this function is
-  // part of a larger SCC.
+  // The first time the root of an SCC is finished, see whether the graph of
+  // the SCC can be restored from the cache.
   //
-  if (Min != MyID)
-    return Min;
+  if (Incremental && !Incremental->Keys.count(F) && reuseGraph(F, State)) {
+    State.Callees.resize(Top.CalleeBegin);
+    State.Frames.pop_back();
+    State.getID(F) = ~0U;
+    Result = MyID;
+    return true;
+  }
 
   //
   // If this is a new SCC, process it now.
   //
-  if (Stack.back() == F) {           // Special case the single "SCC" case here.
+  DSGraph* G;
+  if (State.Stack.back() == F) {    // Special case the single "SCC" case here.
     DEBUG(errs() << "Visiting single node SCC #: " << MyID << " fn: "
 	  << F->getName() << "\n");
-    Stack.pop_back();
+    State.Stack.pop_back();
     DEBUG(errs() << "  [BU] Calculating graph for: " << F->getName()<< "\n");
-    DSGraph* G = getOrCreateGraph(F);
+    G = getOrCreateGraph(F);
     calculateGraph(G);
     DEBUG(errs() << "  [BU] Done inlining: " << F->getName() << " ["
 	  << G->getGraphSize() << "+" << G->getAuxFunctionCalls().size()
 	  << "]\n");
 
     if (MaxSCC < 1) MaxSCC = 1;
-
-    //
-    // Should we revisit the graph?  Only do it if there are now new resolvable
-    // callees.
-    FuncSet NewCallees;
-    getAllAuxCallees(G, NewCallees);
-    if (!NewCallees.empty()) {
-      if (hasNewCallees(NewCallees, CalleeFunctions)) {
-        DEBUG(errs() << "Recalculating " << F->getName() << " due to new knowledge\n");
-        ValMap.erase(F);
-        ++NumRecalculations;
-        return calculateGraphs(F, Stack, NextID, ValMap);
-      }
-      ++NumRecalculationsSkipped;
-    }
-    ValMap[F] = ~0U;
-    return MyID;
   } else {
     unsigned SCCSize = 1;
-    const Function *NF = Stack.back();
+    const Function *NF = State.Stack.back();
     if(NF != F)
-      ValMap[NF] = ~0U;
+      State.getID(NF) = ~0U;
     DSGraph* SCCGraph = getDSGraph(*NF);
 
     //
@@ -474,10 +939,10 @@ BUDataStructures::calculateGraphs (const Function *F,
     // the old graphs.
     //
     while (NF != F) {
-      Stack.pop_back();
-      NF = Stack.back();
+      State.Stack.pop_back();
+      NF = State.Stack.back();
       if(NF != F)
-        ValMap[NF] = ~0U;
+        State.getID(NF) = ~0U;
 
       DSGraph* NFG = getDSGraph(*NF);
 
@@ -487,12 +952,14 @@ BUDataStructures::calculateGraphs (const Function *F,
                E = NFG->retnodes_end(); I != E; ++I)
           setDSGraph(*I->first, SCCGraph);
         
+        if (Incremental)
+          Incremental->forget(NFG, SCCGraph);
         SCCGraph->spliceFrom(NFG);
         delete NFG;
         ++SCCSize;
       }
     }
-    Stack.pop_back();
+    State.Stack.pop_back();
 
     DEBUG(errs() << "Calculating graph for SCC #: " << MyID << " of size: "
 	  << SCCSize << "\n");
@@ -502,7 +969,10 @@ BUDataStructures::calculateGraphs (const Function *F,
       MaxSCC = SCCSize;
 
     // Clean up the graph before we start inlining a bunch again...
-    SCCGraph->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+    if (Incremental)
+      Incremental->removeDeadNodes(SCCGraph, GlobalsGraph);
+    else
+      SCCGraph->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
 
     // Now that we have one big happy family, resolve all of the call sites in
     // the graph...
@@ -510,19 +980,487 @@ BUDataStructures::calculateGraphs (const Function *F,
     DEBUG(errs() << "  [BU] Done inlining SCC  [" << SCCGraph->getGraphSize()
 	  << "+" << SCCGraph->getAuxFunctionCalls().size() << "]\n"
 	  << "DONE with SCC #: " << MyID << "\n");
-    FuncSet NewCallees;
-    getAllAuxCallees(SCCGraph, NewCallees);
-    if (!NewCallees.empty()) {
-      if (hasNewCallees(NewCallees, CalleeFunctions)) {
-        DEBUG(errs() << "Recalculating SCC Graph " << F->getName() << " due to new knowledge\n");
-        ValMap.erase(F);
-        ++NumRecalculations;
-        return calculateGraphs(F, Stack, NextID, ValMap);
+    G = SCCGraph;
+  }
+
+  //
+  // Should we revisit the graph?  Only do it if there are now new resolvable
+  // callees.
+  //
+  bool Revisit = false;
+  FuncSet NewCallees;
+  getAllAuxCallees(G, NewCallees);
+  if (!NewCallees.empty()) {
+    if (hasNewCallees(NewCallees,
+                      State.Callees.begin() + Top.CalleeBegin,
+                      State.Callees.end())) {
+      DEBUG(errs() << "Recalculating " << F->getName()
+            << " due to new knowledge\n");
+      Revisit = true;
+    } else {
+      ++NumRecalculationsSkipped;
+    }
+  }
+
+  State.Callees.resize(Top.CalleeBegin);
+  State.Frames.pop_back();
+
+  if (Revisit) {
+    State.getID(F) = 0;
+    ++NumRecalculations;
+    return !beginVisit(F, State, Result);
+  }
+
+  if (Incremental)
+    saveGraph(F, G);
+
+  State.getID(F) = ~0U;
+  Result = MyID;
+  return true;
+}
+
+//
+// Method: reuseGraph()
+//
+// Description:
+//  Look up the graph of the SCC rooted at the specified function in the
+//  cache.  The SCC is made of the functions on the Tarjan stack down to its
+//  root.  The key of the SCC is recorded for saveGraph() whether or not a
+//  graph is found.
+//
+// Return value:
+//  true  - The graph was restored; the SCC has been popped from the stack.
+//  false - The graph of the SCC must be calculated.
+//
+bool
+BUDataStructures::reuseGraph (const Function *F, TarjanState & State) {
+  IncrementalState & Inc = *Incremental;
+  IncrementalState::SCCKey & Key = Inc.Keys[F];
+  Key.Valid = false;
+
+  std::vector<std::pair<std::string, uint64_t> > Inputs;
+  unsigned Begin = State.Stack.size();
+  do {
+    const Function *MF = State.Stack[--Begin];
+    uint64_t FP = Inc.getFingerprint(getDSGraph(*MF));
+    if (!FP || !MF->hasName())
+      return false;
+    Inputs.push_back(std::make_pair(MF->getName().str(), FP));
+  } while (State.Stack[Begin] != F);
+  std::sort(Inputs.begin(), Inputs.end());
+
+  hash_code Hash = hash_combine(Inc.Context);
+  for (unsigned i = 0, e = Inputs.size(); i != e; ++i) {
+    Hash = hash_combine(Hash, Inputs[i].first, Inputs[i].second);
+    Key.Members.push_back(Inputs[i].first);
+  }
+  Key.Hash = Hash;
+  Key.Valid = true;
+
+  DSGraphCache::Entry *E = Inc.Cache.lookup(F->getName());
+  if (!E || E->Key != Key.Hash || E->Functions != Key.Members)
+    return false;
+
+  //
+  // Every callee that was inlined must have a finished graph equal to the
+  // one that was inlined.
+  //
+  Module & M = const_cast<Module &>(Inc.Values.getModule());
+  for (unsigned i = 0, e = E->Callees.size(); i != e; ++i) {
+    const Function *Callee = M.getFunction(E->Callees[i].first);
+    if (!Callee || !hasDSGraph(*Callee) ||
+        (!Callee->isDeclaration() && State.getID(Callee) != ~0U) ||
+        Inc.getFingerprint(getDSGraph(*Callee)) != E->Callees[i].second)
+      return false;
+  }
+
+  DSGraph *G = new DSGraph(GlobalECs, getDataLayout(), *TypeSS, GlobalsGraph);
+  G->setUseAuxCalls();
+  if (!E->restore(*G, Inc.Values)) {
+    delete G;
+    return false;
+  }
+
+  //
+  // Replace the graphs of the functions of the SCC.  Their call sites are
+  // added to the call graph first, as calculateGraph() would have done.
+  //
+  SmallPtrSet<DSGraph*, 8> Old;
+  for (unsigned i = Begin, e = State.Stack.size(); i != e; ++i) {
+    DSGraph *OG = getDSGraph(*State.Stack[i]);
+    if (Old.insert(OG))
+      OG->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+    setDSGraph(*State.Stack[i], G);
+    State.getID(State.Stack[i]) = ~0U;
+  }
+  for (SmallPtrSet<DSGraph*, 8>::iterator I = Old.begin(), IE = Old.end();
+       I != IE; ++I) {
+    Inc.forget(*I);
+    Inc.Inlined.erase(*I);
+    Inc.MovedCalls.erase(*I);
+    delete *I;
+  }
+  State.Stack.resize(Begin);
+
+  G->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+  G->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+  cloneIntoGlobals(G, DSGraph::DontCloneCallNodes |
+                      DSGraph::DontCloneAuxCallNodes |
+                      DSGraph::StripAllocaBit);
+  ++NumReusedGraphs;
+  return true;
+}
+
+//
+// Method: saveGraph()
+//
+// Description:
+//  Save the finished graph of the SCC rooted at the specified function in
+//  the cache.  Nothing is saved if the SCC has grown since its key was
+//  recorded, as the key does not cover the functions that joined it, or if
+//  calculating the graph changed the calls of the globals graph.
+//
+void
+BUDataStructures::saveGraph (const Function *F, DSGraph *G) {
+  IncrementalState & Inc = *Incremental;
+  std::map<const Function*, IncrementalState::SCCKey>::iterator It =
+    Inc.Keys.find(F);
+  if (It == Inc.Keys.end() || !It->second.Valid || Inc.MovedCalls.count(G))
+    return;
+
+  DSGraphCache::Entry E;
+  for (DSGraph::retnodes_iterator I = G->retnodes_begin(),
+         End = G->retnodes_end(); I != End; ++I)
+    E.Functions.push_back(I->first->getName());
+  std::sort(E.Functions.begin(), E.Functions.end());
+  if (E.Functions != It->second.Members)
+    return;
+
+  E.Key = It->second.Hash;
+  E.Callees = Inc.Inlined[G];
+  std::sort(E.Callees.begin(), E.Callees.end());
+  E.Callees.erase(std::unique(E.Callees.begin(), E.Callees.end()),
+                  E.Callees.end());
+  for (unsigned i = 0, e = E.Callees.size(); i != e; ++i)
+    if (!E.Callees[i].second)
+      return;
+  if (E.Image.capture(*G, Inc.Values))
+    Inc.Cache.insert(E);
+}
+
+//
+// Method: inlineInParallel()
+//
+// Description:
+//  Find the SCCs of the call graph reachable from main() and from every other
+//  function, then calculate their graphs using several threads.
+//
+//  The SCCs are found by the same walk as calculateGraphs(), so they are the
+//  SCCs that the serial walk would calculate.  If calculating a graph finds
+//  callees whose graphs are not finished, the graph is left unfinished, as
+//  are the graphs of its callers; these are left unvisited so that the
+//  serial walk calculates them afterwards.
+//
+// Inputs:
+//  M          - The module being analyzed.
+//  State      - The state of the Tarjan SCC-finding algorithm.
+//  NumThreads - The number of threads to use.
+//
+void
+BUDataStructures::inlineInParallel (Module & M,
+                                    TarjanState & State,
+                                    unsigned NumThreads) {
+  //
+  // Struct layouts are computed on first use and cached.  Compute them all
+  // now so that the threads only read them.
+  //
+  TypeFinder StructTypes;
+  StructTypes.run(M, false);
+  for (TypeFinder::iterator I = StructTypes.begin(), E = StructTypes.end();
+       I != E; ++I)
+    if (!(*I)->isOpaque() && (*I)->isSized())
+      getDataLayout().getStructLayout(*I);
+
+  //
+  // Find the SCCs, starting from main() as the serial walk does.  Remember
+  // the functions at which each walk starts.  As in the serial walk, other
+  // functions sharing the graph of a function unreachable from main() do not
+  // start walks of their own; they belong to the SCC of that function.
+  //
+  SCCScheduler S (State);
+  std::vector<const Function*> Roots;
+  std::vector<std::pair<const Function*, const Function*> > Mates;
+  State.Scheduler = &S;
+  Function *MainFunc = M.getFunction ("main");
+  if (MainFunc && !MainFunc->isDeclaration() && !State.isVisited(MainFunc)) {
+    calculateGraphs(MainFunc, State);
+    Roots.push_back(MainFunc);
+  }
+  for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
+    if (!I->isDeclaration() && !State.isVisited(I)) {
+      calculateGraphs(I, State);
+      Roots.push_back(I);
+
+      DSGraph *G = getDSGraph(*I);
+      for (DSGraph::retnodes_iterator RI = G->retnodes_begin(),
+             RE = G->retnodes_end(); RI != RE; ++RI)
+        if (!State.isVisited(RI->first)) {
+          State.getID(RI->first) = ~0U;
+          Mates.push_back(std::make_pair(RI->first, I));
+        }
+    }
+  State.Scheduler = 0;
+
+  unsigned NumSCCs = S.getNumSCCs();
+  S.SCCOf.resize(State.FunctionNumbers.size(), ~0U);
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC)
+    for (unsigned index = S.MemberBegin[SCC];
+         index < S.MemberBegin[SCC + 1];
+         ++index)
+      S.SCCOf[State.getNumber(S.Members[index])] = SCC;
+  for (unsigned index = 0; index < Mates.size(); ++index)
+    S.SCCOf[State.getNumber(Mates[index].first)] =
+      S.getSCC(Mates[index].second);
+
+  //
+  // Record the edges between SCCs.  An SCC is ready once every SCC that it
+  // calls is done.
+  //
+  S.Callers.resize(NumSCCs);
+  S.Calls.resize(NumSCCs);
+  S.Pending.resize(NumSCCs, 0);
+  S.Done.resize(NumSCCs, false);
+  std::vector<unsigned> LastCaller (NumSCCs, ~0U);
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC) {
+    for (unsigned index = S.MemberBegin[SCC];
+         index < S.MemberBegin[SCC + 1];
+         ++index) {
+      FuncSet Callees;
+      getAllAuxCallees(getDSGraph(*(S.Members[index])), Callees);
+      S.Calls[SCC].insert(S.Calls[SCC].end(), Callees.begin(), Callees.end());
+      for (FuncSet::iterator I = Callees.begin(), E = Callees.end();
+           I != E; ++I) {
+        unsigned CalleeSCC = S.getSCC(*I);
+        if ((CalleeSCC == ~0U) || (CalleeSCC == SCC) ||
+            (LastCaller[CalleeSCC] == SCC))
+          continue;
+        LastCaller[CalleeSCC] = SCC;
+        S.Callers[CalleeSCC].push_back(SCC);
+        ++S.Pending[SCC];
       }
+    }
+  }
+
+  //
+  // Collapse the graphs of each SCC into a single graph.  This updates the
+  // Function -> DSG map, so it is done before any thread starts.
+  //
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC) {
+    unsigned SCCSize = 1;
+    DSGraph* SCCGraph = getDSGraph(*(S.Members[S.MemberBegin[SCC]]));
+    for (unsigned index = S.MemberBegin[SCC] + 1;
+         index < S.MemberBegin[SCC + 1];
+         ++index) {
+      DSGraph* NFG = getDSGraph(*(S.Members[index]));
+      if (NFG != SCCGraph) {
+        for (DSGraph::retnodes_iterator I = NFG->retnodes_begin(),
+               E = NFG->retnodes_end(); I != E; ++I)
+          setDSGraph(*I->first, SCCGraph);
+
+        SCCGraph->spliceFrom(NFG);
+        delete NFG;
+        ++SCCSize;
+      }
+    }
+
+    if (MaxSCC < SCCSize)
+      MaxSCC = SCCSize;
+  }
+
+  //
+  // Several SCCs may share a graph when graphs have been merged before this
+  // pass (see EquivBUDataStructures).  Calculate such SCCs one after another
+  // in the order of the serial walk.
+  //
+  DenseMap<DSGraph*, unsigned> LastSCC;
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC) {
+    DSGraph* G = getDSGraph(*(S.Members[S.MemberBegin[SCC]]));
+    std::pair<DenseMap<DSGraph*, unsigned>::iterator, bool> Entry =
+      LastSCC.insert(std::make_pair(G, SCC));
+    if (!Entry.second) {
+      S.Callers[Entry.first->second].push_back(SCC);
+      ++S.Pending[SCC];
+      Entry.first->second = SCC;
+    }
+  }
+
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC)
+    if (S.Pending[SCC] == 0)
+      S.Ready.push_back(SCC);
+
+  DEBUG(errs() << debugname << ": Calculating " << NumSCCs << " SCCs using "
+        << NumThreads << " threads\n");
+
+  //
+  // Start the worker threads.  If a thread cannot be created, the work is
+  // done by the threads that could be, and by this thread.
+  //
+  Scheduler = &S;
+  std::vector<pthread_t> Handles (NumThreads);
+  std::vector<bool> Started (NumThreads, false);
+  for (unsigned index = 1; index < NumThreads; ++index)
+    Started[index] = (pthread_create (&Handles[index],
+                                      0,
+                                      runSCCThread,
+                                      this) == 0);
+  runSCCThread (this);
+  for (unsigned index = 1; index < NumThreads; ++index)
+    if (Started[index])
+      pthread_join (Handles[index], 0);
+  Scheduler = 0;
+
+  //
+  // Leave the functions of unfinished SCCs unvisited for the serial walk.
+  //
+  for (unsigned SCC = 0; SCC < NumSCCs; ++SCC)
+    if (!S.Done[SCC])
+      for (unsigned index = S.MemberBegin[SCC];
+           index < S.MemberBegin[SCC + 1];
+           ++index)
+        State.getID(S.Members[index]) = 0;
+  for (unsigned index = 0; index < Mates.size(); ++index)
+    if (!S.Done[S.getSCC(Mates[index].second)])
+      State.getID(Mates[index].first) = 0;
+
+  //
+  // Move the unresolved call sites of each finished walk into the globals
+  // graph, as the serial walk does after each walk.  The serial walk visits
+  // callees as they are found, so a function found to be called by an
+  // earlier walk would not have started a walk of its own.
+  //
+  std::vector<char> Reached (NumSCCs, false);
+  for (unsigned index = 0; index < Roots.size(); ++index) {
+    unsigned RootSCC = S.getSCC(Roots[index]);
+    if (Reached[RootSCC])
+      continue;
+
+    std::vector<unsigned> Worklist (1, RootSCC);
+    Reached[RootSCC] = true;
+    while (!Worklist.empty()) {
+      unsigned SCC = Worklist.back();
+      Worklist.pop_back();
+      for (unsigned callee = 0; callee < S.Calls[SCC].size(); ++callee) {
+        unsigned CalleeSCC = S.getSCC(S.Calls[SCC][callee]);
+        if ((CalleeSCC != ~0U) && !Reached[CalleeSCC]) {
+          Reached[CalleeSCC] = true;
+          Worklist.push_back(CalleeSCC);
+        }
+      }
+    }
+
+    if (S.Done[RootSCC])
+      CloneAuxIntoGlobal(getDSGraph(*(Roots[index])));
+  }
+}
+
+//
+// Method: runSCCThread()
+//
+// Description:
+//  Entry point for a thread calculating graphs in parallel.  Repeatedly take
+//  a ready SCC and calculate its graph until no SCC is ready and no other
+//  thread is calculating one that could make more ready.
+//
+// Inputs:
+//  Arg - The BUDataStructures pass.
+//
+// Return value:
+//  NULL is always returned.
+//
+void *
+BUDataStructures::runSCCThread (void * Arg) {
+  BUDataStructures * Pass = (BUDataStructures *) Arg;
+  SCCScheduler & S = *(Pass->Scheduler);
+
+  pthread_mutex_lock (&S.QueueLock);
+  while (true) {
+    while (S.Ready.empty() && S.Running)
+      pthread_cond_wait (&S.QueueChanged, &S.QueueLock);
+    if (S.Ready.empty())
+      break;
+
+    unsigned SCC = S.Ready.back();
+    S.Ready.pop_back();
+    ++S.Running;
+    pthread_mutex_unlock (&S.QueueLock);
+
+    bool Finished = Pass->calculateSCC (SCC);
+
+    pthread_mutex_lock (&S.QueueLock);
+    --S.Running;
+    if (Finished) {
+      S.Done[SCC] = true;
+      for (unsigned index = 0; index < S.Callers[SCC].size(); ++index)
+        if (--S.Pending[S.Callers[SCC][index]] == 0)
+          S.Ready.push_back(S.Callers[SCC][index]);
+    }
+    pthread_cond_broadcast (&S.QueueChanged);
+  }
+  pthread_mutex_unlock (&S.QueueLock);
+
+  return 0;
+}
+
+//
+// Method: calculateSCC()
+//
+// Description:
+//  Calculate the graph of a ready SCC.  As in the serial walk, the graph is
+//  recalculated for as long as doing so finds new callees.
+//
+// Inputs:
+//  SCC - The index of the SCC in the scheduler.
+//
+// Return value:
+//  true  - The graph is finished.
+//  false - The graph has call sites to callees whose graphs are not finished.
+//
+bool
+BUDataStructures::calculateSCC (unsigned SCC) {
+  SCCScheduler & S = *Scheduler;
+  unsigned Begin = S.MemberBegin[SCC];
+  unsigned End = S.MemberBegin[SCC + 1];
+  DSGraph* G = getDSGraph(*(S.Members[Begin]));
+
+  // Clean up the graph before we start inlining a bunch again...
+  if (End - Begin > 1) {
+    SchedulerLock Guard (SCCScheduler::getGlobalsLock(Scheduler));
+    G->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+  }
+
+  FuncSet Callees;
+  Callees.insert(S.RootCallees.begin() + S.RootCalleeBegin[SCC],
+                 S.RootCallees.begin() + S.RootCalleeBegin[SCC + 1]);
+  while (true) {
+    if (!calculateGraph(G))
+      return false;
+
+    FuncSet NewCallees;
+    getAllAuxCallees(G, NewCallees);
+    S.Calls[SCC].insert(S.Calls[SCC].end(),
+                        NewCallees.begin(), NewCallees.end());
+    if (NewCallees.empty())
+      return true;
+    if (!hasNewCallees(NewCallees, Callees.begin(), Callees.end())) {
       ++NumRecalculationsSkipped;
+      return true;
     }
-    ValMap[F] = ~0U;
-    return MyID;
+    if (!S.canInline(G, NewCallees, *this))
+      return false;
+
+    DEBUG(errs() << "Recalculating SCC #" << SCC << " due to new knowledge\n");
+    ++NumRecalculations;
+    Callees.swap(NewCallees);
   }
 }
 
@@ -622,9 +1560,22 @@ void BUDataStructures::CloneAuxIntoGlobal(DSGraph* G) {
 //  Inline all graphs in the callgraph and remove callsites that are completely
 //  dealt with
 //
-void BUDataStructures::calculateGraph(DSGraph* Graph) {
+// Return value:
+//  true  - Every call site with known callees was inlined.
+//  false - Graphs are being calculated in parallel, and some call sites were
+//          kept because the graphs of their callees are not finished.
+//
+bool BUDataStructures::calculateGraph(DSGraph* Graph) {
   DEBUG(Graph->AssertGraphOK(); Graph->getGlobalsGraph()->AssertGraphOK());
-  Graph->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+  if (Incremental)
+    Incremental->forget(Graph);
+  {
+    SchedulerLock Guard (SCCScheduler::getCallGraphLock(Scheduler));
+    Graph->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+  }
+
+  // Whether every call site with known callees was inlined
+  bool Complete = true;
 
   // Move our call site list into TempFCs so that inline call sites go into the
   // new call site list and doesn't invalidate our iterators!
@@ -664,6 +1615,14 @@ void BUDataStructures::calculateGraph(DSGraph* Graph) {
       AuxCallsList.splice(AuxCallsList.end(), TempFCs, S);
       continue;
     }
+
+    // If graphs are being calculated in parallel, only inline the graphs of
+    // callees that are finished.  Keep the call site until they all are.
+    if (Scheduler && !Scheduler->canInline(Graph, CalledFuncs, *this)) {
+      AuxCallsList.push_back(CS);
+      Complete = false;
+      continue;
+    }
     // If we get to this point, we know the callees, and can inline.
     // This means, that either it is a direct call site. Or if it is
     // an indirect call site, its calleeNode is complete, and we can
@@ -683,6 +1642,11 @@ void BUDataStructures::calculateGraph(DSGraph* Graph) {
       // Get the data structure graph for the called function.
 
       GI = getDSGraph(*Callee);  // Graph to inline
+      if (Incremental && GI != Graph)
+        Incremental->Inlined[Graph].push_back(
+          std::make_pair(Callee->getName().str(),
+                         Incremental->getFingerprint(GI)));
+      SchedulerLock Guard (SCCScheduler::getGraphLock(Scheduler, GI, Graph));
       DEBUG(GI->AssertGraphOK(); GI->getGlobalsGraph()->AssertGraphOK());
       DEBUG(errs() << "    Inlining graph for " << Callee->getName()
 	    << "[" << GI->getGraphSize() << "+"
@@ -717,15 +1681,25 @@ void BUDataStructures::calculateGraph(DSGraph* Graph) {
   // Update the callgraph with the new information that we have gleaned.
   // NOTE : This must be called before removeDeadNodes, so that no 
   // information is lost due to deletion of DSCallNodes.
-  Graph->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+  {
+    SchedulerLock Guard (SCCScheduler::getCallGraphLock(Scheduler));
+    Graph->buildCallGraph(callgraph, GlobalFunctionList, filterCallees);
+  }
 
   // Delete dead nodes.  Treat globals that are unreachable but that can
-  // reach live nodes as live.
-  Graph->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
-
-  cloneIntoGlobals(Graph, DSGraph::DontCloneCallNodes |
-                        DSGraph::DontCloneAuxCallNodes |
-                        DSGraph::StripAllocaBit);
+  // reach live nodes as live.  Both steps update the globals graph.
+  {
+    SchedulerLock Guard (SCCScheduler::getGlobalsLock(Scheduler));
+    if (Incremental)
+      Incremental->removeDeadNodes(Graph, GlobalsGraph);
+    else
+      Graph->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+
+    cloneIntoGlobals(Graph, DSGraph::DontCloneCallNodes |
+                          DSGraph::DontCloneAuxCallNodes |
+                          DSGraph::StripAllocaBit);
+  }
   //Graph->writeGraphToFile(cerr, "bu_" + F.getName());
+  return Complete;
 }
 
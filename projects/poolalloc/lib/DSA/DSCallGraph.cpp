@@ -48,6 +48,9 @@ bool DSCallGraph::hasPointers(llvm::CallSite& CS) {
   return _hasPointers(llvm::cast<llvm::FunctionType>(T));
 }
 
+// tarjan_rec - Visit F and the functions it calls.  The functions of an SCC
+// get the ID ~0U once the SCC is complete, so a function is on the stack
+// exactly when it has been visited and still has a smaller ID.
 unsigned DSCallGraph::tarjan_rec(const llvm::Function* F, TFStack& Stack,
                                  unsigned &NextID, TFMap& ValMap) {
   assert(!ValMap.count(F) && "Shouldn't revisit functions!");
@@ -63,7 +66,7 @@ unsigned DSCallGraph::tarjan_rec(const llvm::Function* F, TFStack& Stack,
     TFMap::iterator It = ValMap.find(*ii);
     if (It == ValMap.end()) // No, visit it now.
       M = tarjan_rec(*ii, Stack, NextID, ValMap);
-    else if (std::find(Stack.begin(), Stack.end(), *ii) != Stack.end())
+    else
       M = It->second;
     if (M < Min) Min = M;
   }
@@ -76,6 +79,7 @@ unsigned DSCallGraph::tarjan_rec(const llvm::Function* F, TFStack& Stack,
   if (F == Stack.back()) {
     // single node case
     Stack.pop_back();
+    ValMap[F] = ~0U;
     SCCs.insert(F);
   } else {
     // Take care that the leader is not an external function
@@ -85,6 +89,7 @@ unsigned DSCallGraph::tarjan_rec(const llvm::Function* F, TFStack& Stack,
     do {
       NF = Stack.back();
       Stack.pop_back();
+      ValMap[NF] = ~0U;
       microSCC.push_back(NF);
       if (!Leader && !NF->isDeclaration()) Leader = NF;
     } while (NF != F);
@@ -120,6 +125,100 @@ void DSCallGraph::buildSCCs() {
       tarjan_rec(*ii, Stack, NextID, ValMap);
 
   removeECFunctions();
+  freeze();
+}
+
+//
+// Method: freeze()
+//
+// Description:
+//  Number the call sites and functions of the graph and lay their callees,
+//  and the callers and calling call sites of each function, out in flat
+//  arrays, so that lookups take constant time until the graph is changed
+//  again.
+//
+void DSCallGraph::freeze() {
+  thaw();
+
+  CalleeStart.push_back(0);
+  for (ActualCalleesTy::const_iterator ii = ActualCallees.begin(),
+       ee = ActualCallees.end(); ii != ee; ++ii) {
+    CallSiteNumbers[ii->first.getInstruction()] = CalleeStart.size() - 1;
+    CalleeList.insert(CalleeList.end(), ii->second.begin(), ii->second.end());
+    CalleeStart.push_back(CalleeList.size());
+  }
+  NumCallees = CalleeList.size();
+
+  // Number the functions that call or are called first, then the other
+  // members of their SCCs.
+  std::vector<const llvm::Function*> Functions;
+  for (SimpleCalleesTy::const_iterator ii = SimpleCallees.begin(),
+       ee = SimpleCallees.end(); ii != ee; ++ii) {
+    FunctionNumbers[ii->first] = Functions.size();
+    Functions.push_back(ii->first);
+  }
+  for (llvm::EquivalenceClasses<const llvm::Function*>::iterator
+       ii = SCCs.begin(), ee = SCCs.end(); ii != ee; ++ii)
+    if (FunctionNumbers.insert(std::make_pair(ii->getData(),
+                                              Functions.size())).second)
+      Functions.push_back(ii->getData());
+
+  FlatStart.assign(Functions.size() + 1, 0);
+  CallerStart.assign(Functions.size() + 1, 0);
+  CallSiteStart.assign(Functions.size() + 1, 0);
+  Leaders.reserve(Functions.size());
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i) {
+    FlatStart[i] = FlatList.size();
+    SimpleCalleesTy::const_iterator ii = SimpleCallees.find(Functions[i]);
+    if (ii != SimpleCallees.end()) {
+      FlatList.insert(FlatList.end(), ii->second.begin(), ii->second.end());
+      for (FuncSet::const_iterator ci = ii->second.begin(),
+           ce = ii->second.end(); ci != ce; ++ci)
+        ++CallerStart[FunctionNumbers[*ci] + 1];
+    }
+    CallSiteStart[i] = CallSiteList.size();
+    ActualCallersTy::const_iterator ai = ActualCallers.find(Functions[i]);
+    if (ai != ActualCallers.end())
+      CallSiteList.insert(CallSiteList.end(), ai->second.begin(),
+                          ai->second.end());
+    Leaders.push_back(SCCs.getLeaderValue(Functions[i]));
+  }
+  FlatStart.back() = FlatList.size();
+  CallSiteStart.back() = CallSiteList.size();
+
+  // The callers of each function are filled in the order of the callers'
+  // numbers, which is the order of their addresses, as in a FuncSet.
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i)
+    CallerStart[i + 1] += CallerStart[i];
+  CallerList.resize(CallerStart.back());
+  std::vector<unsigned> Next(CallerStart.begin(), CallerStart.end() - 1);
+  for (unsigned i = 0, e = Functions.size(); i != e; ++i)
+    for (unsigned j = FlatStart[i], je = FlatStart[i + 1]; j != je; ++j)
+      CallerList[Next[FunctionNumbers[FlatList[j]]]++] = Functions[i];
+
+  Frozen = true;
+}
+
+//
+// Method: thaw()
+//
+// Description:
+//  Drop the frozen form of the graph before the graph is changed.
+//
+void DSCallGraph::thaw() {
+  Frozen = false;
+  CallSiteNumbers.clear();
+  CalleeStart.clear();
+  CalleeList.clear();
+  FunctionNumbers.clear();
+  FlatStart.clear();
+  FlatList.clear();
+  CallerStart.clear();
+  CallerList.clear();
+  CallSiteStart.clear();
+  CallSiteList.clear();
+  Leaders.clear();
+  NumCallees = 0;
 }
 
 static void removeECs(DSCallGraph::FuncSet& F,
@@ -158,6 +257,19 @@ void DSCallGraph::removeECFunctions() {
   for (ActualCalleesTy::iterator ii = ActualCallees.begin(),
        ee = ActualCallees.end(); ii != ee; ++ii)
     removeECs(ii->second, SCCs);
+  // and the callers of the functions that are no longer leaders
+  for (ActualCallersTy::iterator ii = ActualCallers.begin(),
+       ee = ActualCallers.end(); ii != ee;) {
+    const llvm::Function* Leader = SCCs.getLeaderValue(ii->first);
+    if (Leader == ii->first) {
+      ++ii;
+    } else {
+      ActualCallers[Leader].insert(ii->second.begin(), ii->second.end());
+      ActualCallersTy::iterator tmpii = ii;
+      ++ii;
+      ActualCallers.erase(tmpii);
+    }
+  }
 }
 
 void DSCallGraph::buildRoots() {
@@ -233,6 +345,8 @@ DSCallGraph::insert(llvm::CallSite CS, const llvm::Function* F) {
   // Find the function to which the call site belongs.
   //
   const llvm::Function * Parent = CS.getInstruction()->getParent()->getParent();
+  if (Frozen)
+    thaw();
 
   //
   // Determine the SCC leaders for both the calling function and the called
@@ -250,11 +364,14 @@ DSCallGraph::insert(llvm::CallSite CS, const llvm::Function* F) {
   SimpleCallees[ParentLeader];
   if (F) {
     ActualCallees[CS].insert(FLeader);
+    ActualCallers[FLeader].insert(CS);
     SimpleCallees[ParentLeader].insert(FLeader);
   }
 }
 
 void DSCallGraph::insureEntry(const llvm::Function* F) {
+  if (Frozen)
+    thaw();
   SimpleCallees[F];
 }
 
@@ -24,6 +24,7 @@
 #include "llvm/DerivedTypes.h"
 #include "llvm/DataLayout.h"
 #include "llvm/Assembly/Writer.h"
+#include "llvm/Support/Atomic.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/ADT/DepthFirstIterator.h"
@@ -110,7 +111,8 @@ std::string DSGraph::getFunctionNames() const {
 DSGraph::DSGraph(DSGraph* G, EquivalenceClasses<const GlobalValue*> &ECs,
                  SuperSet<Type*>& tss,
                  unsigned CloneFlags)
-  : GlobalsGraph(0), ScalarMap(ECs), TD(G->TD), TypeSS(tss) {
+  : GlobalsGraph(0), ScalarMap(ECs), NodeArena(new DSNodeArena()), TD(G->TD),
+    TypeSS(tss) {
   UseAuxCalls = false;
   cloneInto(G, CloneFlags);
 }
@@ -126,8 +128,10 @@ DSGraph::~DSGraph() {
   for (node_iterator NI = node_begin(), E = node_end(); NI != E; ++NI)
     NI->dropAllReferences();
 
-  // Free all of the nodes.
+  // Free all of the nodes.  Their memory goes back to the arena, which is
+  // freed as a whole once no node allocated from it is left.
   Nodes.clear();
+  NodeArena->release();
 }
 
 // dump - Allow inspection of graph in a debugger.
@@ -161,7 +165,7 @@ void DSGraph::removeFunctionCalls(Function& F) {
 /// and does not point to any other objects in the graph.
 DSNode *DSGraph::addObjectToGraph(Value *Ptr, bool UseDeclaredType) {
   assert(isa<PointerType>(Ptr->getType()) && "Ptr is not a pointer!");
-  DSNode *N = new DSNode(this);
+  DSNode *N = new (this) DSNode(this);
   assert(ScalarMap[Ptr].isNull() && "Object already in this graph!");
   ScalarMap[Ptr] = N;
 
@@ -199,7 +203,7 @@ void DSGraph::cloneInto( DSGraph* G, unsigned CloneFlags) {
   for (node_const_iterator I = G->node_begin(), E = G->node_end(); I != E; ++I) {
     assert(!I->isForwarding() &&
            "Forward nodes shouldn't be in node list!");
-    DSNode *New = new DSNode(*I, this);
+    DSNode *New = new (this) DSNode(*I, this);
     New->maskNodeTypes(~BitsToClear);
     OldNodeMap[I] = New;
   }
@@ -907,6 +911,40 @@ static void removeIdenticalCalls(DSGraph::FunctionListTy &Calls) {
   if (NumDeleted)
     DEBUG(errs() << "Merged " << NumDeleted << " call nodes.\n");
 }
+/// compactForwarding - Make every handle held by the graph point straight at
+/// its node.  Handles to merged-away nodes are resolved lazily by getNode(), so
+/// a node that was forwarded stays allocated until the last handle to it has
+/// been looked at; this visits them all at once.
+///
+void DSGraph::compactForwarding() {
+  for (node_iterator NI = node_begin(), E = node_end(); NI != E; ++NI)
+    for (DSNode::edge_iterator ii = NI->edge_begin(), ee = NI->edge_end();
+         ii != ee; ++ii)
+      ii->second.getNode();
+
+  for (DSScalarMap::iterator I = ScalarMap.begin(), E = ScalarMap.end();
+       I != E; ++I)
+    I->second.getNode();
+
+  for (ReturnNodesTy::iterator I = ReturnNodes.begin(), E = ReturnNodes.end();
+       I != E; ++I)
+    I->second.getNode();
+  for (VANodesTy::iterator I = VANodes.begin(), E = VANodes.end(); I != E; ++I)
+    I->second.getNode();
+
+  FunctionListTy *Calls[] = { &FunctionCalls, &AuxFunctionCalls };
+  for (unsigned i = 0; i != 2; ++i)
+    for (FunctionListTy::iterator I = Calls[i]->begin(), E = Calls[i]->end();
+         I != E; ++I) {
+      I->getRetVal().getNode();
+      I->getVAVal().getNode();
+      if (I->isIndirectCall())
+        I->getCalleeNode();
+      for (unsigned a = 0, e = I->getNumPtrArgs(); a != e; ++a)
+        I->getPtrArg(a).getNode();
+    }
+}
+
 // removeTriviallyDeadNodes - After the graph has been constructed, this method
 // removes all unreachable nodes that are created because they got merged with
 // other nodes in the graph.  These nodes will all be trivially unreachable, so
@@ -916,21 +954,12 @@ void DSGraph::removeTriviallyDeadNodes() {
   /// NOTE: This code is disabled.  This slows down DSA on 177.mesa
   /// substantially!
 
-  // Loop over all of the nodes in the graph, calling getNode on each field.
-  // This will cause all nodes to update their forwarding edges, causing
+  // Update every handle in the graph past forwarding nodes, causing
   // forwarded nodes to be delete-able.  Further, reclaim any memory used by
-  // useless edge or type entries
+  // useless edge or type entries.
+  compactForwarding();
   for (node_iterator NI = node_begin(), E = node_end(); NI != E; ++NI)
-    for (DSNode::edge_iterator ii = NI->edge_begin(), ee = NI->edge_end();
-         ii != ee; ++ii) {
-      ii->second.getNode()->cleanEdges();
-    }
-
-  // Likewise, forward any edges from the scalar nodes.  While we are at it,
-  // clean house a bit.
-  for (DSScalarMap::iterator I = ScalarMap.begin(), E = ScalarMap.end();
-       I != E; ++I)
-    I->second.getNode();
+    NI->cleanEdges();
 
   bool isGlobalsGraph = !GlobalsGraph;
 
@@ -988,57 +1017,247 @@ void DSGraph::removeTriviallyDeadNodes() {
   removeIdenticalCalls(AuxFunctionCalls);
 }
 
-// CanReachAliveNodes - Simple graph walker that recursively traverses the graph
-// looking for a node that is marked alive.  If an alive node is found, return
-// true, otherwise return false.  If an alive node is reachable, this node is
-// marked as alive...
-//
-static bool CanReachAliveNodes(DSNode *N, DenseSet<const DSNode*> &Alive,
-                               DenseSet<const DSNode*> &Visited,
-                               bool IgnoreGlobals) {
-  if (N == 0) return false;
-  assert(N->isForwarding() == 0 && "Cannot mark a forwarded node!");
-
-  // If this is a global node, it will end up in the globals graph anyway, so we
-  // don't need to worry about it.
-  if (IgnoreGlobals && N->isGlobalNode()) return false;
-
-  // If we know that this node is alive, return so!
-  if (Alive.count(N)) return true;
-
-  // Otherwise, we don't think the node is alive yet, check for infinite
-  // recursion.
-  if (Visited.count(N)) return false;  // Found a cycle
-  Visited.insert(N);   // No recursion, insert into Visited...
-
-  for (DSNode::edge_iterator I = N->edge_begin(),E = N->edge_end(); I != E; ++I)
-    if (CanReachAliveNodes(I->second.getNode(), Alive, Visited, IgnoreGlobals)) {
-      N->markReachableNodes(Alive);
-      return true;
-    }
-  return false;
+namespace llvm {
+
+/// LiveNodeWalk - Find the nodes of a graph that removeDeadNodes keeps, in
+/// time linear in the size of the graph.
+///
+/// Nodes reachable from the roots are alive.  A global node, or an aux call
+/// site, that reaches an alive node becomes alive too, and so does everything
+/// it reaches.  Instead of searching forward from every global and call until
+/// nothing changes, the walk follows edges backwards from the alive nodes, so
+/// every node and edge is looked at a bounded number of times.  The walk
+/// numbers the nodes of the graph through DSNode::Epoch and DSNode::Index,
+/// and keeps the rest of its state in vectors indexed by them.
+///
+/// Most graphs have no global roots and no direct aux calls.  The reversed
+/// edges are only built, and the backward walk only done, for those that do.
+///
+class LiveNodeWalk {
+  enum { Alive = 1, ReachesAlive = 2, IsGlobalRoot = 4 };
+
+  /// IgnoreGlobals - True if paths through global nodes do not count, as
+  /// when unreachable globals are being removed.
+  bool IgnoreGlobals;
+  unsigned Epoch;
+
+  /// WalkingBackward - True once the backward walk has started, after which
+  /// every node made alive is followed backwards as well.
+  bool WalkingBackward;
+
+  /// NumGlobalRoots, NumDeadCalls - The global roots, and the aux calls that
+  /// are not alive yet.  The backward walk is only needed if either is not
+  /// zero once the forward walk is done.
+  unsigned NumGlobalRoots, NumDeadCalls;
+
+  std::vector<DSNode*> Nodes;
+  std::vector<unsigned char> State;
+
+  /// Preds - The nodes with an edge to node I are Preds[PredBegin[I]] up to
+  /// Preds[PredBegin[I+1]], and the aux calls that use node I likewise.
+  std::vector<unsigned> PredBegin, Preds;
+  std::vector<unsigned> UseBegin, Uses;
+
+  std::vector<const DSCallSite*> Calls;
+  std::vector<bool> CallAlive;
+
+  std::vector<unsigned> Forward, Backward;
+
+  /// NextEpoch - The number of walks started so far.  Graphs are walked from
+  /// several threads by the top-down pass, so it is bumped atomically.
+  static volatile sys::cas_flag NextEpoch;
+
+  unsigned getIndex(const DSNode *N) const {
+    assert(N->Epoch == Epoch && "Node is not in the graph being walked!");
+    return N->Index;
+  }
+
+  void setAlive(unsigned I) {
+    if (State[I] & Alive) return;
+    State[I] |= Alive;
+    Forward.push_back(I);
+    if (WalkingBackward) setReachesAlive(I);
+  }
+
+  void setReachesAlive(unsigned I) {
+    if (State[I] & ReachesAlive) return;
+    if (IgnoreGlobals && Nodes[I]->isGlobalNode()) return;
+    State[I] |= ReachesAlive;
+    Backward.push_back(I);
+  }
+
+  void setCallAlive(unsigned Call) {
+    if (CallAlive[Call]) return;
+    CallAlive[Call] = true;
+    --NumDeadCalls;
+    markAlive(*Calls[Call]);
+  }
+
+  void walkForward();
+  void buildReverseEdges();
+  void addUse(const DSNode *N, unsigned Call, std::vector<unsigned> *Next);
+  void addUses(const DSCallSite &CS, unsigned Call,
+               std::vector<unsigned> *Next);
+
+public:
+  LiveNodeWalk(DSGraph &G, bool IgnoreGlobals);
+
+  /// markAlive - Make N, and the nodes it reaches, alive.
+  void markAlive(const DSNode *N) { if (N) setAlive(getIndex(N)); }
+  void markAlive(const DSCallSite &CS);
+
+  /// addGlobalRoot - Make the global node N alive if it reaches an alive
+  /// node.  This must be done before run is called.
+  void addGlobalRoot(const DSNode *N) {
+    unsigned char &S = State[getIndex(N)];
+    if (!(S & IsGlobalRoot)) ++NumGlobalRoots;
+    S |= IsGlobalRoot;
+  }
+
+  /// run - Propagate liveness until every node that should be alive is.
+  void run();
+
+  bool isAlive(const DSNode *N) const { return State[getIndex(N)] & Alive; }
+
+  /// isCallAlive - Return true if the aux call that was at position I in the
+  /// list of aux calls when the walk started is alive.
+  bool isCallAlive(unsigned I) const { return CallAlive[I]; }
+};
+
+volatile sys::cas_flag LiveNodeWalk::NextEpoch = 0;
+
+LiveNodeWalk::LiveNodeWalk(DSGraph &G, bool IgnoreGlobals)
+  : IgnoreGlobals(IgnoreGlobals),
+    Epoch((unsigned)sys::AtomicIncrement(&NextEpoch)),
+    WalkingBackward(false), NumGlobalRoots(0), NumDeadCalls(0) {
+  for (DSGraph::node_iterator NI = G.node_begin(), E = G.node_end();
+       NI != E; ++NI) {
+    assert(!NI->isForwarding() && "Forwarded node in nodes list?");
+    NI->Epoch = Epoch;
+    NI->Index = Nodes.size();
+    Nodes.push_back(&*NI);
+  }
+  State.resize(Nodes.size());
+
+  for (DSGraph::afc_iterator CI = G.afc_begin(), E = G.afc_end(); CI != E; ++CI)
+    Calls.push_back(&*CI);
+  CallAlive.resize(Calls.size());
+  NumDeadCalls = Calls.size();
+
+  // Indirect calls are alive no matter what they reach; they are resolved
+  // later, in the callers of this function.
+  for (unsigned i = 0, e = Calls.size(); i != e; ++i)
+    if (Calls[i]->isIndirectCall())
+      setCallAlive(i);
 }
 
-// CallSiteUsesAliveArgs - Return true if the specified call site can reach any
-// alive nodes.
-//
-static bool CallSiteUsesAliveArgs(const DSCallSite &CS,
-                                  DenseSet<const DSNode*> &Alive,
-                                  DenseSet<const DSNode*> &Visited,
-                                  bool IgnoreGlobals) {
-  if (CanReachAliveNodes(CS.getRetVal().getNode(), Alive, Visited,
-                         IgnoreGlobals))
-    return true;
-  if (CanReachAliveNodes(CS.getVAVal().getNode(), Alive, Visited, IgnoreGlobals))
-    return true;
-  if (CS.isIndirectCall() &&
-      CanReachAliveNodes(CS.getCalleeNode(), Alive, Visited, IgnoreGlobals))
-    return true;
+// buildReverseEdges - Fill in the incoming edges of each node and, if some
+// aux calls are not alive yet, the aux calls that use each node.
+void LiveNodeWalk::buildReverseEdges() {
+  // Count the incoming edges of each node, then fill them in.
+  PredBegin.resize(Nodes.size() + 1);
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    for (DSNode::edge_iterator I = Nodes[i]->edge_begin(),
+         E = Nodes[i]->edge_end(); I != E; ++I)
+      if (DSNode *N = I->second.getNode())
+        ++PredBegin[getIndex(N) + 1];
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    PredBegin[i + 1] += PredBegin[i];
+  Preds.resize(PredBegin.back());
+  std::vector<unsigned> Next(PredBegin.begin(), PredBegin.end() - 1);
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    for (DSNode::edge_iterator I = Nodes[i]->edge_begin(),
+         E = Nodes[i]->edge_end(); I != E; ++I)
+      if (DSNode *N = I->second.getNode())
+        Preds[Next[getIndex(N)]++] = i;
+
+  // Alive calls never need to be found again, so only dead ones are used.
+  if (NumDeadCalls == 0) return;
+  UseBegin.resize(Nodes.size() + 1);
+  for (unsigned i = 0, e = Calls.size(); i != e; ++i)
+    if (!CallAlive[i])
+      addUses(*Calls[i], i, 0);
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    UseBegin[i + 1] += UseBegin[i];
+  Uses.resize(UseBegin.back());
+  Next.assign(UseBegin.begin(), UseBegin.end() - 1);
+  for (unsigned i = 0, e = Calls.size(); i != e; ++i)
+    if (!CallAlive[i])
+      addUses(*Calls[i], i, &Next);
+}
+
+// addUse - Record that Call uses N in the slot that Next gives for N, or,
+// if Next is null, only count the use in UseBegin.
+void LiveNodeWalk::addUse(const DSNode *N, unsigned Call,
+                          std::vector<unsigned> *Next) {
+  if (N == 0) return;
+  unsigned I = getIndex(N);
+  if (Next)
+    Uses[(*Next)[I]++] = Call;
+  else
+    ++UseBegin[I + 1];
+}
+
+void LiveNodeWalk::addUses(const DSCallSite &CS, unsigned Call,
+                           std::vector<unsigned> *Next) {
+  addUse(CS.getRetVal().getNode(), Call, Next);
+  addUse(CS.getVAVal().getNode(), Call, Next);
+  if (CS.isIndirectCall())
+    addUse(CS.getCalleeNode(), Call, Next);
   for (unsigned i = 0, e = CS.getNumPtrArgs(); i != e; ++i)
-    if (CanReachAliveNodes(CS.getPtrArg(i).getNode(), Alive, Visited,
-                           IgnoreGlobals))
-      return true;
-  return false;
+    addUse(CS.getPtrArg(i).getNode(), Call, Next);
+}
+
+void LiveNodeWalk::markAlive(const DSCallSite &CS) {
+  markAlive(CS.getRetVal().getNode());
+  markAlive(CS.getVAVal().getNode());
+  if (CS.isIndirectCall()) markAlive(CS.getCalleeNode());
+  for (unsigned i = 0, e = CS.getNumPtrArgs(); i != e; ++i)
+    markAlive(CS.getPtrArg(i).getNode());
+}
+
+// walkForward - Make everything an alive node points to alive.
+void LiveNodeWalk::walkForward() {
+  while (!Forward.empty()) {
+    DSNode *N = Nodes[Forward.back()];
+    Forward.pop_back();
+    for (DSNode::edge_iterator I = N->edge_begin(), E = N->edge_end();
+         I != E; ++I)
+      markAlive(I->second.getNode());
+  }
+}
+
+void LiveNodeWalk::run() {
+  walkForward();
+
+  // Without global roots or dead aux calls, nothing else can become alive.
+  if (NumGlobalRoots == 0 && NumDeadCalls == 0)
+    return;
+
+  // Every alive node reaches an alive node; start the backward walk from
+  // them, and follow the nodes made alive from now on as well.
+  buildReverseEdges();
+  WalkingBackward = true;
+  for (unsigned i = 0, e = Nodes.size(); i != e; ++i)
+    if (State[i] & Alive)
+      setReachesAlive(i);
+
+  while (!Backward.empty()) {
+    // A node that reaches an alive node makes its predecessors reach one
+    // too, and brings to life the global roots and aux calls among them.
+    unsigned I = Backward.back();
+    Backward.pop_back();
+    if (State[I] & IsGlobalRoot)
+      setAlive(I);
+    if (!UseBegin.empty())
+      for (unsigned i = UseBegin[I], e = UseBegin[I + 1]; i != e; ++i)
+        setCallAlive(Uses[i]);
+    for (unsigned i = PredBegin[I], e = PredBegin[I + 1]; i != e; ++i)
+      setReachesAlive(Preds[i]);
+    walkForward();
+  }
+}
+
 }
 
 // removeDeadNodes - Use a more powerful reachability analysis to eliminate
@@ -1058,8 +1277,8 @@ void DSGraph::removeDeadNodes(unsigned Flags) {
 
   // FIXME: Merge non-trivially identical call nodes...
 
-  // Alive - a set that holds all nodes found to be reachable/alive.
-  DenseSet<const DSNode*> Alive;
+  // Walk - finds all nodes that are reachable/alive.
+  LiveNodeWalk Walk(*this, Flags & DSGraph::RemoveUnreachableGlobals);
   std::vector<std::pair<const Value*, DSNode*> > GlobalNodes;
 
   // Copy and merge all information about globals to the GlobalsGraph if this is
@@ -1088,84 +1307,58 @@ void DSGraph::removeDeadNodes(unsigned Flags) {
       if (!(Flags & DSGraph::RemoveUnreachableGlobals) && GlobalsGraph) {
           GGCloner.getClonedNH(I->second);
       }
+
+      // If any global node points to a non-global that is "alive", the global
+      // is "alive" as well.
+      if (!(Flags & DSGraph::RemoveUnreachableGlobals))
+        Walk.addGlobalRoot(I->second.getNode());
     } else {
-      I->second.getNode()->markReachableNodes(Alive);
+      Walk.markAlive(I->second.getNode());
     }
 
   // The return values are alive as well.
   for (ReturnNodesTy::iterator I = ReturnNodes.begin(), E = ReturnNodes.end();
        I != E; ++I)
-    I->second.getNode()->markReachableNodes(Alive);
+    Walk.markAlive(I->second.getNode());
 
   // Mark any nodes reachable by primary calls as alive...
   for (fc_iterator I = fc_begin(), E = fc_end(); I != E; ++I)
-    I->markReachableNodes(Alive);
-
-
-  // Now find globals and aux call nodes that are already live or reach a live
-  // value (which makes them live in turn), and continue till no more are found.
-  //
-  bool Iterate;
-  DenseSet<const DSNode*> Visited;
-  std::set<const DSCallSite*> AuxFCallsAlive;
-  do {
-    Visited.clear();
-    // If any global node points to a non-global that is "alive", the global is
-    // "alive" as well...  Remove it from the GlobalNodes list so we only have
-    // unreachable globals in the list.
-    //
-    Iterate = false;
-    if (!(Flags & DSGraph::RemoveUnreachableGlobals))
-      for (unsigned i = 0; i != GlobalNodes.size(); ++i)
-        if (CanReachAliveNodes(GlobalNodes[i].second, Alive, Visited,
-                               Flags & DSGraph::RemoveUnreachableGlobals)) {
-          std::swap(GlobalNodes[i--], GlobalNodes.back()); // Move to end to...
-          GlobalNodes.pop_back();                          // erase efficiently
-          Iterate = true;
-        }
+    Walk.markAlive(*I);
+
+  // Now find globals and aux call nodes that reach a live value (which makes
+  // them live in turn).  Only unresolvable call nodes are kept for moving to
+  // the GlobalsGraph since call nodes that get resolved will be difficult to
+  // remove from that graph.  The final unresolved call nodes must be handled
+  // specially at the end of the BU pass (i.e., in main or other roots of the
+  // call graph).
+  Walk.run();
+
+  // If only some of the aux calls are alive, move dead aux function calls to
+  // the end of the list.  Liveness belongs to the place a call had in the list
+  // when the walk started.
+  FunctionListTy::iterator Erase = AuxFunctionCalls.end();
+  unsigned CallNo = 0;
+  for (FunctionListTy::iterator CI = AuxFunctionCalls.begin(); CI != Erase; )
+    if (Walk.isCallAlive(CallNo)) {
+      ++CI;
+      ++CallNo;
+    } else {
+      // Copy and merge global nodes and dead aux call nodes into the
+      // GlobalsGraph, and all nodes reachable from those nodes.  Update their
+      // target pointers using the GGCloner.
+      //
+      if (!(Flags & DSGraph::RemoveUnreachableGlobals))
+        GlobalsGraph->AuxFunctionCalls.push_back(DSCallSite(*CI, GGCloner));
 
-    // Mark only unresolvable call nodes for moving to the GlobalsGraph since
-    // call nodes that get resolved will be difficult to remove from that graph.
-    // The final unresolved call nodes must be handled specially at the end of
-    // the BU pass (i.e., in main or other roots of the call graph).
-    for (afc_iterator CI = afc_begin(), E = afc_end(); CI != E; ++CI)
-      if (!AuxFCallsAlive.count(&*CI) &&
-          (CI->isIndirectCall()
-           || CallSiteUsesAliveArgs(*CI, Alive, Visited,
-                                  Flags & DSGraph::RemoveUnreachableGlobals))) {
-        CI->markReachableNodes(Alive);
-        AuxFCallsAlive.insert(&*CI);
-        Iterate = true;
-      }
-  } while (Iterate);
-
-  // If only some of the aux calls are alive
-  if (AuxFCallsAlive.size() != AuxFunctionCalls.size()) {
-    // Move dead aux function calls to the end of the list
-    FunctionListTy::iterator Erase = AuxFunctionCalls.end();
-    for (FunctionListTy::iterator CI = AuxFunctionCalls.begin(); CI != Erase; )
-      if (AuxFCallsAlive.count(&*CI))
-        ++CI;
-      else {
-        // Copy and merge global nodes and dead aux call nodes into the
-        // GlobalsGraph, and all nodes reachable from those nodes.  Update their
-        // target pointers using the GGCloner.
-        //
-        if (!(Flags & DSGraph::RemoveUnreachableGlobals))
-          GlobalsGraph->AuxFunctionCalls.push_back(DSCallSite(*CI, GGCloner));
-
-        std::swap(*CI, *--Erase);
-      }
-    AuxFunctionCalls.erase(Erase, AuxFunctionCalls.end());
-  }
-  AuxFCallsAlive.clear();
+      std::swap(*CI, *--Erase);
+    }
+  AuxFunctionCalls.erase(Erase, AuxFunctionCalls.end());
 
   // We are finally done with the GGCloner so we can destroy it.
   GGCloner.destroy();
 
-  // At this point, any nodes which are visited, but not alive, are nodes
-  // which can be removed.  Loop over all nodes, eliminating completely
-  // unreachable nodes.
+  // At this point, any nodes which are not alive can be removed.  Loop over
+  // all nodes, eliminating completely unreachable nodes.
   //
   std::vector<DSNode*> DeadNodes;
   DeadNodes.reserve(Nodes.size());
@@ -1173,7 +1366,7 @@ void DSGraph::removeDeadNodes(unsigned Flags) {
     DSNode *N = NI++;
     assert(!N->isForwarding() && "Forwarded node in nodes list?");
 
-    if (!Alive.count(N)) {
+    if (!Walk.isAlive(N)) {
       Nodes.remove(N);
       assert(!N->isForwarding() && "Cannot remove a forwarding node!");
       DeadNodes.push_back(N);
@@ -1182,14 +1375,11 @@ void DSGraph::removeDeadNodes(unsigned Flags) {
     }
   }
 
-  // Remove all unreachable globals from the ScalarMap.
-  // If flag RemoveUnreachableGlobals is set, GlobalNodes has only dead nodes.
-  // In either case, the dead nodes will not be in the set Alive.
+  // Remove all unreachable globals from the ScalarMap.  The dead nodes are
+  // still numbered by the walk, so it can tell which ones they are.
   for (unsigned i = 0, e = GlobalNodes.size(); i != e; ++i)
-    if (!Alive.count(GlobalNodes[i].second))
+    if (!Walk.isAlive(GlobalNodes[i].second))
       ScalarMap.erase(GlobalNodes[i].first);
-    else
-      assert((Flags & DSGraph::RemoveUnreachableGlobals) && "non-dead global");
 
   // Delete all dead nodes now since their referrer counts are zero.
   for (unsigned i = 0, e = DeadNodes.size(); i != e; ++i)
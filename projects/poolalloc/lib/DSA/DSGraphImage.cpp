@@ -0,0 +1,1226 @@
+//===- DSGraphImage.cpp - Saved copies of DSGraphs ------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements DSGraphImage, the fingerprints of functions and graphs,
+// and the cache of graphs kept by the incremental mode of the DSA passes.
+//
+//===----------------------------------------------------------------------===//
+
+#include "dsa/DSGraphImage.h"
+#include "dsa/DSGraph.h"
+#include "dsa/DSNode.h"
+#include "dsa/DSSupport.h"
+#include "llvm/Constants.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/InlineAsm.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InstIterator.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// DSValueTable Implementation
+//===----------------------------------------------------------------------===//
+
+DSValueTable::~DSValueTable() {
+  for (DenseMap<const Function*, FunctionTable*>::iterator
+         I = Functions.begin(), E = Functions.end(); I != E; ++I)
+    delete I->second;
+}
+
+/// getTable - Number the values of F and compute its fingerprint, the first
+/// time they are asked for.
+DSValueTable::FunctionTable &DSValueTable::getTable(const Function &F) {
+  FunctionTable *&Slot = Functions[&F];
+  if (Slot) return *Slot;
+  FunctionTable *T = Slot = new FunctionTable();
+
+  DenseMap<const BasicBlock*, unsigned> Blocks;
+  for (Function::const_arg_iterator I = F.arg_begin(), E = F.arg_end();
+       I != E; ++I) {
+    T->Positions[I] = T->Values.size();
+    T->Values.push_back(I);
+  }
+  for (Function::const_iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB) {
+    unsigned Number = Blocks.size();
+    Blocks[BB] = Number;
+    for (BasicBlock::const_iterator I = BB->begin(), E = BB->end();
+         I != E; ++I) {
+      T->Positions[I] = T->Values.size();
+      T->Values.push_back(I);
+    }
+  }
+
+  hash_code H = hash_combine(getFingerprint(F.getType()), F.getLinkage(),
+                             F.getCallingConv(), F.isDeclaration());
+  for (Function::const_iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB) {
+    H = hash_combine(H, BB->size());
+    for (BasicBlock::const_iterator I = BB->begin(), E = BB->end();
+         I != E; ++I) {
+      H = hash_combine(H, I->getOpcode(), getFingerprint(I->getType()),
+                       I->getRawSubclassOptionalData(), I->getNumOperands());
+
+      // Parts of an instruction that are not operands
+      if (const CmpInst *CI = dyn_cast<CmpInst>(I))
+        H = hash_combine(H, CI->getPredicate());
+      else if (const AllocaInst *AI = dyn_cast<AllocaInst>(I))
+        H = hash_combine(H, AI->getAlignment());
+      else if (const LoadInst *LI = dyn_cast<LoadInst>(I))
+        H = hash_combine(H, LI->isVolatile(), LI->getAlignment(),
+                         LI->getOrdering());
+      else if (const StoreInst *SI = dyn_cast<StoreInst>(I))
+        H = hash_combine(H, SI->isVolatile(), SI->getAlignment(),
+                         SI->getOrdering());
+      else if (const CallInst *CI = dyn_cast<CallInst>(I))
+        H = hash_combine(H, CI->getCallingConv(), CI->isTailCall());
+      else if (const InvokeInst *II = dyn_cast<InvokeInst>(I))
+        H = hash_combine(H, II->getCallingConv());
+      else if (const ExtractValueInst *EV = dyn_cast<ExtractValueInst>(I))
+        H = hash_combine(H, hash_combine_range(EV->idx_begin(), EV->idx_end()));
+      else if (const InsertValueInst *IV = dyn_cast<InsertValueInst>(I))
+        H = hash_combine(H, hash_combine_range(IV->idx_begin(), IV->idx_end()));
+      else if (const AtomicRMWInst *RMW = dyn_cast<AtomicRMWInst>(I))
+        H = hash_combine(H, RMW->getOperation());
+      else if (const PHINode *PN = dyn_cast<PHINode>(I))
+        for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e; ++i)
+          H = hash_combine(H, Blocks[PN->getIncomingBlock(i)]);
+
+      for (User::const_op_iterator OI = I->op_begin(), OE = I->op_end();
+           OI != OE; ++OI)
+        H = hash_combine(H, hashOperand(*T, *OI, Blocks));
+    }
+  }
+  T->Fingerprint = H;
+  return *T;
+}
+
+/// addConstant - Number the constant C and the constants it is made of, if
+/// they have no number yet.
+void DSValueTable::addConstant(FunctionTable &T, const Constant *C) {
+  if (isa<GlobalValue>(C) || T.Positions.count(C)) return;
+  T.Positions[C] = T.Values.size();
+  T.Values.push_back(C);
+  for (User::const_op_iterator I = C->op_begin(), E = C->op_end(); I != E; ++I)
+    if (const Constant *Op = dyn_cast<Constant>(*I))
+      addConstant(T, Op);
+}
+
+/// hashOperand - Return a hash of the operand V of an instruction in the
+/// function with table T.  Constants are hashed by their contents.
+uint64_t DSValueTable::hashOperand(FunctionTable &T, const Value *V,
+                          const DenseMap<const BasicBlock*, unsigned> &Blocks) {
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
+    return hash_combine(1, getFingerprint(*GV));
+  if (const BasicBlock *BB = dyn_cast<BasicBlock>(V))
+    return hash_combine(2, Blocks.lookup(BB));
+  if (const Constant *C = dyn_cast<Constant>(V)) {
+    addConstant(T, C);
+    hash_code H = hash_combine(3, C->getValueID(),
+                               getFingerprint(C->getType()));
+    if (const ConstantInt *CI = dyn_cast<ConstantInt>(C))
+      return hash_combine(H, CI->getValue());
+    if (const ConstantFP *CF = dyn_cast<ConstantFP>(C))
+      return hash_combine(H, CF->getValueAPF());
+    if (const ConstantDataSequential *CD = dyn_cast<ConstantDataSequential>(C))
+      return hash_combine(H, CD->getRawDataValues());
+    if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(C)) {
+      H = hash_combine(H, CE->getOpcode(), CE->getRawSubclassOptionalData());
+      if (CE->isCompare())
+        H = hash_combine(H, CE->getPredicate());
+      if (CE->hasIndices())
+        H = hash_combine(H, hash_combine_range(CE->getIndices().begin(),
+                                               CE->getIndices().end()));
+    }
+    for (User::const_op_iterator I = C->op_begin(), E = C->op_end();
+         I != E; ++I)
+      H = hash_combine(H, hashOperand(T, *I, Blocks));
+    return H;
+  }
+  if (const InlineAsm *IA = dyn_cast<InlineAsm>(V))
+    return hash_combine(4, IA->getAsmString(), IA->getConstraintString(),
+                        IA->hasSideEffects());
+  DenseMap<const Value*, unsigned>::const_iterator I = T.Positions.find(V);
+  if (I != T.Positions.end())
+    return hash_combine(5, I->second);
+  return hash_combine(6, V->getValueID());
+}
+
+uint64_t DSValueTable::getFingerprint(const Function &F) {
+  return getTable(F).Fingerprint;
+}
+
+uint64_t DSValueTable::getFingerprint(const GlobalValue &GV) {
+  DenseMap<const GlobalValue*, uint64_t>::iterator I =
+    GlobalFingerprints.find(&GV);
+  if (I != GlobalFingerprints.end()) return I->second;
+
+  hash_code H = hash_combine(GV.getName(), getFingerprint(GV.getType()),
+                             GV.getLinkage(), GV.isDeclaration(),
+                             GV.hasSection() ? GV.getSection() : "");
+  if (const GlobalVariable *GVar = dyn_cast<GlobalVariable>(&GV))
+    H = hash_combine(H, GVar->isConstant(), GVar->isThreadLocal());
+  return GlobalFingerprints[&GV] = H;
+}
+
+uint64_t DSValueTable::getFingerprint(Type *Ty) {
+  DenseMap<Type*, uint64_t>::iterator I = TypeFingerprints.find(Ty);
+  if (I != TypeFingerprints.end()) return I->second;
+
+  hash_code H = hash_combine(Ty->getTypeID());
+  if (StructType *ST = dyn_cast<StructType>(Ty)) {
+    // A named struct may contain a pointer to itself.  Give it a fingerprint
+    // from its name while its elements are hashed.
+    if (ST->hasName())
+      TypeFingerprints[Ty] = H = hash_combine(H, ST->getName());
+    H = hash_combine(H, ST->isPacked(), ST->isOpaque());
+  } else if (IntegerType *IT = dyn_cast<IntegerType>(Ty)) {
+    H = hash_combine(H, IT->getBitWidth());
+  } else if (PointerType *PT = dyn_cast<PointerType>(Ty)) {
+    H = hash_combine(H, PT->getAddressSpace());
+  } else if (SequentialType *ST = dyn_cast<SequentialType>(Ty)) {
+    if (ArrayType *AT = dyn_cast<ArrayType>(ST))
+      H = hash_combine(H, AT->getNumElements());
+    else if (VectorType *VT = dyn_cast<VectorType>(ST))
+      H = hash_combine(H, VT->getNumElements());
+  } else if (FunctionType *FT = dyn_cast<FunctionType>(Ty)) {
+    H = hash_combine(H, FT->isVarArg());
+  }
+  for (Type::subtype_iterator S = Ty->subtype_begin(), E = Ty->subtype_end();
+       S != E; ++S)
+    H = hash_combine(H, getFingerprint(*S));
+  return TypeFingerprints[Ty] = H;
+}
+
+/// addType - Make Ty and the types it is made of known to getType.
+void DSValueTable::addType(Type *Ty) {
+  if (!TypesByFingerprint.insert(std::make_pair(getFingerprint(Ty), Ty)).second)
+    return;
+  for (Type::subtype_iterator S = Ty->subtype_begin(), E = Ty->subtype_end();
+       S != E; ++S)
+    addType(*S);
+}
+
+/// addTypesOf - Make the type of V known to getType, and if V is a constant,
+/// the types of the constants it is made of.
+void DSValueTable::addTypesOf(const Value *V,
+                              SmallPtrSet<const Constant*, 32> &Seen) {
+  addType(V->getType());
+  const Constant *C = dyn_cast<Constant>(V);
+  if (!C || isa<GlobalValue>(C) || !Seen.insert(C)) return;
+  for (User::const_op_iterator I = C->op_begin(), E = C->op_end(); I != E; ++I)
+    addTypesOf(*I, Seen);
+}
+
+Type *DSValueTable::getType(uint64_t Fingerprint) {
+  // The types a graph can refer to are those of the values in the module and
+  // the types they are made of.  They are found the first time one is asked
+  // for.
+  if (TypesByFingerprint.empty()) {
+    SmallPtrSet<const Constant*, 32> Seen;
+    for (Module::const_global_iterator I = M.global_begin(),
+           E = M.global_end(); I != E; ++I) {
+      addType(I->getType());
+      if (I->hasInitializer())
+        addTypesOf(I->getInitializer(), Seen);
+    }
+    for (Module::const_alias_iterator I = M.alias_begin(), E = M.alias_end();
+         I != E; ++I)
+      addTypesOf(I, Seen);
+    for (Module::const_iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+      addType(F->getType());
+      for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E;
+           ++I) {
+        addType(I->getType());
+        for (User::const_op_iterator OI = I->op_begin(), OE = I->op_end();
+             OI != OE; ++OI)
+          addTypesOf(*OI, Seen);
+      }
+    }
+  }
+  DenseMap<uint64_t, Type*>::iterator I = TypesByFingerprint.find(Fingerprint);
+  return I == TypesByFingerprint.end() ? 0 : I->second;
+}
+
+bool DSValueTable::getPosition(const Function &F, const Value *V,
+                               unsigned &Position) {
+  FunctionTable &T = getTable(F);
+  DenseMap<const Value*, unsigned>::iterator I = T.Positions.find(V);
+  if (I == T.Positions.end()) return false;
+  Position = I->second;
+  return true;
+}
+
+const Value *DSValueTable::getValue(const Function &F, unsigned Position) {
+  FunctionTable &T = getTable(F);
+  return Position < T.Values.size() ? T.Values[Position] : 0;
+}
+
+//===----------------------------------------------------------------------===//
+// DSGraphImage Implementation
+//===----------------------------------------------------------------------===//
+
+namespace {
+  /// ValueKey - A value as an image names it: the name of a global value, and
+  /// a position in that function or ~0U.
+  struct ValueKey {
+    StringRef Name;
+    unsigned Position;
+
+    bool operator<(const ValueKey &RHS) const {
+      int C = Name.compare(RHS.Name);
+      return C < 0 || (C == 0 && Position < RHS.Position);
+    }
+    bool operator==(const ValueKey &RHS) const {
+      return Name == RHS.Name && Position == RHS.Position;
+    }
+  };
+
+  template<typename T>
+  bool firstLess(const std::pair<ValueKey, T> &L,
+                 const std::pair<ValueKey, T> &R) {
+    return L.first < R.first;
+  }
+
+  /// ImageWriter - The state of DSGraphImage::capture.
+  class ImageWriter {
+    DSGraph &G;
+    DSValueTable &VT;
+    std::vector<std::string> &Names;
+    std::vector<std::pair<unsigned, unsigned> > &Values;
+    std::vector<uint64_t> &Types;
+    std::vector<uint32_t> &Words;
+
+    StringMap<unsigned> NameIDs;
+    DenseMap<std::pair<unsigned, unsigned>, unsigned> ValueIDs;
+    DenseMap<Type*, unsigned> TypeIDs;
+    DenseMap<const DSNode*, unsigned> NodeIDs;
+
+  public:
+    std::vector<DSNode*> Nodes;
+
+    ImageWriter(DSGraph &G, DSValueTable &VT, std::vector<std::string> &N,
+                std::vector<std::pair<unsigned, unsigned> > &V,
+                std::vector<uint64_t> &T, std::vector<uint32_t> &W)
+      : G(G), VT(VT), Names(N), Values(V), Types(T), Words(W) {}
+
+    /// getKey - Find how the image names V.  A global value is named by the
+    /// representative of its equivalence class unless Exact is set.
+    bool getKey(const Value *V, ValueKey &Key, bool Exact = false) {
+      const Function *F = 0;
+      if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+        if (!Exact)
+          GV = DSGraphImage::getRepresentative(G.getGlobalECs(), GV);
+        if (!GV->hasName()) return false;
+        Key.Name = GV->getName();
+        Key.Position = ~0U;
+        return true;
+      } else if (const Argument *A = dyn_cast<Argument>(V)) {
+        F = A->getParent();
+      } else if (const Instruction *I = dyn_cast<Instruction>(V)) {
+        F = I->getParent()->getParent();
+      } else {
+        // A constant is named by the function of the graph with the smallest
+        // name that uses it.
+        bool Found = false;
+        unsigned Position;
+        for (DSGraph::retnodes_iterator I = G.retnodes_begin(),
+               E = G.retnodes_end(); I != E; ++I)
+          if (I->first->hasName() &&
+              (!Found || I->first->getName() < Key.Name) &&
+              VT.getPosition(*I->first, V, Position)) {
+            Key.Name = I->first->getName();
+            Key.Position = Position;
+            Found = true;
+          }
+        return Found;
+      }
+      if (!F->hasName()) return false;
+      Key.Name = F->getName();
+      return VT.getPosition(*F, V, Key.Position);
+    }
+
+    /// number - Return the number of the node of NH, numbering it if needed.
+    unsigned number(const DSNodeHandle &NH) {
+      DSNode *N = NH.getNode();
+      if (!N) return 0;
+      unsigned &ID = NodeIDs[N];
+      if (!ID) {
+        Nodes.push_back(N);
+        ID = Nodes.size();
+      }
+      return ID;
+    }
+
+    void writeHandle(const DSNodeHandle &NH) {
+      unsigned ID = number(NH);
+      Words.push_back(ID);
+      Words.push_back(ID ? NH.getOffset() : 0);
+    }
+
+    void writeValue(const ValueKey &Key) {
+      StringMapEntry<unsigned> &Name = NameIDs.GetOrCreateValue(Key.Name, 0);
+      if (!Name.getValue()) {
+        Names.push_back(Key.Name);
+        Name.setValue(Names.size());
+      }
+      std::pair<unsigned, unsigned> Ref(Name.getValue() - 1, Key.Position);
+      unsigned &ID = ValueIDs[Ref];
+      if (!ID) {
+        Values.push_back(Ref);
+        ID = Values.size();
+      }
+      Words.push_back(ID - 1);
+    }
+
+    void writeType(Type *Ty) {
+      unsigned &ID = TypeIDs[Ty];
+      if (!ID) {
+        Types.push_back(VT.getFingerprint(Ty));
+        ID = Types.size();
+      }
+      Words.push_back(ID - 1);
+    }
+
+    bool writeNode(const DSNode *N);
+    bool writeCall(const DSCallSite &CS);
+  };
+
+  struct TypeFingerprintLess {
+    DSValueTable &VT;
+    explicit TypeFingerprintLess(DSValueTable &VT) : VT(VT) {}
+    bool operator()(Type *L, Type *R) const {
+      return VT.getFingerprint(L) < VT.getFingerprint(R);
+    }
+  };
+}
+
+bool ImageWriter::writeNode(const DSNode *N) {
+  Words.push_back(N->getSize());
+  Words.push_back(N->getNodeFlags());
+
+  Words.push_back(std::distance(N->type_begin(), N->type_end()));
+  for (DSNode::const_type_iterator I = N->type_begin(), E = N->type_end();
+       I != E; ++I) {
+    Words.push_back(I->first);
+    if (!I->second) {
+      Words.push_back(0);
+      continue;
+    }
+    std::vector<Type*> Tys(I->second->begin(), I->second->end());
+    std::sort(Tys.begin(), Tys.end(), TypeFingerprintLess(VT));
+    Words.push_back(Tys.size());
+    for (unsigned i = 0, e = Tys.size(); i != e; ++i)
+      writeType(Tys[i]);
+  }
+
+  std::vector<ValueKey> Globals;
+  for (DSNode::globals_iterator I = N->globals_begin(), E = N->globals_end();
+       I != E; ++I) {
+    ValueKey Key;
+    if (!getKey(*I, Key)) return false;
+    Globals.push_back(Key);
+  }
+  std::sort(Globals.begin(), Globals.end());
+  Words.push_back(Globals.size());
+  for (unsigned i = 0, e = Globals.size(); i != e; ++i)
+    writeValue(Globals[i]);
+
+  unsigned NumLinks = 0;
+  for (DSNode::const_edge_iterator I = N->edge_begin(), E = N->edge_end();
+       I != E; ++I)
+    if (!I->second.isNull())
+      ++NumLinks;
+  Words.push_back(NumLinks);
+  for (DSNode::const_edge_iterator I = N->edge_begin(), E = N->edge_end();
+       I != E; ++I)
+    if (!I->second.isNull()) {
+      Words.push_back(I->first);
+      writeHandle(I->second);
+    }
+  return true;
+}
+
+bool ImageWriter::writeCall(const DSCallSite &CS) {
+  ValueKey Key;
+  if (!getKey(CS.getCallSite().getInstruction(), Key)) return false;
+  writeValue(Key);
+
+  if (CS.isDirectCall()) {
+    if (!getKey(CS.getCalleeFunc(), Key, true)) return false;
+    Words.push_back(1);
+    writeValue(Key);
+  } else {
+    Words.push_back(0);
+    writeHandle(CS.getCalleeNode());
+  }
+  writeHandle(CS.getRetVal());
+  writeHandle(CS.getVAVal());
+  Words.push_back(CS.getNumPtrArgs());
+  for (unsigned i = 0, e = CS.getNumPtrArgs(); i != e; ++i)
+    writeHandle(CS.getPtrArg(i));
+
+  std::vector<ValueKey> Mapped;
+  for (DSCallSite::MappedSites_t::const_iterator I = CS.ms_begin(),
+         E = CS.ms_end(); I != E; ++I) {
+    if (!getKey(I->getInstruction(), Key)) return false;
+    Mapped.push_back(Key);
+  }
+  std::sort(Mapped.begin(), Mapped.end());
+  Words.push_back(Mapped.size());
+  for (unsigned i = 0, e = Mapped.size(); i != e; ++i)
+    writeValue(Mapped[i]);
+  return true;
+}
+
+bool DSGraphImage::capture(DSGraph &G, DSValueTable &VT,
+                           const std::vector<const GlobalValue*> *Roots) {
+  clear();
+  ImageWriter W(G, VT, Names, Values, Types, Words);
+
+  // Find the roots of the graph, each kind in a fixed order.  Call sites are
+  // ordered by their instructions rather than by their place in the lists,
+  // which depends on the addresses of nodes.
+  typedef std::vector<std::pair<ValueKey, DSNodeHandle> > RootListTy;
+  typedef std::vector<std::pair<ValueKey, const DSCallSite*> > CallListTy;
+  RootListTy Scalars, Returns, VarArgs;
+  CallListTy Calls[2];
+  DenseMap<const DSCallSite*, unsigned> Places;
+  ValueKey Key;
+  if (Roots) {
+    for (unsigned i = 0, e = Roots->size(); i != e; ++i) {
+      DSScalarMap::iterator I = G.getScalarMap().find((*Roots)[i]);
+      if (I == G.getScalarMap().end()) continue;
+      if (!W.getKey(I->first, Key)) { clear(); return false; }
+      Scalars.push_back(std::make_pair(Key, I->second));
+    }
+  } else {
+    for (DSScalarMap::iterator I = G.getScalarMap().begin(),
+           E = G.getScalarMap().end(); I != E; ++I) {
+      if (!W.getKey(I->first, Key)) { clear(); return false; }
+      Scalars.push_back(std::make_pair(Key, I->second));
+    }
+    for (DSGraph::retnodes_iterator I = G.retnodes_begin(),
+           E = G.retnodes_end(); I != E; ++I) {
+      if (!W.getKey(I->first, Key, true)) { clear(); return false; }
+      Returns.push_back(std::make_pair(Key, I->second));
+    }
+    for (DSGraph::vanodes_iterator I = G.vanodes_begin(),
+           E = G.vanodes_end(); I != E; ++I) {
+      if (!W.getKey(I->first, Key, true)) { clear(); return false; }
+      VarArgs.push_back(std::make_pair(Key, I->second));
+    }
+    const DSGraph::FunctionListTy *Lists[] = {
+      &G.getFunctionCalls(), &G.getAuxFunctionCalls()
+    };
+    for (unsigned l = 0; l != 2; ++l)
+      for (DSGraph::fc_iterator I = Lists[l]->begin(), E = Lists[l]->end();
+           I != E; ++I) {
+        if (!W.getKey(I->getCallSite().getInstruction(), Key)) {
+          clear();
+          return false;
+        }
+        Places[&*I] = Calls[l].size();
+        Calls[l].push_back(std::make_pair(Key, &*I));
+      }
+  }
+  std::sort(Scalars.begin(), Scalars.end(), firstLess<DSNodeHandle>);
+  std::sort(Returns.begin(), Returns.end(), firstLess<DSNodeHandle>);
+  std::sort(VarArgs.begin(), VarArgs.end(), firstLess<DSNodeHandle>);
+  for (unsigned l = 0; l != 2; ++l)
+    std::stable_sort(Calls[l].begin(), Calls[l].end(),
+                     firstLess<const DSCallSite*>);
+
+  // DSA sorts call sites by the addresses of their nodes, and which of
+  // several identical calls survives removeIdenticalCalls depends on the
+  // order of the list, so both orders are kept as well, outside the words.
+  for (unsigned l = 0; l != 2; ++l)
+    for (unsigned i = 0, e = Calls[l].size(); i != e; ++i)
+      CallOrder.push_back(Places[Calls[l][i].second]);
+
+  // Number the nodes breadth first from the roots, in the order in which the
+  // roots are written below.
+  RootListTy *Lists[] = { &Scalars, &Returns, &VarArgs };
+  for (unsigned l = 0; l != 3; ++l)
+    for (unsigned i = 0, e = Lists[l]->size(); i != e; ++i)
+      W.number((*Lists[l])[i].second);
+  for (unsigned l = 0; l != 2; ++l)
+    for (unsigned i = 0, e = Calls[l].size(); i != e; ++i) {
+      const DSCallSite &CS = *Calls[l][i].second;
+      if (CS.isIndirectCall())
+        W.number(CS.getCalleeNode());
+      W.number(CS.getRetVal());
+      W.number(CS.getVAVal());
+      for (unsigned a = 0, ae = CS.getNumPtrArgs(); a != ae; ++a)
+        W.number(CS.getPtrArg(a));
+    }
+  for (unsigned n = 0; n != W.Nodes.size(); ++n)
+    for (DSNode::edge_iterator I = W.Nodes[n]->edge_begin(),
+           E = W.Nodes[n]->edge_end(); I != E; ++I)
+      W.number(I->second);
+
+  std::vector<std::pair<const DSNode*, unsigned> > ByAddress;
+  for (unsigned n = 0; n != W.Nodes.size(); ++n)
+    ByAddress.push_back(std::make_pair(W.Nodes[n], n + 1));
+  std::sort(ByAddress.begin(), ByAddress.end());
+  for (unsigned n = 0; n != ByAddress.size(); ++n)
+    NodeOrder.push_back(ByAddress[n].second);
+
+  Words.push_back(W.Nodes.size());
+  for (unsigned n = 0; n != W.Nodes.size(); ++n)
+    if (!W.writeNode(W.Nodes[n])) { clear(); return false; }
+
+  for (unsigned l = 0; l != 3; ++l) {
+    Words.push_back(Lists[l]->size());
+    for (unsigned i = 0, e = Lists[l]->size(); i != e; ++i) {
+      W.writeValue((*Lists[l])[i].first);
+      W.writeHandle((*Lists[l])[i].second);
+    }
+  }
+
+  for (unsigned l = 0; l != 2; ++l) {
+    Words.push_back(Calls[l].size());
+    for (unsigned i = 0, e = Calls[l].size(); i != e; ++i)
+      if (!W.writeCall(*Calls[l][i].second)) { clear(); return false; }
+  }
+
+  // The fingerprint covers the code the image refers to as well as the
+  // graph, so an image of a graph of changed code differs from the old one.
+  const Module &M = VT.getModule();
+  hash_code H = hash_combine_range(Words.begin(), Words.end());
+  std::vector<bool> Local(Names.size(), false);
+  for (unsigned i = 0, e = Values.size(); i != e; ++i)
+    if (Values[i].second != ~0U)
+      Local[Values[i].first] = true;
+  for (unsigned i = 0, e = Names.size(); i != e; ++i) {
+    const GlobalValue *GV = M.getNamedValue(Names[i]);
+    if (!GV) { clear(); return false; }
+    H = hash_combine(H, VT.getFingerprint(*GV));
+    if (Local[i])
+      H = hash_combine(H, VT.getFingerprint(*cast<Function>(GV)));
+  }
+  for (unsigned i = 0, e = Types.size(); i != e; ++i)
+    H = hash_combine(H, Types[i]);
+  Fingerprint = H;
+  return true;
+}
+
+/// Reader - The state of DSGraphImage::restore.  The words are read twice:
+/// once to check that they are well formed and that every value has the kind
+/// it is used as, and then to build the graph.  An image read from a cache
+/// file may be damaged, so every count and index is checked the first time.
+class DSGraphImage::Reader {
+  const std::vector<uint32_t> &Words;
+  const std::vector<const Value*> &Values;
+  const std::vector<Type*> &Types;
+  const std::vector<uint32_t> &NodeOrder;
+  const std::vector<uint32_t> &CallOrder;
+  unsigned Pos;
+  unsigned NumNodes;
+  bool Bad;
+  DSGraph *G;
+  std::vector<DSNode*> Nodes;
+
+  unsigned next() {
+    if (Pos == Words.size()) {
+      Bad = true;
+      return 0;
+    }
+    return Words[Pos++];
+  }
+
+  /// count - Read the number of things that follow, each at least Size
+  /// words long.
+  unsigned count(unsigned Size = 1) {
+    unsigned N = next();
+    if (N > (Words.size() - Pos) / Size) {
+      Bad = true;
+      return 0;
+    }
+    return N;
+  }
+
+  const Value *readValue() {
+    unsigned I = next();
+    if (I < Values.size()) return Values[I];
+    Bad = true;
+    return 0;
+  }
+
+  Type *readType() {
+    unsigned I = next();
+    if (I < Types.size()) return Types[I];
+    Bad = true;
+    return 0;
+  }
+
+  DSNodeHandle readHandle() {
+    unsigned N = next(), Offset = next();
+    if (N > NumNodes) Bad = true;
+    if (!G || !N) return DSNodeHandle();
+    return DSNodeHandle(Nodes[N], Offset);
+  }
+
+  const GlobalValue *getLeader(const GlobalValue *GV) {
+    EquivalenceClasses<const GlobalValue*> &ECs = G->getGlobalECs();
+    EquivalenceClasses<const GlobalValue*>::iterator I = ECs.findValue(GV);
+    return I == ECs.end() ? GV : *ECs.findLeader(I);
+  }
+
+  bool readNodes();
+  bool readCall(DSGraph::FunctionListTy &List);
+
+public:
+  Reader(const std::vector<uint32_t> &W, const std::vector<const Value*> &V,
+         const std::vector<Type*> &T, const std::vector<uint32_t> &NO,
+         const std::vector<uint32_t> &CO)
+    : Words(W), Values(V), Types(T), NodeOrder(NO), CallOrder(CO), Pos(0),
+      NumNodes(0), Bad(false), G(0) {}
+
+  /// read - Check the image if G is null, or add it to G.
+  bool read(DSGraph *Graph);
+};
+
+bool DSGraphImage::Reader::readNodes() {
+  NumNodes = count(4);
+  if (NodeOrder.size() != NumNodes) return false;
+  std::vector<bool> Seen(NumNodes + 1);
+  for (unsigned n = 0; n != NumNodes; ++n) {
+    unsigned N = NodeOrder[n];
+    if (!N || N > NumNodes || Seen[N]) return false;
+    Seen[N] = true;
+  }
+
+  // Nodes are allocated in the order of their addresses when they were
+  // captured, so they compare the same way.
+  if (G) {
+    Nodes.resize(NumNodes + 1);
+    for (unsigned n = 0; n != NumNodes; ++n)
+      Nodes[NodeOrder[n]] = new (G) DSNode(G);
+  }
+
+  // The links are set once every node exists.
+  std::vector<unsigned> LinkPos(NumNodes + 1);
+  for (unsigned n = 1; n <= NumNodes && !Bad; ++n) {
+    DSNode *N = G ? Nodes[n] : 0;
+    unsigned Size = next(), Flags = next();
+    if (N) {
+      N->Size = Size;
+      N->NodeType = Flags;
+    }
+    for (unsigned t = 0, te = count(2); t != te; ++t) {
+      unsigned Offset = next();
+      svset<Type*> Tys;
+      for (unsigned i = 0, ie = count(); i != ie; ++i)
+        Tys.insert(readType());
+      if (N)
+        N->TyMap[Offset] = G->getTypeSS().getOrCreate(Tys);
+    }
+    for (unsigned g = 0, ge = count(); g != ge; ++g) {
+      const GlobalValue *GV = dyn_cast_or_null<GlobalValue>(readValue());
+      if (!GV) return false;
+      if (N)
+        N->Globals.insert(getLeader(GV));
+    }
+    LinkPos[n] = Pos;
+    Pos += 3 * count(3);
+  }
+
+  unsigned End = Pos;
+  for (unsigned n = 1; n <= NumNodes && !Bad; ++n) {
+    Pos = LinkPos[n];
+    for (unsigned l = 0, le = next(); l != le; ++l) {
+      unsigned Offset = next();
+      DSNodeHandle NH = readHandle();
+      if (G)
+        Nodes[n]->setLink(Offset, NH);
+    }
+  }
+  Pos = End;
+  return !Bad;
+}
+
+bool DSGraphImage::Reader::readCall(DSGraph::FunctionListTy &List) {
+  CallSite Site(const_cast<Value*>(readValue()));
+  if (!Site.getInstruction()) return false;
+
+  const Function *CalleeF = 0;
+  DSNodeHandle CalleeN;
+  if (next()) {
+    CalleeF = dyn_cast_or_null<Function>(readValue());
+    if (!CalleeF) return false;
+  } else {
+    CalleeN = readHandle();
+    if (G && !CalleeN.getNode()) return false;
+  }
+  DSNodeHandle RetVal = readHandle();
+  DSNodeHandle VarArgVal = readHandle();
+  std::vector<DSNodeHandle> Args(count(2));
+  for (unsigned a = 0, ae = Args.size(); a != ae; ++a)
+    Args[a] = readHandle();
+
+  std::vector<CallSite> Mapped;
+  for (unsigned m = 0, me = count(); m != me; ++m) {
+    CallSite MS(const_cast<Value*>(readValue()));
+    if (!MS.getInstruction()) return false;
+    Mapped.push_back(MS);
+  }
+  if (Bad) return false;
+
+  if (G) {
+    if (CalleeF)
+      List.push_back(DSCallSite(Site, RetVal, VarArgVal, CalleeF, Args));
+    else
+      List.push_back(DSCallSite(Site, RetVal, VarArgVal, CalleeN.getNode(),
+                                Args));
+    List.back().MappedSites.insert(Mapped.begin(), Mapped.end());
+  }
+  return true;
+}
+
+bool DSGraphImage::Reader::read(DSGraph *Graph) {
+  G = Graph;
+  Pos = 0;
+  Bad = false;
+  if (!readNodes()) return false;
+
+  for (unsigned s = 0, se = count(3); s != se; ++s) {
+    const Value *V = readValue();
+    DSNodeHandle NH = readHandle();
+    if (G)
+      G->getNodeForValue(V).mergeWith(NH);
+  }
+  for (unsigned l = 0; l != 2; ++l)
+    for (unsigned r = 0, re = count(3); r != re; ++r) {
+      const Function *F = dyn_cast_or_null<Function>(readValue());
+      if (!F) return false;
+      DSNodeHandle NH = readHandle();
+      if (G) {
+        if (l == 0)
+          G->getOrCreateReturnNodeFor(*F).mergeWith(NH);
+        else
+          G->getOrCreateVANodeFor(*F).mergeWith(NH);
+      }
+    }
+  DSGraph::FunctionListTy *Lists[2] = { 0, 0 };
+  if (G) {
+    Lists[0] = &G->getFunctionCalls();
+    Lists[1] = &G->getAuxFunctionCalls();
+  }
+  unsigned Place = 0;
+  for (unsigned l = 0; l != 2; ++l) {
+    unsigned NumCalls = count(8);
+    if (CallOrder.size() < Place + NumCalls) return false;
+    std::vector<bool> Seen(NumCalls);
+    for (unsigned c = 0; c != NumCalls; ++c) {
+      unsigned P = CallOrder[Place + c];
+      if (P >= NumCalls || Seen[P]) return false;
+      Seen[P] = true;
+    }
+
+    // Read the calls into a list of their own, then move them to the end of
+    // the graph's list in the order they had when they were captured.
+    DSGraph::FunctionListTy Calls;
+    std::vector<DSGraph::FunctionListTy::iterator> Placed(NumCalls);
+    for (unsigned c = 0; c != NumCalls; ++c) {
+      if (!readCall(Calls)) return false;
+      if (G)
+        Placed[CallOrder[Place + c]] = --Calls.end();
+    }
+    if (G)
+      for (unsigned c = 0; c != NumCalls; ++c)
+        Lists[l]->splice(Lists[l]->end(), Calls, Placed[c]);
+    Place += NumCalls;
+  }
+  return !Bad && Pos == Words.size() && Place == CallOrder.size();
+}
+
+bool DSGraphImage::restore(DSGraph &G, DSValueTable &VT) const {
+  if (Words.empty()) return false;
+  const Module &M = VT.getModule();
+  std::vector<const GlobalValue*> Globals(Names.size());
+  for (unsigned i = 0, e = Names.size(); i != e; ++i)
+    if (!(Globals[i] = M.getNamedValue(Names[i])))
+      return false;
+
+  std::vector<const Value*> Vals(Values.size());
+  for (unsigned i = 0, e = Values.size(); i != e; ++i) {
+    if (Values[i].first >= Globals.size()) return false;
+    const GlobalValue *GV = Globals[Values[i].first];
+    if (Values[i].second == ~0U) {
+      Vals[i] = GV;
+      continue;
+    }
+    const Function *F = dyn_cast<Function>(GV);
+    if (!F || F->isDeclaration() ||
+        !(Vals[i] = VT.getValue(*F, Values[i].second)))
+      return false;
+  }
+
+  std::vector<Type*> Tys(Types.size());
+  for (unsigned i = 0, e = Types.size(); i != e; ++i)
+    if (!(Tys[i] = VT.getType(Types[i])))
+      return false;
+
+  Reader R(Words, Vals, Tys, NodeOrder, CallOrder);
+  if (!R.read(0)) return false;
+  R.read(&G);
+  return true;
+}
+
+const GlobalValue *DSGraphImage::getRepresentative(
+    const EquivalenceClasses<const GlobalValue*> &ECs, const GlobalValue *GV) {
+  EquivalenceClasses<const GlobalValue*>::iterator I = ECs.findValue(GV);
+  if (I == ECs.end()) return GV;
+  const GlobalValue *Rep = GV;
+  for (EquivalenceClasses<const GlobalValue*>::member_iterator
+         MI = ECs.findLeader(I), ME = ECs.member_end(); MI != ME; ++MI)
+    if ((*MI)->getName() < Rep->getName())
+      Rep = *MI;
+  return Rep;
+}
+
+void DSGraphImage::clear() {
+  Names.clear();
+  Values.clear();
+  Types.clear();
+  Words.clear();
+  NodeOrder.clear();
+  CallOrder.clear();
+  Fingerprint = 0;
+}
+
+void DSGraphImage::swap(DSGraphImage &Other) {
+  Names.swap(Other.Names);
+  Values.swap(Other.Values);
+  Types.swap(Other.Types);
+  Words.swap(Other.Words);
+  NodeOrder.swap(Other.NodeOrder);
+  CallOrder.swap(Other.CallOrder);
+  std::swap(Fingerprint, Other.Fingerprint);
+}
+
+//===----------------------------------------------------------------------===//
+// Cache File Format
+//===----------------------------------------------------------------------===//
+//
+// A cache file is a sequence of little-endian 32-bit words.  A 64-bit number
+// takes two words, low word first, and a string is its length in bytes
+// followed by its bytes, padded with zeros to a whole word.  The file holds
+// the magic number and version, the number of entries, and for each entry
+// its key, functions, callees and image.  The image is a string, so that it
+// can be skipped until it is needed.
+//
+
+namespace {
+  const uint32_t CacheMagic = 0x43475344;   // "DSGC"
+  const uint32_t CacheVersion = 1;
+
+  void writeWord(raw_ostream &OS, uint32_t W) {
+    char Bytes[4] = { char(W), char(W >> 8), char(W >> 16), char(W >> 24) };
+    OS.write(Bytes, 4);
+  }
+
+  void writeWord64(raw_ostream &OS, uint64_t W) {
+    writeWord(OS, uint32_t(W));
+    writeWord(OS, uint32_t(W >> 32));
+  }
+
+  void writeString(raw_ostream &OS, StringRef S) {
+    writeWord(OS, S.size());
+    OS << S;
+    for (size_t i = S.size(); i % 4; ++i)
+      OS << '\0';
+  }
+
+  void writeWords(raw_ostream &OS, const std::vector<uint32_t> &Words) {
+    writeWord(OS, Words.size());
+    for (unsigned i = 0, e = Words.size(); i != e; ++i)
+      writeWord(OS, Words[i]);
+  }
+
+  /// CacheReader - Read the words of a cache file.  Reading past the end
+  /// makes it fail, after which every read returns zero.
+  class CacheReader {
+    StringRef Data;
+    size_t Pos;
+    bool Failed;
+
+    void fail() {
+      Failed = true;
+      Pos = Data.size();
+    }
+
+  public:
+    explicit CacheReader(StringRef Data) : Data(Data), Pos(0), Failed(false) {}
+
+    bool failed() const { return Failed; }
+    bool atEnd() const { return Pos == Data.size(); }
+
+    uint32_t readWord() {
+      if (Data.size() - Pos < 4) {
+        fail();
+        return 0;
+      }
+      const unsigned char *P =
+        reinterpret_cast<const unsigned char*>(Data.data()) + Pos;
+      Pos += 4;
+      return P[0] | P[1] << 8 | P[2] << 16 | uint32_t(P[3]) << 24;
+    }
+
+    uint64_t readWord64() {
+      uint64_t Low = readWord();
+      return Low | uint64_t(readWord()) << 32;
+    }
+
+    /// readCount - Read the number of things that follow, each at least
+    /// Size words long.
+    unsigned readCount(unsigned Size) {
+      uint32_t N = readWord();
+      if (N > (Data.size() - Pos) / (4 * Size)) {
+        fail();
+        return 0;
+      }
+      return N;
+    }
+
+    StringRef readString() {
+      uint32_t Size = readWord();
+      size_t Padded = (size_t(Size) + 3) & ~size_t(3);
+      if (Data.size() - Pos < Padded) {
+        fail();
+        return StringRef();
+      }
+      StringRef S = Data.substr(Pos, Size);
+      Pos += Padded;
+      return S;
+    }
+
+    void readWords(std::vector<uint32_t> &Words) {
+      Words.resize(readCount(1));
+      for (unsigned i = 0, e = Words.size(); i != e; ++i)
+        Words[i] = readWord();
+    }
+  };
+}
+
+void DSGraphImage::write(raw_ostream &Out) const {
+  std::string Data;
+  raw_string_ostream OS(Data);
+  writeWord64(OS, Fingerprint);
+  writeWord(OS, Names.size());
+  for (unsigned i = 0, e = Names.size(); i != e; ++i)
+    writeString(OS, Names[i]);
+  writeWord(OS, Values.size());
+  for (unsigned i = 0, e = Values.size(); i != e; ++i) {
+    writeWord(OS, Values[i].first);
+    writeWord(OS, Values[i].second);
+  }
+  writeWord(OS, Types.size());
+  for (unsigned i = 0, e = Types.size(); i != e; ++i)
+    writeWord64(OS, Types[i]);
+  writeWords(OS, Words);
+  writeWords(OS, NodeOrder);
+  writeWords(OS, CallOrder);
+
+  // The image ends with a checksum, so that a damaged one is not restored.
+  Out << OS.str();
+  writeWord64(Out, hash_value(StringRef(Data)));
+}
+
+bool DSGraphImage::read(StringRef Data) {
+  clear();
+  if (Data.size() < 8 ||
+      CacheReader(Data.substr(Data.size() - 8)).readWord64() !=
+        uint64_t(hash_value(Data.drop_back(8))))
+    return false;
+  CacheReader R(Data.drop_back(8));
+  Fingerprint = R.readWord64();
+  Names.resize(R.readCount(1));
+  for (unsigned i = 0, e = Names.size(); i != e; ++i)
+    Names[i] = R.readString();
+  Values.resize(R.readCount(2));
+  for (unsigned i = 0, e = Values.size(); i != e; ++i) {
+    Values[i].first = R.readWord();
+    Values[i].second = R.readWord();
+  }
+  Types.resize(R.readCount(2));
+  for (unsigned i = 0, e = Types.size(); i != e; ++i)
+    Types[i] = R.readWord64();
+  R.readWords(Words);
+  R.readWords(NodeOrder);
+  R.readWords(CallOrder);
+
+  // The words themselves are checked when the image is restored.
+  if (R.failed() || !R.atEnd() || Words.empty()) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+//===----------------------------------------------------------------------===//
+// DSGraphCache Implementation
+//===----------------------------------------------------------------------===//
+
+namespace {
+  /// CacheMap - The caches of the passes, by the name of the pass.
+  struct CacheMap : public StringMap<DSGraphCache*> {
+    ~CacheMap() { DeleteContainerSeconds(*this); }
+  };
+}
+
+static ManagedStatic<CacheMap> Caches;
+
+DSGraphCache &DSGraphCache::get(StringRef PassName) {
+  DSGraphCache *&Cache = (*Caches)[PassName];
+  if (!Cache)
+    Cache = new DSGraphCache();
+  return *Cache;
+}
+
+bool DSGraphCache::Entry::restore(DSGraph &G, DSValueTable &VT) {
+  if (!Data.empty()) {
+    Image.read(Data);
+    Data = StringRef();
+  }
+  return Image.restore(G, VT);
+}
+
+DSGraphCache::Entry *DSGraphCache::lookup(StringRef Function) const {
+  StringMap<Entry*>::const_iterator I = ByFunction.find(Function);
+  return I == ByFunction.end() ? 0 : I->second;
+}
+
+void DSGraphCache::erase(Entry *E) {
+  for (unsigned f = 0, fe = E->Functions.size(); f != fe; ++f)
+    ByFunction.erase(E->Functions[f]);
+  for (std::list<Entry>::iterator I = Entries.begin(); I != Entries.end(); ++I)
+    if (&*I == E) {
+      Entries.erase(I);
+      break;
+    }
+}
+
+void DSGraphCache::insert(Entry &E) {
+  // Drop the entries that hold any of these functions.
+  for (unsigned i = 0, e = E.Functions.size(); i != e; ++i)
+    if (Entry *Old = lookup(E.Functions[i]))
+      erase(Old);
+
+  Entries.push_back(Entry());
+  Entry &New = Entries.back();
+  New.Key = E.Key;
+  New.Functions.swap(E.Functions);
+  New.Callees.swap(E.Callees);
+  New.Image.swap(E.Image);
+  New.Data = E.Data;
+  for (unsigned i = 0, e = New.Functions.size(); i != e; ++i)
+    ByFunction[New.Functions[i]] = &New;
+}
+
+void DSGraphCache::load(StringRef Path) {
+  if (Loaded) return;
+  Loaded = true;
+
+  // The file is not copied: the images of the entries point into it.
+  if (MemoryBuffer::getFile(Path, File, -1, false))
+    return;
+  CacheReader R(File->getBuffer());
+  if (R.readWord() != CacheMagic || R.readWord() != CacheVersion)
+    return;
+  std::list<Entry> Read;
+  for (unsigned i = 0, e = R.readCount(5); i != e; ++i) {
+    Read.push_back(Entry());
+    Entry &E = Read.back();
+    E.Key = R.readWord64();
+    E.Functions.resize(R.readCount(1));
+    for (unsigned f = 0, fe = E.Functions.size(); f != fe; ++f)
+      E.Functions[f] = R.readString();
+    E.Callees.resize(R.readCount(3));
+    for (unsigned c = 0, ce = E.Callees.size(); c != ce; ++c) {
+      E.Callees[c].first = R.readString();
+      E.Callees[c].second = R.readWord64();
+    }
+    E.Data = R.readString();
+  }
+  if (R.failed() || !R.atEnd())
+    return;
+
+  for (std::list<Entry>::iterator I = Read.begin(), E = Read.end(); I != E;
+       ++I)
+    if (!I->Functions.empty() && !I->Data.empty())
+      insert(*I);
+}
+
+bool DSGraphCache::save(StringRef Path, const Module &M,
+                        std::string &Error) const {
+  std::vector<const Entry*> Live;
+  for (std::list<Entry>::const_iterator I = Entries.begin(),
+         E = Entries.end(); I != E; ++I) {
+    if (I->Data.empty() && I->Image.empty()) continue;
+    bool Defined = true;
+    for (unsigned f = 0, fe = I->Functions.size(); f != fe && Defined; ++f) {
+      const Function *F = M.getFunction(I->Functions[f]);
+      Defined = F && !F->isDeclaration();
+    }
+    if (Defined)
+      Live.push_back(&*I);
+  }
+
+  // Write a new file and then move it into place, as the old one may still
+  // be mapped into memory.
+  std::string TempPath = (Path + ".tmp").str();
+  {
+    raw_fd_ostream OS(TempPath.c_str(), Error, raw_fd_ostream::F_Binary);
+    if (!Error.empty()) return false;
+    writeWord(OS, CacheMagic);
+    writeWord(OS, CacheVersion);
+    writeWord(OS, Live.size());
+    for (unsigned i = 0, e = Live.size(); i != e; ++i) {
+      const Entry &E = *Live[i];
+      writeWord64(OS, E.Key);
+      writeWord(OS, E.Functions.size());
+      for (unsigned f = 0, fe = E.Functions.size(); f != fe; ++f)
+        writeString(OS, E.Functions[f]);
+      writeWord(OS, E.Callees.size());
+      for (unsigned c = 0, ce = E.Callees.size(); c != ce; ++c) {
+        writeString(OS, E.Callees[c].first);
+        writeWord64(OS, E.Callees[c].second);
+      }
+      if (!E.Data.empty()) {
+        writeString(OS, E.Data);
+      } else {
+        std::string Data;
+        raw_string_ostream DS(Data);
+        E.Image.write(DS);
+        writeString(OS, DS.str());
+      }
+    }
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      Error = "could not write '" + TempPath + "'";
+      return false;
+    }
+  }
+  if (error_code EC = sys::fs::rename(TempPath, Path)) {
+    Error = "could not rename '" + TempPath + "': " + EC.message();
+    return false;
+  }
+  return true;
+}
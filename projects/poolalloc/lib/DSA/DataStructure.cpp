@@ -14,6 +14,7 @@
 #include "dsa/DSGraphTraits.h"
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
+#include "dsa/DSGraphImage.h"
 #include "dsa/DSSupport.h"
 #include "dsa/DSNode.h"
 #include "llvm/Constants.h"
@@ -25,7 +26,11 @@
 #include "llvm/Assembly/Writer.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/PathV2.h"
 #include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
@@ -41,6 +46,13 @@ namespace {
   STATISTIC (NumFolds, "Number of nodes completely folded");
   STATISTIC (NumFoldsOOBOffset, "Number of OOB offsets that caused node folding");
   STATISTIC (NumNodeAllocated  , "Number of nodes allocated");
+  STATISTIC (NumNodeRecycled   , "Number of nodes allocated from a free list");
+
+  static cl::opt<std::string> DSACacheDir("dsa-cache-dir",
+         cl::desc("Keep the graphs saved by -dsa-incremental in this "
+                  "directory between runs"),
+         cl::value_desc("directory"),
+         cl::Hidden);
 }
 
 /// isForwarding - Return true if this NodeHandle is forwarding to another
@@ -62,16 +74,45 @@ DSNode *DSNodeHandle::HandleForwarding() const {
     }
     }
     );
-  // Handle node forwarding here!
-  DSNode *Next = N->ForwardNH.getNode();  // Cause recursive shrinkage
-  Offset += N->ForwardNH.getOffset();
-
-  if (--N->NumReferrers == 0) {
-    // Removing the last referrer to the node, sever the forwarding link
-    N->stopForwarding();
+  // Forwarding nodes form a union-find forest; find the representative.  The
+  // chain is walked without recursion, since merging in large SCCs can build
+  // long chains before anything asks for their nodes.
+  SmallVector<DSNode*, 8> Path;
+  DSNode *Root = N;
+  do {
+    Path.push_back(Root);
+    Root = Root->ForwardNH.N;
+  } while (Root->isForwarding());
+
+  // Compress the path: point every forwarding node on it straight at the
+  // representative, adding up the offsets along the way.  Working back from
+  // the end of the chain, each node's successor is already compressed and may
+  // be deleted once it loses its last referrer.
+  unsigned RootOffset = 0;
+  for (unsigned i = Path.size(); i-- != 0; ) {
+    DSNodeHandle &Fwd = Path[i]->ForwardNH;
+    RootOffset += Fwd.Offset;
+    if (RootOffset >= Root->getSize()) {
+      assert(Root->getSize() <= 1 && "Forwarded to shrunk but not collapsed node?");
+      RootOffset = 0;
+    }
+    if (Fwd.N != Root) {
+      DSNode *Next = Fwd.N;
+      Fwd.N = Root;
+      Root->NumReferrers++;
+      if (--Next->NumReferrers == 0) {
+        // Removing the last referrer to the node, sever the forwarding link
+        Next->stopForwarding();
+      }
+    }
+    Fwd.Offset = RootOffset;
   }
 
-  N = Next;
+  // Finally move this handle over to the representative.
+  Offset += RootOffset;
+  if (--N->NumReferrers == 0)
+    N->stopForwarding();
+  N = Root;
   N->NumReferrers++;
 
   if (N->getSize() <= Offset) {
@@ -96,9 +137,9 @@ DSNodeHandle &DSScalarMap::AddGlobal(const GlobalValue *GV) {
     const GlobalValue *Leader = *GlobalECs.findLeader(ECI);
     if (Leader != GV) {
       GV = Leader;
-      iterator I = ValueMap.find(GV);
+      ValueMapTy::iterator I = ValueMap.find(GV);
       if (I != ValueMap.end())
-        return I->second;
+        return Entries[I->second].second;
     }
   }
 
@@ -106,7 +147,7 @@ DSNodeHandle &DSScalarMap::AddGlobal(const GlobalValue *GV) {
   // will be inserted into the scalar map now.
   GlobalSet.insert(GV);
 
-  return ValueMap.insert(std::make_pair(GV, DSNodeHandle())).first->second;
+  return addEntry(GV);
 }
 
 /// spliceFrom - Copy all entries from RHS, then clear RHS.
@@ -114,23 +155,79 @@ DSNodeHandle &DSScalarMap::AddGlobal(const GlobalValue *GV) {
 void DSScalarMap::spliceFrom(DSScalarMap &RHS) {
   // Special case if this is empty.
   if (ValueMap.empty()) {
+    Entries.swap(RHS.Entries);
+    FreeEntries.swap(RHS.FreeEntries);
     ValueMap.swap(RHS.ValueMap);
     GlobalSet.swap(RHS.GlobalSet);
   } else {
     GlobalSet.insert(RHS.GlobalSet.begin(), RHS.GlobalSet.end());
-    for (ValueMapTy::iterator I = RHS.ValueMap.begin(), E = RHS.ValueMap.end();
-         I != E; ++I)
-      ValueMap[I->first].mergeWith(I->second);
-    RHS.ValueMap.clear();
+    for (iterator I = RHS.begin(), E = RHS.end(); I != E; ++I)
+      getRawEntryRef(I->first).mergeWith(I->second);
+    RHS.clear();
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// DSNodeArena Implementation
+//===----------------------------------------------------------------------===//
+
+void *DSNodeArena::allocate(DSNodeArena *A, size_t Size) {
+  BlockHeader *B;
+  if (!A) {
+    B = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + Size));
+  } else {
+    // All nodes have the same size, so any free block will do.
+    assert(Size == sizeof(DSNode) && "Arena only holds DSNodes!");
+    if ((B = A->FreeList)) {
+      A->FreeList = B->NextFree;
+      ++NumNodeRecycled;
+    } else {
+      B = static_cast<BlockHeader*>(
+        A->Allocator.Allocate(sizeof(BlockHeader) + Size,
+                              AlignOf<BlockHeader>::Alignment));
+    }
+    ++A->Users;
+  }
+  B->Arena = A;
+  return B + 1;
+}
+
+void DSNodeArena::deallocate(void *P) {
+  if (!P) return;
+  BlockHeader *B = static_cast<BlockHeader*>(P) - 1;
+  DSNodeArena *A = B->Arena;
+  if (!A) {
+    free(B);
+    return;
   }
+  B->NextFree = A->FreeList;
+  A->FreeList = B;
+  A->release();
 }
 
 //===----------------------------------------------------------------------===//
 // DSNode Implementation
 //===----------------------------------------------------------------------===//
 
+void *DSNode::operator new(size_t Size, DSGraph *G) {
+  return DSNodeArena::allocate(G ? G->getNodeArena() : 0, Size);
+}
+
+void *DSNode::operator new(size_t Size) {
+  return DSNodeArena::allocate(0, Size);
+}
+
+void DSNode::operator delete(void *P) {
+  DSNodeArena::deallocate(P);
+}
+
+void DSNode::operator delete(void *P, DSGraph *) {
+  DSNodeArena::deallocate(P);
+}
+
 DSNode::DSNode(DSGraph *G)
-  : NumReferrers(0), Size(0), ParentGraph(G), NodeType(0) {
+  : NumReferrers(0), Size(0), ParentGraph(G), NodeType(0), Epoch(0),
+    Index(0) {
     // Add the type entry if it is specified...
     if (G) G->addNode(this);
     ++NumNodeAllocated;
@@ -139,7 +236,7 @@ DSNode::DSNode(DSGraph *G)
 // DSNode copy constructor... do not copy over the referrers list!
 DSNode::DSNode(const DSNode &N, DSGraph *G, bool NullLinks)
   : NumReferrers(0), Size(N.Size), ParentGraph(G), TyMap(N.TyMap),
-  Globals(N.Globals), NodeType(N.NodeType) {
+  Globals(N.Globals), NodeType(N.NodeType), Epoch(0), Index(0) {
     if (!NullLinks) Links = N.Links;
     G->addNode(this);
     ++NumNodeAllocated;
@@ -252,7 +349,7 @@ void DSNode::foldNodeCompletely() {
     // Create the node we are going to forward to.  This is required because
     // some referrers may have an offset that is > 0.  By forcing them to
     // forward, the forwarder has the opportunity to correct the offset.
-    DSNode *DestNode = new DSNode(ParentGraph);
+    DSNode *DestNode = new (ParentGraph) DSNode(ParentGraph);
     DestNode->NodeType = NodeType;
     DestNode->setCollapsedMarker();
     DestNode->Size = 1;
@@ -470,9 +567,7 @@ void DSNode::mergeTypeInfo(const TyMapTy::mapped_type TyIt, unsigned Offset) {
         growSize(Offset + TD.getTypeAllocSize(*ni));
     }
   } else if (TyIt) {
-    svset<Type*> S(*TyMap[Offset]);
-    S.insert(TyIt->begin(), TyIt->end());
-    TyMap[Offset] = getParentGraph()->getTypeSS().getOrCreate(S);
+    TyMap[Offset] = getParentGraph()->getTypeSS().getOrCreate(TyMap[Offset], TyIt);
   }
   assert(TyMap[Offset]);
 }
@@ -494,10 +589,14 @@ void DSNode::addEdgeTo(unsigned Offset, const DSNodeHandle &NH) {
   if (isNodeCompletelyFolded())
     Offset = 0;
 
-  DSNodeHandle &ExistingEdge = getLink(Offset);
-  if (!ExistingEdge.isNull()) {
+  // Look the edge up without inserting: NH may be one of our own links, and
+  // an insertion could move it.
+  assert(Offset < getSize() && "Link index is out of range!");
+  assert(!isForwarding() && "Link on a forwarding node");
+  LinkMapTy::iterator ExistingEdge = Links.find(Offset);
+  if (ExistingEdge != Links.end() && !ExistingEdge->second.isNull()) {
     // Merge the two nodes...
-    ExistingEdge.mergeWith(NH);
+    ExistingEdge->second.mergeWith(NH);
   } else {                             // No merging to perform...
     setLink(Offset, NH);               // Just force a link in there...
   }
@@ -688,6 +787,12 @@ void DSNode::mergeWith(const DSNodeHandle &NH, unsigned Offset) {
     // If the offsets are the same, merge the smaller node into the bigger node
     N->mergeWith(DSNodeHandle(this, Offset), NH.getOffset());
     return;
+  } else if (Offset == NH.getOffset() && getSize() == N->getSize() &&
+             getNumReferrers() < N->getNumReferrers()) {
+    // Otherwise use the number of referrers as the rank: the node that more
+    // handles point to stays, so fewer handles have to be forwarded.
+    N->mergeWith(DSNodeHandle(this, Offset), NH.getOffset());
+    return;
   }
 
   // Ok, now we can merge the two nodes.  Use a static helper that works with
@@ -705,21 +810,14 @@ void DSNode::cleanEdges() {
   for (type_iterator ii = type_begin(); ii != type_end(); ) {
     if (ii->second)
       ++ii;
-    else {
-      type_iterator backup = ii;
-      ++backup;
-      TyMap.erase(ii);
-      ii = backup;
-    }
+    else
+      ii = TyMap.erase(ii);
   }
   //get rid of any node edge pointing to nothing
   for (edge_iterator ii = edge_begin(); ii != edge_end(); ) {
-    if (ii->second.isNull()) {
-      edge_iterator backup = ii;
-      ++backup;
-      Links.erase(ii);
-      ii = backup;
-    } else
+    if (ii->second.isNull())
+      ii = Links.erase(ii);
+    else
       ++ii;
   }
 }
@@ -747,19 +845,35 @@ void DSNode::checkOffsetFoldIfNeeded(int Offset) {
 // ReachabilityCloner Implementation
 //===----------------------------------------------------------------------===//
 
-DSNodeHandle ReachabilityCloner::getClonedNH(const DSNodeHandle &SrcNH) {
-  if (SrcNH.isNull()) return DSNodeHandle();
+// getOffsetNH - Return the node that NH points to, at Offset past NH,
+// folding the node if that offset is out of it.
+static DSNodeHandle getOffsetNH(const DSNodeHandle &NH, unsigned Offset) {
+  DSNode *NHN = NH.getNode();
+  unsigned NewOffset = NH.getOffset() + Offset;
+  if (NHN) {
+    NHN->checkOffsetFoldIfNeeded(NewOffset);
+    NHN = NH.getNode();
+  }
+  return DSNodeHandle(NHN, NewOffset);
+}
+
+// findClonedNH - Set Result to the node that SrcNH maps to if it has been
+// cloned already, or can be merged into a node for the same global in the
+// destination graph, or cannot be created, and return true.  Otherwise,
+// create a copy of the source node without links, map the source node to it
+// and return false.
+bool ReachabilityCloner::findClonedNH(const DSNodeHandle &SrcNH,
+                                      DSNodeHandle &Result) {
+  if (SrcNH.isNull()) {
+    Result = DSNodeHandle();
+    return true;
+  }
   const DSNode *SN = SrcNH.getNode();
 
-  DSNodeHandle &NH = NodeMap[SN];
+  DSNodeHandle &NH = getMappedNH(SN);
   if (!NH.isNull()) { // Node already mapped?
-    DSNode *NHN = NH.getNode();
-    unsigned NewOffset = NH.getOffset() + SrcNH.getOffset();
-    if (NHN) {
-      NHN->checkOffsetFoldIfNeeded(NewOffset);
-      NHN = NH.getNode();
-    }
-    return DSNodeHandle(NHN, NewOffset);
+    Result = getOffsetNH(NH, SrcNH.getOffset());
+    return true;
   }
 
   // If SrcNH has globals and the destination graph has one of the same globals,
@@ -774,46 +888,46 @@ DSNodeHandle ReachabilityCloner::getClonedNH(const DSNodeHandle &SrcNH) {
         // We found one, use merge instead!
         merge(GI->second, Src->getNodeForValue(GV));
         assert(!NH.isNull() && "Didn't merge node!");
-        DSNode *NHN = NH.getNode();
-        unsigned NewOffset = NH.getOffset() + SrcNH.getOffset();
-        if (NHN) {
-          NHN->checkOffsetFoldIfNeeded(NewOffset);
-          NHN = NH.getNode();
-        }
-        return DSNodeHandle(NHN, NewOffset);
+        Result = getOffsetNH(NH, SrcNH.getOffset());
+        return true;
       }
     }
   }
 
-  if (!createDest) return DSNodeHandle(0,0);
+  if (!createDest) {
+    Result = DSNodeHandle(0,0);
+    return true;
+  }
 
-  DSNode *DN = new DSNode(*SN, Dest, true /* Null out all links */);
+  DSNode *DN = new (Dest) DSNode(*SN, Dest, true /* Null out all links */);
   DN->maskNodeTypes(BitsToKeep);
   NH = DN;
+  return false;
+}
 
-  // Next, recursively clone all outgoing links as necessary.  Note that
-  // adding these links can cause the node to collapse itself at any time, and
-  // the current node may be merged with arbitrary other nodes.  For this
-  // reason, we must always go through NH.
-  DN = 0;
-  for (DSNode::const_edge_iterator ii = SN->edge_begin(), ee = SN->edge_end();
-       ii != ee; ++ii) {
-    const DSNodeHandle &SrcEdge = ii->second;
-    if (!SrcEdge.isNull()) {
-      const DSNodeHandle &DestEdge = getClonedNH(SrcEdge);
-      // Compute the offset into the current node at which to
-      // merge this link.  In the common case, this is a linear
-      // relation to the offset in the original node (with
-      // wrapping), but if the current node gets collapsed due to
-      // recursive merging, we must make sure to merge in all remaining
-      // links at offset zero.
-      unsigned MergeOffset = 0;
-      DSNode *CN = NH.getNode();
-      if (CN->getSize() != 1)
-        MergeOffset = (ii->first + NH.getOffset()) % CN->getSize();
-      CN->addEdgeTo(MergeOffset, DestEdge);
-    }
-  }
+// addClonedEdge - Add the link that Frame is at, which now leads to
+// DestEdge, to the node that Frame clones.
+void ReachabilityCloner::addClonedEdge(CloneFrame &Frame,
+                                       const DSNodeHandle &DestEdge) {
+  // Compute the offset into the current node at which to
+  // merge this link.  In the common case, this is a linear
+  // relation to the offset in the original node (with
+  // wrapping), but if the current node gets collapsed due to
+  // recursive merging, we must make sure to merge in all remaining
+  // links at offset zero.
+  unsigned MergeOffset = 0;
+  DSNode *CN = Frame.NH->getNode();
+  if (CN->getSize() != 1)
+    MergeOffset = (Frame.I->first + Frame.NH->getOffset()) % CN->getSize();
+  CN->addEdgeTo(MergeOffset, DestEdge);
+}
+
+// finishClonedNode - Once all links of the node that Frame clones are
+// copied, put its globals in the scalar map of the destination graph, and
+// return the handle for the source handle that Frame was made for.
+DSNodeHandle ReachabilityCloner::finishClonedNode(CloneFrame &Frame) {
+  const DSNode *SN = Frame.SrcNH->getNode();
+  DSNodeHandle &NH = *Frame.NH;
 
   // If this node contains any globals, make sure they end up in the scalar
   // map with the correct offset.
@@ -821,20 +935,58 @@ DSNodeHandle ReachabilityCloner::getClonedNH(const DSNodeHandle &SrcNH) {
        I != E; ++I) {
     const GlobalValue *GV = *I;
     const DSNodeHandle &SrcGNH = Src->getNodeForValue(GV);
-    DSNodeHandle &DestGNH = NodeMap[SrcGNH.getNode()];
+    DSNodeHandle &DestGNH = getMappedNH(SrcGNH.getNode());
     assert(DestGNH.getNode() == NH.getNode() &&"Global mapping inconsistent");
     Dest->getNodeForValue(GV).mergeWith(DSNodeHandle(DestGNH.getNode(),
                                                      DestGNH.getOffset()+SrcGNH.getOffset()));
   }
   NH.getNode()->mergeGlobals(*SN);
 
-  DSNode* NHN = NH.getNode();
-  unsigned NewOffset = NH.getOffset() + SrcNH.getOffset();
-  if (NHN) {
-    NHN->checkOffsetFoldIfNeeded(NewOffset);
-    NHN = NH.getNode();
+  return getOffsetNH(NH, Frame.SrcNH->getOffset());
+}
+
+DSNodeHandle ReachabilityCloner::getClonedNH(const DSNodeHandle &SrcNH) {
+  DSNodeHandle Result;
+  if (findClonedNH(SrcNH, Result))
+    return Result;
+
+  // Clone all outgoing links, and the new nodes they lead to, depth first.
+  // The walk keeps its own stack so that long chains of nodes cannot
+  // overflow the native one.  Note that adding these links can cause a node
+  // to collapse itself at any time, and the node may be merged with
+  // arbitrary other nodes.  For this reason, we must always go through the
+  // handle in the node map.
+  SmallVector<CloneFrame, 16> Stack;
+  CloneFrame Root = { &SrcNH, &getMappedNH(SrcNH.getNode()),
+                      SrcNH.getNode()->edge_begin(),
+                      SrcNH.getNode()->edge_end() };
+  Stack.push_back(Root);
+  while (true) {
+    CloneFrame &Frame = Stack.back();
+    if (Frame.I != Frame.E) {
+      const DSNodeHandle &SrcEdge = Frame.I->second;
+      if (!SrcEdge.isNull()) {
+        DSNodeHandle DestEdge;
+        if (!findClonedNH(SrcEdge, DestEdge)) {
+          const DSNode *SN = SrcEdge.getNode();
+          CloneFrame Next = { &SrcEdge, &getMappedNH(SN),
+                              SN->edge_begin(), SN->edge_end() };
+          Stack.push_back(Next);
+          continue;
+        }
+        addClonedEdge(Frame, DestEdge);
+      }
+      ++Frame.I;
+      continue;
+    }
+
+    Result = finishClonedNode(Frame);
+    Stack.pop_back();
+    if (Stack.empty())
+      return Result;
+    addClonedEdge(Stack.back(), Result);
+    ++Stack.back().I;
   }
-  return DSNodeHandle(NHN, NewOffset);
 }
 
 void ReachabilityCloner::merge(const DSNodeHandle &NH,
@@ -851,7 +1003,7 @@ void ReachabilityCloner::merge(const DSNodeHandle &NH,
   // node that need to be merged.  Check to see if the source node has already
   // been cloned.
   const DSNode *SN = SrcNH.getNode();
-  DSNodeHandle &SCNH = NodeMap[SN];  // SourceClonedNodeHandle
+  DSNodeHandle &SCNH = getMappedNH(SN);  // SourceClonedNodeHandle
   if (!SCNH.isNull()) {   // Node already cloned?
     DSNode *SCNHN = SCNH.getNode();
     NH.mergeWith(DSNodeHandle(SCNHN,
@@ -948,7 +1100,7 @@ void ReachabilityCloner::merge(const DSNodeHandle &NH,
            E = SN->globals_end(); I != E; ++I) {
         const GlobalValue *GV = *I;
         const DSNodeHandle &SrcGNH = Src->getNodeForValue(GV);
-        DSNodeHandle &DestGNH = NodeMap[SrcGNH.getNode()];
+        DSNodeHandle &DestGNH = getMappedNH(SrcGNH.getNode());
         assert(DestGNH.getNode()==NH.getNode() &&"Global mapping inconsistent");
         Dest->getNodeForValue(GV).mergeWith(DSNodeHandle(DestGNH.getNode(),
                                                          DestGNH.getOffset()+SrcGNH.getOffset()));
@@ -958,7 +1110,7 @@ void ReachabilityCloner::merge(const DSNodeHandle &NH,
   } else {
     // We cannot handle this case without allocating a temporary node.  Fall
     // back on being simple.
-    DSNode *NewDN = new DSNode(*SN, Dest, true /* Null out all links */);
+    DSNode *NewDN = new (Dest) DSNode(*SN, Dest, true /* Null out all links */);
     NewDN->maskNodeTypes(BitsToKeep);
 
 #ifndef NDEBUG
@@ -983,7 +1135,7 @@ void ReachabilityCloner::merge(const DSNodeHandle &NH,
          E = SN->globals_end(); I != E; ++I) {
       const GlobalValue *GV = *I;
       const DSNodeHandle &SrcGNH = Src->getNodeForValue(GV);
-      DSNodeHandle &DestGNH = NodeMap[SrcGNH.getNode()];
+      DSNodeHandle &DestGNH = getMappedNH(SrcGNH.getNode());
       assert(DestGNH.getNode()==NH.getNode() &&"Global mapping inconsistent");
       assert(SrcGNH.getNode() == SN && "Global mapping inconsistent");
       Dest->getNodeForValue(GV).mergeWith(DSNodeHandle(DestGNH.getNode(),
@@ -1061,6 +1213,20 @@ void ReachabilityCloner::mergeCallSite(DSCallSite &DestCS,
   }
 }
 
+/// mergeCallSites - Merge the nodes reachable from each of the src call
+/// sites into the nodes reachable from the dest call site at the same
+/// position, in order.
+void ReachabilityCloner::mergeCallSites(std::vector<DSCallSite> &DestCSs,
+                                   const std::vector<const DSCallSite*> &SrcCSs) {
+  assert(DestCSs.size() == SrcCSs.size() && "Call sites do not pair up!");
+
+  // Most of the source graph is usually reached by one call site or another,
+  // so make room for all of it at once.
+  NodeIndex.resize(Src->getGraphSize() * 4 / 3 + 1);
+  for (unsigned i = 0, e = DestCSs.size(); i != e; ++i)
+    mergeCallSite(DestCSs[i], *SrcCSs[i]);
+}
+
 DSCallSite ReachabilityCloner::cloneCallSite(const DSCallSite& SrcCS) {
   std::vector<DSNodeHandle> Args;
   for(unsigned x = 0; x < SrcCS.getNumPtrArgs(); ++x)
@@ -1339,6 +1505,35 @@ void DataStructures::formGlobalFunctionList() {
   GlobalFunctionList.swap(List);
 }
 
+/// getGraphCachePath - Return the name of the file in which the graphs of
+/// the pass with the given print name are kept.
+static std::string getGraphCachePath(const char *PrintName) {
+  SmallString<128> Path(DSACacheDir.begin(), DSACacheDir.end());
+  sys::path::append(Path, Twine(PrintName) + "graphs");
+  return Path.str();
+}
+
+DSGraphCache &DataStructures::getGraphCache() const {
+  DSGraphCache &Cache = DSGraphCache::get(printname);
+  if (!DSACacheDir.empty())
+    Cache.load(getGraphCachePath(printname));
+  return Cache;
+}
+
+void DataStructures::saveGraphCache(const Module &M) const {
+  if (DSACacheDir.empty()) return;
+  bool Existed;
+  std::string Error;
+  if (error_code EC = sys::fs::create_directories(Twine(DSACacheDir),
+                                                  Existed))
+    Error = EC.message();
+  else
+    getGraphCache().save(getGraphCachePath(printname), M, Error);
+  if (!Error.empty())
+    errs() << "Warning: DSA graphs not saved in '" << DSACacheDir << "': "
+           << Error << "\n";
+}
+
 
 void DataStructures::formGlobalECs() {
   // Grow the equivalence classes for the globals to include anything that we
@@ -0,0 +1,480 @@
+//===- DataStructureAA.cpp - Data Structure Based Alias Analysis ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file was developed by the LLVM research group and is distributed under
+// the University of Illinois Open Source License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This pass uses the top-down data structure graphs to implement a simple
+// context sensitive alias analysis.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "ds-aa"
+
+#include "dsa/DataStructureAA.h"
+#include "dsa/DataStructure.h"
+#include "dsa/DSGraph.h"
+
+#include "llvm/Function.h"
+#include "llvm/GlobalValue.h"
+#include "llvm/Instructions.h"
+#include "llvm/Module.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+using namespace llvm;
+
+namespace {
+  RegisterPass<DSAA> X("ds-aa", "Data Structure Graph Based Alias Analysis");
+
+  // Register as an implementation of AliasAnalysis
+  RegisterAnalysisGroup<AliasAnalysis> Y(X);
+
+  STATISTIC (NumCachedQueries, "Number of alias queries answered from cache");
+  STATISTIC (NumNoAlias, "Number of alias queries answered NoAlias by DSA");
+  STATISTIC (NumCheckedPairs, "Number of batch alias answers checked");
+}
+
+char DSAA::ID;
+
+namespace {
+  /// AliasKey - Two ranges of memory, each a node number, an offset into the
+  /// node and a size, with the smaller range first.
+  struct AliasKey {
+    unsigned Node1, Offset1, Node2, Offset2;
+    uint64_t Size1, Size2;
+  };
+
+  struct AliasKeyInfo {
+    static AliasKey getEmptyKey() {
+      AliasKey K = { ~0U, 0, 0, 0, 0, 0 };
+      return K;
+    }
+    static AliasKey getTombstoneKey() {
+      AliasKey K = { ~0U - 1, 0, 0, 0, 0, 0 };
+      return K;
+    }
+    static unsigned getHashValue(const AliasKey &K) {
+      return hash_combine(K.Node1, K.Offset1, K.Size1,
+                          K.Node2, K.Offset2, K.Size2);
+    }
+    static bool isEqual(const AliasKey &L, const AliasKey &R) {
+      return L.Node1 == R.Node1 && L.Offset1 == R.Offset1 &&
+             L.Size1 == R.Size1 && L.Node2 == R.Node2 &&
+             L.Offset2 == R.Offset2 && L.Size2 == R.Size2;
+    }
+  };
+}
+
+struct DSAA::Pointer {
+  GraphCache *Cache;
+  unsigned Node;
+  unsigned Offset;
+  uint64_t Size;
+
+  Pointer() : Cache(0), Node(0), Offset(0), Size(0) {}
+};
+
+struct DSAA::GraphCache {
+  /// Nodes - The nodes that the pointers of the graph point to, by number.
+  std::vector<const DSNode*> Nodes;
+
+  /// Pointers - The node number and offset of each value in the scalar map.
+  DenseMap<const Value*, std::pair<unsigned, unsigned> > Pointers;
+
+  /// NoAlias - Whether two ranges were found not to alias.
+  DenseMap<AliasKey, bool, AliasKeyInfo> NoAlias;
+};
+
+// getFnForValue - Return the function that a local value belongs to, or null
+// for a value that is not local to a function.
+static const Function *getFnForValue(const Value *V) {
+  if (const Instruction *I = dyn_cast<Instruction>(V))
+    return I->getParent()->getParent();
+  if (const Argument *A = dyn_cast<Argument>(V))
+    return A->getParent();
+  if (const BasicBlock *BB = dyn_cast<BasicBlock>(V))
+    return BB->getParent();
+  return 0;
+}
+
+// isOpaque - Return true if pointers that DSA does not track may point into
+// the memory of N.
+static bool isOpaque(const DSNode *N) {
+  return N->isUnknownNode() || N->isIntToPtrNode();
+}
+
+// isClosed - Return true if every pointer to the memory of N, and every
+// access to it, is known to the graph of N.
+static bool isClosed(const DSNode *N) {
+  return N->isCompleteNode() && !isOpaque(N) && !N->isPtrToIntNode();
+}
+
+bool DSAA::runOnModule(Module &M) {
+  InitializeAliasAnalysis(this);
+  TD = &getAnalysis<TDDataStructures>();
+  invalidateCaches();
+  return false;
+}
+
+void DSAA::getAnalysisUsage(AnalysisUsage &AU) const {
+  AliasAnalysis::getAnalysisUsage(AU);
+  AU.setPreservesAll();                         // Does not transform code
+  AU.addRequiredTransitive<TDDataStructures>(); // Uses TD Datastructures
+}
+
+//
+// Method: getCache()
+//
+// Description:
+//  Return the cache of the specified graph, numbering its nodes and finding
+//  the node and offset of each value in its scalar map the first time.
+//
+DSAA::GraphCache *DSAA::getCache(DSGraph *G) {
+  GraphCache *&Cache = Caches[G];
+  if (Cache)
+    return Cache;
+
+  Cache = new GraphCache();
+  DenseMap<const DSNode*, unsigned> NodeNumbers;
+  DSScalarMap &SM = G->getScalarMap();
+  for (DSScalarMap::iterator I = SM.begin(), E = SM.end(); I != E; ++I) {
+    const DSNode *N = I->second.getNode();
+    if (!N)
+      continue;
+    std::pair<DenseMap<const DSNode*, unsigned>::iterator, bool> NI =
+      NodeNumbers.insert(std::make_pair(N, (unsigned)Cache->Nodes.size()));
+    if (NI.second)
+      Cache->Nodes.push_back(N);
+    Cache->Pointers[I->first] =
+      std::make_pair(NI.first->second, I->second.getOffset());
+  }
+  return Cache;
+}
+
+//
+// Method: getGraphForValues()
+//
+// Description:
+//  Return the graph to use for a query about the specified locations: the
+//  graph of the first function that one of them is local to, or the globals
+//  graph if none of them is.
+//
+DSGraph *DSAA::getGraphForValues(const Location *Locs, unsigned NumLocs) {
+  for (unsigned i = 0; i != NumLocs; ++i) {
+    const Function *F = getFnForValue(Locs[i].Ptr);
+    if (F && TD->hasDSGraph(*F))
+      return TD->getDSGraph(*F);
+  }
+  return TD->getGlobalsGraph();
+}
+
+//
+// Method: findPointer()
+//
+// Description:
+//  Find the node and offset that the specified location has in the graph.
+//  If DSA does not know the pointer, the cache of the result is left null.
+//
+void DSAA::findPointer(DSGraph *G, const Location &Loc, Pointer &P) {
+  GraphCache *Cache = getCache(G);
+  const Value *V = Loc.Ptr;
+  DenseMap<const Value*, std::pair<unsigned, unsigned> >::iterator I =
+    Cache->Pointers.find(V);
+  if (I == Cache->Pointers.end()) {
+    V = V->stripPointerCasts();
+    if (const GlobalValue *GV = dyn_cast<GlobalValue>(V))
+      V = G->getScalarMap().getLeaderForGlobal(GV);
+    I = Cache->Pointers.find(V);
+    if (I == Cache->Pointers.end())
+      return;
+  }
+
+  P.Cache = Cache;
+  P.Node = I->second.first;
+  P.Offset = I->second.second;
+  P.Size = Loc.Size;
+}
+
+//
+// Method: isNoAlias()
+//
+// Description:
+//  Return true if the graph shows that the specified pointers cannot alias.
+//  The answer for each pair of ranges is kept in the cache of the graph.
+//
+bool DSAA::isNoAlias(const Pointer &P1, const Pointer &P2) {
+  if (!P1.Cache || P1.Cache != P2.Cache)
+    return false;
+
+  AliasKey K = { P1.Node, P1.Offset, P2.Node, P2.Offset, P1.Size, P2.Size };
+  if (P2.Node < P1.Node ||
+      (P2.Node == P1.Node && (P2.Offset < P1.Offset ||
+                              (P2.Offset == P1.Offset && P2.Size < P1.Size)))) {
+    std::swap(K.Node1, K.Node2);
+    std::swap(K.Offset1, K.Offset2);
+    std::swap(K.Size1, K.Size2);
+  }
+
+  std::pair<DenseMap<AliasKey, bool, AliasKeyInfo>::iterator, bool> I =
+    P1.Cache->NoAlias.insert(std::make_pair(K, false));
+  if (!I.second) {
+    ++NumCachedQueries;
+    return I.first->second;
+  }
+
+  //
+  // We can only make a judgment if one of the nodes is complete and neither
+  // may be reached by pointers made out of integers.
+  //
+  const DSNode *N1 = P1.Cache->Nodes[K.Node1];
+  const DSNode *N2 = P1.Cache->Nodes[K.Node2];
+  if (isOpaque(N1) || isOpaque(N2) || !(isClosed(N1) || isClosed(N2)))
+    return false;
+
+  bool Result;
+  if (N1 != N2) {
+    Result = true;      // Completely different nodes.
+  } else if (N1->isCollapsedNode() || K.Size1 == UnknownSize) {
+    Result = false;
+  } else {
+    //
+    // The ranges of the same node do not overlap if the first ends before the
+    // second begins.  The elements of an array node are folded together, so
+    // the second range must also end within the node.
+    //
+    Result = K.Offset1 + K.Size1 <= K.Offset2;
+    if (Result && N1->isArrayNode())
+      Result = K.Size2 != UnknownSize &&
+               K.Offset2 + K.Size2 <= N1->getSize();
+  }
+
+  I.first->second = Result;
+  return Result;
+}
+
+//
+// Method: invalidateCache()
+//
+// Description:
+//  Forget what is known about the graph that the specified value is in, or
+//  about every graph if the value is not local to a function.
+//
+void DSAA::invalidateCache(const Value *V) {
+  const Function *F = getFnForValue(V);
+  if (!F) {
+    invalidateCaches();
+    return;
+  }
+  if (!TD->hasDSGraph(*F))
+    return;
+
+  DenseMap<const DSGraph*, GraphCache*>::iterator I =
+    Caches.find(TD->getDSGraph(*F));
+  if (I != Caches.end()) {
+    delete I->second;
+    Caches.erase(I);
+  }
+}
+
+void DSAA::invalidateCaches() {
+  for (DenseMap<const DSGraph*, GraphCache*>::iterator I = Caches.begin(),
+       E = Caches.end(); I != E; ++I)
+    delete I->second;
+  Caches.clear();
+}
+
+AliasAnalysis::AliasResult DSAA::alias(const Location &LocA,
+                                       const Location &LocB) {
+  if (LocA.Ptr == LocB.Ptr)
+    return AliasAnalysis::alias(LocA, LocB);
+
+  Location Locs[2] = { LocA, LocB };
+  DSGraph *G = getGraphForValues(Locs, 2);
+  Pointer PA, PB;
+  findPointer(G, LocA, PA);
+  findPointer(G, LocB, PB);
+  if (isNoAlias(PA, PB)) {
+    ++NumNoAlias;
+    return NoAlias;
+  }
+
+  // FIXME: we could improve on this by checking the globals graph for aliased
+  // global queries...
+  return AliasAnalysis::alias(LocA, LocB);
+}
+
+//
+// Method: findPointers()
+//
+// Description:
+//  Find the node and offset of each of the specified locations in the graph
+//  of a batch query.  Locations that are not local to a function are also
+//  found in the globals graph, which is where alias() looks when neither
+//  pointer of a query is local.
+//
+void DSAA::findPointers(DSGraph *G, ArrayRef<Location> Locs,
+                        SmallVectorImpl<Pointer> &InGraph,
+                        SmallVectorImpl<Pointer> &InGlobals) {
+  DSGraph *GG = TD->getGlobalsGraph();
+  InGraph.resize(Locs.size());
+  InGlobals.resize(Locs.size());
+  for (unsigned i = 0, e = Locs.size(); i != e; ++i) {
+    findPointer(G, Locs[i], InGraph[i]);
+    if (getFnForValue(Locs[i].Ptr))
+      continue;
+    if (G == GG)
+      InGlobals[i] = InGraph[i];
+    else
+      findPointer(GG, Locs[i], InGlobals[i]);
+  }
+}
+
+//
+// Method: aliasMany()
+//
+// Description:
+//  Answer an alias query for every pair of a location in LocsA and a
+//  location in LocsB.  Each location is looked up in each graph once, and
+//  the pairs that DSA cannot answer are passed on to the next alias
+//  analysis.
+//
+void DSAA::aliasMany(ArrayRef<Location> LocsA, ArrayRef<Location> LocsB,
+                     SmallVectorImpl<AliasResult> &Results) {
+  Results.clear();
+  if (LocsA.empty() || LocsB.empty())
+    return;
+
+  DSGraph *G = getGraphForValues(LocsA.data(), LocsA.size());
+  if (G == TD->getGlobalsGraph())
+    G = getGraphForValues(LocsB.data(), LocsB.size());
+
+  SmallVector<Pointer, 16> PointersA, GlobalsA, PointersB, GlobalsB;
+  findPointers(G, LocsA, PointersA, GlobalsA);
+  findPointers(G, LocsB, PointersB, GlobalsB);
+
+  Results.reserve(LocsA.size() * LocsB.size());
+  for (unsigned i = 0, e = LocsA.size(); i != e; ++i) {
+    bool LocalA = getFnForValue(LocsA[i].Ptr) != 0;
+    for (unsigned j = 0, f = LocsB.size(); j != f; ++j) {
+      bool Local = LocalA || getFnForValue(LocsB[j].Ptr) != 0;
+      if (LocsA[i].Ptr != LocsB[j].Ptr &&
+          isNoAlias(Local ? PointersA[i] : GlobalsA[i],
+                    Local ? PointersB[j] : GlobalsB[j])) {
+        ++NumNoAlias;
+        Results.push_back(NoAlias);
+      } else {
+        Results.push_back(AliasAnalysis::alias(LocsA[i], LocsB[j]));
+      }
+    }
+  }
+}
+
+/// getModRefInfo - does a callsite modify or reference a value?
+///
+/// The graph of the caller holds what the callee does to the memory that
+/// the caller can reach, so memory in a complete node that is never written
+/// or read in that graph is not written or read by the call either.
+///
+AliasAnalysis::ModRefResult
+DSAA::getModRefInfo(ImmutableCallSite CS, const Location &Loc) {
+  const Function *Caller = CS.getInstruction()->getParent()->getParent();
+  if (!TD->hasDSGraph(*Caller))
+    return AliasAnalysis::getModRefInfo(CS, Loc);
+
+  Pointer P;
+  findPointer(TD->getDSGraph(*Caller), Loc, P);
+  if (!P.Cache)
+    return AliasAnalysis::getModRefInfo(CS, Loc);
+
+  const DSNode *N = P.Cache->Nodes[P.Node];
+  if (!isClosed(N))
+    return AliasAnalysis::getModRefInfo(CS, Loc);
+
+  ModRefResult Result = ModRef;
+  if (!N->isModifiedNode())   // We proved it was not modified.
+    Result = ModRefResult(Result & ~Mod);
+  if (!N->isReadNode())       // We proved it was not read.
+    Result = ModRefResult(Result & ~Ref);
+  if (Result == NoModRef)
+    return Result;
+  return ModRefResult(Result & AliasAnalysis::getModRefInfo(CS, Loc));
+}
+
+void DSAA::deleteValue(Value *V) {
+  invalidateCache(V);
+  TD->deleteValue(V);
+  AliasAnalysis::deleteValue(V);
+}
+
+void DSAA::copyValue(Value *From, Value *To) {
+  if (From == To) return;
+  invalidateCache(From);
+  TD->copyValue(From, To);
+  AliasAnalysis::copyValue(From, To);
+}
+
+namespace {
+  /// DSAAChecker - A pass used by the regression tests to check that the
+  /// answers of DSAA::aliasMany() are the answers that DSAA::alias() gives
+  /// for each pair.  In each function, it asks about every pair of the
+  /// locations read or written and the pointers, and aborts if an answer
+  /// differs.
+  struct DSAAChecker : public ModulePass {
+    static char ID;
+    DSAAChecker() : ModulePass(ID) {}
+
+    virtual bool runOnModule(Module &M);
+    virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+      AU.addRequired<DSAA>();
+      AU.setPreservesAll();
+    }
+  };
+
+  RegisterPass<DSAAChecker> C("ds-aa-check",
+                              "Check DSAA batch queries against single ones");
+}
+
+char DSAAChecker::ID;
+
+bool DSAAChecker::runOnModule(Module &M) {
+  DSAA &AA = getAnalysis<DSAA>();
+  for (Module::iterator F = M.begin(), FE = M.end(); F != FE; ++F) {
+    SmallVector<AliasAnalysis::Location, 32> Locs;
+    for (Function::arg_iterator A = F->arg_begin(), AE = F->arg_end();
+         A != AE; ++A)
+      if (A->getType()->isPointerTy())
+        Locs.push_back(AliasAnalysis::Location(A));
+    for (Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+      for (BasicBlock::iterator I = BB->begin(), E = BB->end(); I != E; ++I) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(I))
+          Locs.push_back(AA.getLocation(LI));
+        else if (StoreInst *SI = dyn_cast<StoreInst>(I))
+          Locs.push_back(AA.getLocation(SI));
+        if (I->getType()->isPointerTy())
+          Locs.push_back(AliasAnalysis::Location(I));
+      }
+
+    SmallVector<AliasAnalysis::AliasResult, 64> Results;
+    AA.aliasMany(Locs, Locs, Results);
+    for (unsigned i = 0, e = Locs.size(); i != e; ++i)
+      for (unsigned j = 0; j != e; ++j) {
+        AliasAnalysis::AliasResult Single = AA.alias(Locs[i], Locs[j]);
+        if (Results[i * e + j] != Single) {
+          errs() << "ERROR: aliasMany and alias differ in " << F->getName()
+                 << " for\n  " << *Locs[i].Ptr << ", size " << Locs[i].Size
+                 << "\n  " << *Locs[j].Ptr << ", size " << Locs[j].Size
+                 << "\n  aliasMany: " << Results[i * e + j]
+                 << ", alias: " << Single << "\n";
+          abort();
+        }
+        ++NumCheckedPairs;
+      }
+  }
+  return false;
+}
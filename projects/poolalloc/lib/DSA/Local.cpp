@@ -16,9 +16,13 @@
 
 #include "dsa/DataStructure.h"
 #include "dsa/DSGraph.h"
+#include "dsa/DSGraphImage.h"
 
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Constants.h"
 #include "llvm/DataLayout.h"
@@ -31,6 +35,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/GetElementPtrTypeIterator.h"
+#include "llvm/Support/InstIterator.h"
 #include "llvm/Support/InstVisitor.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Use.h"
@@ -52,6 +57,7 @@ STATISTIC(NumIntrinsicCall, "Number of intrinsics called");
 STATISTIC(NumBoringIntToPtr, "Number of inttoptr used only in cmp");
 //STATISTIC(NumSimpleIntToPtr, "Number of inttoptr from ptrtoint");
 STATISTIC(NumIgnoredInst,       "Number of instructions ignored");
+STATISTIC(NumReusedGraphs,  "Number of local graphs reused");
 
 RegisterPass<LocalDataStructures>
 X("dsa-local", "Local Data Structure Analysis");
@@ -63,6 +69,10 @@ cl::opt<bool> TypeInferenceOptimize("enable-type-inference-opts",
                                     cl::desc("Enable Type Inference Optimizations added to DSA."),
                                     cl::Hidden,
                                     cl::init(false));
+cl::opt<bool> DSAIncremental("dsa-incremental",
+         cl::desc("Reuse the graphs of unchanged code from earlier DSA runs"),
+         cl::Hidden,
+         cl::init(false));
 
 namespace {
   //===--------------------------------------------------------------------===//
@@ -89,7 +99,7 @@ namespace {
     ///
     DSNode *createNode() 
     {   
-      DSNode* ret = new DSNode(&G);
+      DSNode* ret = new (&G) DSNode(&G);
       assert(ret->getParentGraph() && "No parent?");
       return ret;
     }
@@ -202,8 +212,7 @@ namespace {
       g.computeExternalFlags(EFlags);
       g.computeIntPtrFlags();
 
-      // Remove any nodes made dead due to merging...
-      g.removeDeadNodes(DSGraph::KeepUnreachableGlobals);
+      // Nodes made dead due to merging are removed by the caller.
     }
 
     // GraphBuilder ctor for working on the globals graph
@@ -1437,6 +1446,67 @@ void handleMagicSections(DSGraph* GlobalsGraph, Module& M) {
   }
 }
 
+/// addUsedGlobals - Add the global values used by the constant C to Used.
+static void addUsedGlobals(const Constant *C,
+                           SmallPtrSet<const Constant*, 16> &Visited,
+                           std::vector<const GlobalValue*> &Used) {
+  if (!Visited.insert(C)) return;
+  if (const GlobalValue *GV = dyn_cast<GlobalValue>(C)) {
+    Used.push_back(GV);
+    return;
+  }
+  for (User::const_op_iterator I = C->op_begin(), E = C->op_end(); I != E; ++I)
+    if (const Constant *Op = dyn_cast<Constant>(*I))
+      addUsedGlobals(Op, Visited, Used);
+}
+
+/// getLocalGraphKey - Compute the fingerprint of everything the local graph
+/// of F is built from: the body of F, the options of the pass, the
+/// equivalence classes of the globals F uses, and the part of the globals
+/// graph that is merged in for the constant ones.  Return false if some of
+/// it cannot be fingerprinted.
+static bool getLocalGraphKey(const Function &F, DSGraph &GG, DSValueTable &VT,
+                             uint64_t &Key) {
+  SmallPtrSet<const Constant*, 16> Visited;
+  std::vector<const GlobalValue*> Used;
+  for (const_inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I)
+    for (User::const_op_iterator OI = I->op_begin(), OE = I->op_end();
+         OI != OE; ++OI)
+      if (const Constant *C = dyn_cast<Constant>(*OI))
+        addUsedGlobals(C, Visited, Used);
+
+  hash_code H = hash_combine(VT.getFingerprint(F),
+                             GG.getDataLayout().getStringRepresentation(),
+                             (bool)TypeInferenceOptimize,
+                             StringRef(hasMagicSections));
+
+  // Globals are found in the same order in functions with equal bodies.  The
+  // graph refers to the leader of the equivalence class of each global, but
+  // only the class matters.
+  EquivalenceClasses<const GlobalValue*> &ECs = GG.getGlobalECs();
+  std::vector<const GlobalValue*> Constants;
+  for (unsigned i = 0, e = Used.size(); i != e; ++i) {
+    const GlobalValue *Rep = DSGraphImage::getRepresentative(ECs, Used[i]);
+    if (!Rep->hasName()) return false;
+    H = hash_combine(H, Rep->getName());
+
+    const GlobalValue *Leader = Used[i];
+    EquivalenceClasses<const GlobalValue*>::iterator EC = ECs.findValue(Leader);
+    if (EC != ECs.end())
+      Leader = *ECs.findLeader(EC);
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(Leader))
+      if (GV->isConstant())
+        Constants.push_back(GV);
+  }
+  if (!Constants.empty()) {
+    DSGraphImage Image;
+    if (!Image.capture(GG, VT, &Constants)) return false;
+    H = hash_combine(H, Image.getFingerprint());
+  }
+  Key = H;
+  return true;
+}
+
 char LocalDataStructures::ID;
 
 bool LocalDataStructures::runOnModule(Module &M) {
@@ -1477,11 +1547,37 @@ bool LocalDataStructures::runOnModule(Module &M) {
   formGlobalFunctionList();
   GlobalsGraph->maskIncompleteMarkers();
 
+  // In the incremental mode, the graphs of functions that have not changed
+  // are restored from the cache instead of being built again.
+  OwningPtr<DSValueTable> VT;
+  if (DSAIncremental)
+    VT.reset(new DSValueTable(M));
+  DSGraphCache &Cache = getGraphCache();
+
   // Calculate all of the graphs...
   for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I)
     if (!I->isDeclaration()) {
       DSGraph* G = new DSGraph(GlobalECs, getDataLayout(), *TypeSS, GlobalsGraph);
-      GraphBuilder GGB(*I, *G, *this);
+      uint64_t Key;
+      if (VT && getLocalGraphKey(*I, *GlobalsGraph, *VT, Key)) {
+        DSGraphCache::Entry *Cached = Cache.lookup(I->getName());
+        if (Cached && Cached->Key == Key && Cached->restore(*G, *VT)) {
+          ++NumReusedGraphs;
+        } else {
+          GraphBuilder GGB(*I, *G, *this);
+          DSGraphCache::Entry New;
+          New.Key = Key;
+          New.Functions.push_back(I->getName());
+          if (New.Image.capture(*G, *VT))
+            Cache.insert(New);
+        }
+      } else {
+        GraphBuilder GGB(*I, *G, *this);
+      }
+      // Remove any nodes made dead due to merging.  This also copies what the
+      // graph knows about globals to the globals graph, so it is done after
+      // the graph is saved.
+      G->removeDeadNodes(DSGraph::KeepUnreachableGlobals);
       G->getAuxFunctionCalls() = G->getFunctionCalls();
       setDSGraph(*I, G);
       propagateUnknownFlag(G);
@@ -1497,6 +1593,9 @@ bool LocalDataStructures::runOnModule(Module &M) {
       DEBUG(G->AssertGraphOK());
     }
 
+  if (VT)
+    saveGraphCache(M);
+
   //GlobalsGraph->removeTriviallyDeadNodes();
   GlobalsGraph->markIncompleteNodes(DSGraph::MarkFormalArgs
                                     |DSGraph::IgnoreGlobals);
@@ -19,14 +19,30 @@
 #include "llvm/Module.h"
 #include "llvm/DerivedTypes.h"
 #include "dsa/DSGraph.h"
+#include "dsa/DSGraphImage.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/Timer.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/OwningPtr.h"
 #include "llvm/ADT/Statistic.h"
+
+#include <algorithm>
+#include <pthread.h>
 using namespace llvm;
 
 #define TIME_REGION(VARNAME, DESC)
 
+// Defined in BottomUpClosure.cpp
+extern cl::opt<unsigned> DSAThreads;
+
+// Defined in Local.cpp
+extern cl::opt<bool> DSAIncremental;
+
 namespace {
   RegisterPass<TDDataStructures>   // Register the pass
   Y("dsa-td", "Top-down Data Structure Analysis");
@@ -35,11 +51,118 @@ namespace {
   Z("dsa-eqtd", "EQ Top-down Data Structure Analysis");
 
   STATISTIC (NumTDInlines, "Number of graphs inlined");
+  STATISTIC (NumReusedGraphs, "Number of TD graphs reused");
 }
 
 char TDDataStructures::ID;
 char EQTDDataStructures::ID;
 
+namespace {
+  /// SchedulerLock - Hold a lock for the lifetime of this object.  Nothing is
+  /// locked when graphs are not being processed in parallel.
+  class SchedulerLock {
+    sys::Mutex *M;
+  public:
+    explicit SchedulerLock(sys::Mutex *M) : M(M) {
+      if (M) M->acquire();
+    }
+    ~SchedulerLock() {
+      if (M) M->release();
+    }
+  };
+}
+
+/// GraphScheduler - This holds the graphs in reverse post-order while
+/// several threads inline callers into them.  A graph is ready once every
+/// graph that calls it, or that it calls and that comes before it in the
+/// order, is finished.  Ready graphs do not share any caller graph that is
+/// still being changed, so they can be processed at the same time.
+///
+/// The threads share the globals graph, the CallerEdges and IndCallMap
+/// tables, and the graphs of finished callers, which are read while they are
+/// inlined into their callees.  Each of these is guarded by a lock here.
+///
+struct TDDataStructures::GraphScheduler {
+  // Number of locks guarding the graphs of finished callers
+  enum { NumGraphLocks = 64 };
+
+  // Graphs in reverse post-order
+  std::vector<DSGraph*> Graphs;
+
+  // Graphs that must wait for each graph, and the number of graphs that each
+  // graph is waiting for
+  std::vector<std::vector<unsigned> > Waiting;
+  std::vector<unsigned> Pending;
+
+  // Graphs that are ready, and the number of graphs being processed
+  std::vector<unsigned> Ready;
+  unsigned Running;
+
+  // Guards Pending, Ready and Running
+  pthread_mutex_t QueueLock;
+  pthread_cond_t QueueChanged;
+
+  sys::Mutex GlobalsLock;
+  sys::Mutex EdgesLock;
+  sys::Mutex GraphLocks[NumGraphLocks];
+
+  GraphScheduler() : Running(0) {
+    pthread_mutex_init(&QueueLock, 0);
+    pthread_cond_init(&QueueChanged, 0);
+  }
+
+  ~GraphScheduler() {
+    pthread_cond_destroy(&QueueChanged);
+    pthread_mutex_destroy(&QueueLock);
+  }
+
+  static sys::Mutex *getGlobalsLock(GraphScheduler *S) {
+    return S ? &S->GlobalsLock : 0;
+  }
+
+  /// getEdgesLock - Return the lock guarding CallerEdges, IndCallMap and
+  /// the graphs in IndCallMap while callers are added to them.
+  static sys::Mutex *getEdgesLock(GraphScheduler *S) {
+    return S ? &S->EdgesLock : 0;
+  }
+
+  /// getGraphLock - Return the lock to hold while the finished graph G is
+  /// inlined into a callee.  Reading a graph can update the forwarding of
+  /// its node handles, so a graph must not be read by two threads at once.
+  static sys::Mutex *getGraphLock(GraphScheduler *S, const DSGraph *G) {
+    if (!S)
+      return 0;
+    return &S->GraphLocks[(reinterpret_cast<uintptr_t>(G) / sizeof(DSGraph))
+                          % NumGraphLocks];
+  }
+};
+
+/// IncrementalState - The graphs saved by earlier runs, and the fingerprints
+/// of the graphs finished by this run.  The graph of a group of functions is
+/// restored if its input graph is the same as when it was saved, and so are
+/// the graphs and call sites of all of its callers.  A change to a function
+/// is thus followed down to its callees and no further.
+struct TDDataStructures::IncrementalState {
+  DSValueTable Values;
+  DSGraphCache &Cache;
+
+  // Fingerprints of finished graphs.  A graph that could not be
+  // fingerprinted has the fingerprint 0.
+  DenseMap<const DSGraph*, uint64_t> Fingerprints;
+
+  IncrementalState(Module &M, DSGraphCache &Cache) : Values(M), Cache(Cache) {}
+
+  /// getFingerprint - Return the fingerprint of G.  Graphs of merged indirect
+  /// callers keep changing, so only finished graphs are remembered.
+  uint64_t getFingerprint(DSGraph *G) {
+    DenseMap<const DSGraph*, uint64_t>::iterator I = Fingerprints.find(G);
+    if (I != Fingerprints.end())
+      return I->second;
+    DSGraphImage Image;
+    return Image.capture(*G, Values) ? Image.getFingerprint() : 0;
+  }
+};
+
 TDDataStructures::~TDDataStructures() {
   releaseMemory();
 }
@@ -138,11 +261,30 @@ bool TDDataStructures::runOnModule(Module &M) {
 
 {TIME_REGION(XXX, "td:Inline stuff");
 
+  // In the incremental mode, graphs whose code and callers have not changed
+  // are restored from the cache.  Graphs are then processed by this thread
+  // alone, as a graph may be replaced by the one restored.
+  OwningPtr<IncrementalState> Inc;
+  if (DSAIncremental) {
+    Inc.reset(new IncrementalState(M, getGraphCache()));
+    Incremental = Inc.get();
+  }
+
+  // If several threads may be used, process graphs whose callers are all
+  // finished in parallel.
+  if (DSAThreads > 1 && !Incremental &&
+      (llvm_is_multithreaded() || llvm_start_multithreaded()))
+    inlineInParallel(PostOrder, DSAThreads);
+
   // Visit each of the graphs in reverse post-order now!
   while (!PostOrder.empty()) {
     InlineCallersIntoGraph(PostOrder.back());
     PostOrder.pop_back();
   }
+
+  if (Incremental)
+    saveGraphCache(M);
+  Incremental = 0;
 }
 
   // Free the IndCallMap.
@@ -227,11 +369,14 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
   // Inline caller graphs into this graph.  First step, get the list of call
   // sites that call into this graph.
   std::vector<CallerCallEdge> EdgesFromCaller;
-  std::map<DSGraph*, std::vector<CallerCallEdge> >::iterator
-    CEI = CallerEdges.find(DSG);
-  if (CEI != CallerEdges.end()) {
-    std::swap(CEI->second, EdgesFromCaller);
-    CallerEdges.erase(CEI);
+  {
+    SchedulerLock Guard(GraphScheduler::getEdgesLock(Scheduler));
+    std::map<DSGraph*, std::vector<CallerCallEdge> >::iterator
+      CEI = CallerEdges.find(DSG);
+    if (CEI != CallerEdges.end()) {
+      std::swap(CEI->second, EdgesFromCaller);
+      CallerEdges.erase(CEI);
+    }
   }
 
   // Sort the caller sites to provide a by-caller-graph ordering.
@@ -243,16 +388,44 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
   // then having RemoveDeadNodes clone it back, we should do all of this as a
   // post-pass over all of the graphs.  We need to take cloning out of
   // removeDeadNodes and gut removeDeadNodes at the same time first though. :(
-  cloneGlobalsInto(DSG, DSGraph::DontCloneCallNodes |
-                        DSGraph::DontCloneAuxCallNodes);
+  {
+    SchedulerLock Guard(GraphScheduler::getGlobalsLock(Scheduler));
+    cloneGlobalsInto(DSG, DSGraph::DontCloneCallNodes |
+                          DSGraph::DontCloneAuxCallNodes);
+  }
+
+  // If any of the functions is externally callable, treat everything in its
+  // SCC as externally callable.
+  bool isExternallyCallable = false;
+  for (DSGraph::retnodes_iterator I = DSG->retnodes_begin(),
+         E = DSG->retnodes_end(); I != E; ++I)
+    if (ExternallyCallable.count(I->first)) {
+      isExternallyCallable = true;
+      break;
+    }
+
+  // In the incremental mode, look for the finished graph in the cache.
+  uint64_t Key = 0;
+  bool HasKey = Incremental &&
+    getGraphKey(DSG, EdgesFromCaller, isExternallyCallable, Key);
+  bool Reused = false;
+  if (HasKey) {
+    if (DSGraph *Restored = reuseGraph(DSG, Key)) {
+      DSG = Restored;
+      EdgesFromCaller.clear();
+      Reused = true;
+    }
+  }
 
   DEBUG(errs() << "[TD] Inlining callers into '"
         << DSG->getFunctionNames() << "'\n");
 
-  DSG->maskIncompleteMarkers();
+  if (!Reused)
+    DSG->maskIncompleteMarkers();
   // Iteratively inline caller graphs into this graph.
   while (!EdgesFromCaller.empty()) {
     DSGraph* CallerGraph = EdgesFromCaller.back().CallerGraph;
+    SchedulerLock Guard(GraphScheduler::getGraphLock(Scheduler, CallerGraph));
 
     // Iterate through all of the call sites of this graph, cloning and merging
     // any nodes required by the call.
@@ -260,7 +433,9 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
                           DSGraph::DontCloneCallNodes |
                           DSGraph::DontCloneAuxCallNodes);
 
-    // Inline all call sites from this caller graph.
+    // Inline all call sites from this caller graph in one batch.
+    std::vector<DSCallSite> Formals;
+    std::vector<const DSCallSite*> Actuals;
     do {
       const DSCallSite &CS = *EdgesFromCaller.back().CS;
       const Function &CF = *EdgesFromCaller.back().CalledFunction;
@@ -275,47 +450,39 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
       DEBUG(errs() << ": " << CF.getFunctionType()->getNumParams()
             << " args\n");
 
-      // Get the formal argument and return nodes for the called function and
-      // merge them with the cloned subgraph.
-      DSCallSite T1 = DSG->getCallSiteForArguments(CF);
-      RC.mergeCallSite(T1, CS);
+      // Get the formal argument and return nodes for the called function, to
+      // be merged with the cloned subgraph.
+      Formals.push_back(DSG->getCallSiteForArguments(CF));
+      Actuals.push_back(&CS);
       ++NumTDInlines;
 
       EdgesFromCaller.pop_back();
     } while (!EdgesFromCaller.empty() &&
              EdgesFromCaller.back().CallerGraph == CallerGraph);
+    RC.mergeCallSites(Formals, Actuals);
   }
 
 
 
   // Next, now that this graph is finalized, we need to recompute the
   // incompleteness markers for this graph and remove unreachable nodes.
+  // A restored graph already has its markers.
+  if (!Reused) {
+    // Recompute the Incomplete markers.  Depends on whether args are complete
+    unsigned IncFlags = DSGraph::IgnoreFormalArgs;
+    IncFlags |= DSGraph::IgnoreGlobals | DSGraph::MarkVAStart;
+    DSG->markIncompleteNodes(IncFlags);
+
+    // If this graph contains functions that are externally callable, now is
+    // the time to mark their arguments and return values as external.  At
+    // this point TD is inlining all caller information, and that means
+    // External callers too.
+    unsigned ExtFlags = isExternallyCallable ? DSGraph::MarkFormalsExternal
+                                             : DSGraph::DontMarkFormalsExternal;
+    DSG->computeExternalFlags(ExtFlags);
+    DSG->computeIntPtrFlags();
+  }
 
-  // If any of the functions is externally callable, treat everything in its
-  // SCC as externally callable.
-  bool isExternallyCallable = false;
-  for (DSGraph::retnodes_iterator I = DSG->retnodes_begin(),
-         E = DSG->retnodes_end(); I != E; ++I)
-    if (ExternallyCallable.count(I->first)) {
-      isExternallyCallable = true;
-      break;
-    }
-
-  // Recompute the Incomplete markers.  Depends on whether args are complete
-  unsigned IncFlags = DSGraph::IgnoreFormalArgs;
-  IncFlags |= DSGraph::IgnoreGlobals | DSGraph::MarkVAStart;
-  DSG->markIncompleteNodes(IncFlags);
-
-  // If this graph contains functions that are externally callable, now is the time to mark
-  // their arguments and return values as external.  At this point TD is inlining all caller information,
-  // and that means External callers too.
-  unsigned ExtFlags
-    = isExternallyCallable ? DSGraph::MarkFormalsExternal : DSGraph::DontMarkFormalsExternal;
-  DSG->computeExternalFlags(ExtFlags);
-  DSG->computeIntPtrFlags();
-
-  cloneIntoGlobals(DSG, DSGraph::DontCloneCallNodes |
-                        DSGraph::DontCloneAuxCallNodes);
   //
   // Delete dead nodes.  Treat globals that are unreachable as dead also.
   //
@@ -329,13 +496,31 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
   //
   //  So, for now, just remove dead nodes but leave the globals alone.
   //
-  DSG->removeDeadNodes(0);
+  //  Both steps update the globals graph.
+  //
+  //  A graph whose dead aux calls were moved to the globals graph is not
+  //  saved, as a restored graph would not move them again.
+  //
+  bool MovedCalls;
+  {
+    SchedulerLock Guard(GraphScheduler::getGlobalsLock(Scheduler));
+    cloneIntoGlobals(DSG, DSGraph::DontCloneCallNodes |
+                          DSGraph::DontCloneAuxCallNodes);
+    DSGraph::FunctionListTy &GGCalls = GlobalsGraph->getAuxFunctionCalls();
+    const DSCallSite *LastGGCall = GGCalls.empty() ? 0 : &GGCalls.back();
+    DSG->removeDeadNodes(0);
+    MovedCalls = (GGCalls.empty() ? 0 : &GGCalls.back()) != LastGGCall;
+  }
+
+  if (Incremental)
+    saveGraph(DSG, HasKey && !Reused && !MovedCalls, Key);
 
   // We are done with computing the current TD Graph!  Finally, before we can
   // finish processing this function, we figure out which functions it calls and
   // records these call graph edges, so that we have them when we process the
   // callee graphs.
   if (DSG->fc_begin() == DSG->fc_end()) return;
+  SchedulerLock EdgesGuard(GraphScheduler::getEdgesLock(Scheduler));
 
   // Loop over all the call sites and all the callees at each call site, and add
   // edges to the CallerEdges structure for each callee.
@@ -422,3 +607,216 @@ void TDDataStructures::InlineCallersIntoGraph(DSGraph* DSG) {
     }
   }
 }
+
+/// getFunctionNames - Return the sorted names of the functions of G, or
+/// false if one of them has no name.
+static bool getFunctionNames(DSGraph *G, std::vector<std::string> &Names) {
+  for (DSGraph::retnodes_iterator I = G->retnodes_begin(),
+         E = G->retnodes_end(); I != E; ++I) {
+    if (!I->first->hasName())
+      return false;
+    Names.push_back(I->first->getName());
+  }
+  std::sort(Names.begin(), Names.end());
+  return !Names.empty();
+}
+
+/// getGraphKey - Compute the key under which the finished graph of DSG is
+/// saved: the fingerprint of DSG before its callers are inlined, whether it
+/// is externally callable, and the fingerprints of the caller graphs along
+/// with the call sites and functions through which they are inlined.  Return
+/// false if one of these cannot be fingerprinted.
+bool TDDataStructures::getGraphKey(DSGraph *DSG,
+                                   const std::vector<CallerCallEdge> &Edges,
+                                   bool isExternallyCallable, uint64_t &Key) {
+  IncrementalState &Inc = *Incremental;
+  uint64_t Input = Inc.getFingerprint(DSG);
+  if (!Input)
+    return false;
+
+  // The edges are sorted by caller graph, so each graph is fingerprinted
+  // once.
+  std::vector<uint64_t> Callers;
+  DSGraph *CallerGraph = 0;
+  uint64_t CallerFP = 0;
+  for (unsigned i = 0, e = Edges.size(); i != e; ++i) {
+    if (Edges[i].CallerGraph != CallerGraph) {
+      CallerGraph = Edges[i].CallerGraph;
+      CallerFP = Inc.getFingerprint(CallerGraph);
+    }
+    const Instruction *I = Edges[i].CS->getCallSite().getInstruction();
+    const Function *F = I->getParent()->getParent();
+    unsigned Position;
+    if (!CallerFP || !F->hasName() || !Edges[i].CalledFunction->hasName() ||
+        !Inc.Values.getPosition(*F, I, Position))
+      return false;
+    Callers.push_back(hash_combine(CallerFP, F->getName(), Position,
+                                   Edges[i].CalledFunction->getName()));
+  }
+  std::sort(Callers.begin(), Callers.end());
+
+  hash_code Hash = hash_combine(Input, isExternallyCallable);
+  for (unsigned i = 0, e = Callers.size(); i != e; ++i)
+    Hash = hash_combine(Hash, Callers[i]);
+  Key = Hash;
+  return true;
+}
+
+/// reuseGraph - Restore the finished graph of the functions of DSG from the
+/// cache if it was saved under Key.  The graph restored replaces DSG, which
+/// is deleted.  Return the graph restored, or null if there is none.
+DSGraph *TDDataStructures::reuseGraph(DSGraph *DSG, uint64_t Key) {
+  IncrementalState &Inc = *Incremental;
+  std::vector<std::string> Functions;
+  if (!getFunctionNames(DSG, Functions))
+    return 0;
+  DSGraphCache::Entry *E = Inc.Cache.lookup(Functions.front());
+  if (!E || E->Key != Key || E->Functions != Functions)
+    return 0;
+
+  DSGraph *G = new DSGraph(GlobalECs, getDataLayout(), *TypeSS, GlobalsGraph);
+  G->setUseAuxCalls();
+  if (!E->restore(*G, Inc.Values)) {
+    delete G;
+    return 0;
+  }
+
+  for (DSGraph::retnodes_iterator I = DSG->retnodes_begin(),
+         RE = DSG->retnodes_end(); I != RE; ++I)
+    setDSGraph(*I->first, G);
+  delete DSG;
+  ++NumReusedGraphs;
+  return G;
+}
+
+/// saveGraph - Remember the fingerprint of the finished graph DSG for its
+/// callees, and save the graph in the cache under Key if Save is true.
+void TDDataStructures::saveGraph(DSGraph *DSG, bool Save, uint64_t Key) {
+  IncrementalState &Inc = *Incremental;
+  DSGraphCache::Entry E;
+  if (!E.Image.capture(*DSG, Inc.Values)) {
+    Inc.Fingerprints[DSG] = 0;
+    return;
+  }
+  Inc.Fingerprints[DSG] = E.Image.getFingerprint();
+  if (!Save || !getFunctionNames(DSG, E.Functions))
+    return;
+  E.Key = Key;
+  Inc.Cache.insert(E);
+}
+
+/// getCalleeGraphs - Find the graphs, other than G itself, that
+/// InlineCallersIntoGraph will record G as a caller of.
+void TDDataStructures::getCalleeGraphs(DSGraph* G,
+                                       std::vector<DSGraph*> &Callees) {
+  for (DSGraph::fc_iterator CI = G->fc_begin(), E = G->fc_end();
+       CI != E; ++CI) {
+    if (CI->isDirectCall()) {
+      if (!CI->getCalleeFunc()->isDeclaration() &&
+          !G->getReturnNodes().count(CI->getCalleeFunc()))
+        Callees.push_back(getDSGraph(*CI->getCalleeFunc()));
+      continue;
+    }
+
+    svset<const Function*> AllCallees;
+    callgraph.addFullFunctionSet(CI->getCallSite(), AllCallees);
+    for (svset<const Function*>::iterator I = AllCallees.begin(),
+         E = AllCallees.end(); I != E; ++I)
+      if (!(*I)->isDeclaration() && getDSGraph(**I) != G)
+        Callees.push_back(getDSGraph(**I));
+  }
+
+  std::sort(Callees.begin(), Callees.end());
+  Callees.erase(std::unique(Callees.begin(), Callees.end()), Callees.end());
+}
+
+/// inlineInParallel - Inline callers into the graphs in PostOrder using
+/// several threads, emptying PostOrder.
+///
+/// A graph waits for every graph that calls it and comes before it in
+/// reverse post-order, as in the serial walk.  It also waits for the graphs
+/// that it calls which come before it; the serial walk has finished those,
+/// so the edges it records to them are never used, and a graph of merged
+/// indirect callers that it adds to is not read while it is changed.
+void TDDataStructures::inlineInParallel(std::vector<DSGraph*> &PostOrder,
+                                        unsigned NumThreads) {
+  GraphScheduler S;
+  S.Graphs.assign(PostOrder.rbegin(), PostOrder.rend());
+  PostOrder.clear();
+
+  unsigned NumGraphs = S.Graphs.size();
+  DenseMap<DSGraph*, unsigned> Position;
+  for (unsigned i = 0; i != NumGraphs; ++i)
+    Position[S.Graphs[i]] = i;
+
+  S.Waiting.resize(NumGraphs);
+  S.Pending.resize(NumGraphs, 0);
+  for (unsigned i = 0; i != NumGraphs; ++i) {
+    std::vector<DSGraph*> Callees;
+    getCalleeGraphs(S.Graphs[i], Callees);
+    for (unsigned c = 0, e = Callees.size(); c != e; ++c) {
+      DenseMap<DSGraph*, unsigned>::iterator PI = Position.find(Callees[c]);
+      if (PI == Position.end())
+        continue;
+      unsigned First = std::min(i, PI->second);
+      unsigned Second = std::max(i, PI->second);
+      S.Waiting[First].push_back(Second);
+      ++S.Pending[Second];
+    }
+  }
+
+  // Ready graphs are taken from the back, so queue them in reverse order.
+  for (unsigned i = NumGraphs; i != 0; --i)
+    if (S.Pending[i - 1] == 0)
+      S.Ready.push_back(i - 1);
+
+  DEBUG(errs() << "[TD] Inlining callers into " << NumGraphs
+        << " graphs using " << NumThreads << " threads\n");
+
+  // Start the worker threads.  If a thread cannot be created, the work is
+  // done by the threads that could be, and by this thread.
+  Scheduler = &S;
+  std::vector<pthread_t> Handles(NumThreads);
+  std::vector<bool> Started(NumThreads, false);
+  for (unsigned i = 1; i < NumThreads; ++i)
+    Started[i] = (pthread_create(&Handles[i], 0, runGraphThread, this) == 0);
+  runGraphThread(this);
+  for (unsigned i = 1; i < NumThreads; ++i)
+    if (Started[i])
+      pthread_join(Handles[i], 0);
+  Scheduler = 0;
+}
+
+/// runGraphThread - Entry point for a thread inlining callers in parallel.
+/// Repeatedly take a ready graph and inline its callers into it until no
+/// graph is ready and no other thread is processing one that could make more
+/// ready.
+void *TDDataStructures::runGraphThread(void *Arg) {
+  TDDataStructures *Pass = (TDDataStructures *) Arg;
+  GraphScheduler &S = *(Pass->Scheduler);
+
+  pthread_mutex_lock(&S.QueueLock);
+  while (true) {
+    while (S.Ready.empty() && S.Running)
+      pthread_cond_wait(&S.QueueChanged, &S.QueueLock);
+    if (S.Ready.empty())
+      break;
+
+    unsigned Index = S.Ready.back();
+    S.Ready.pop_back();
+    ++S.Running;
+    pthread_mutex_unlock(&S.QueueLock);
+
+    Pass->InlineCallersIntoGraph(S.Graphs[Index]);
+
+    pthread_mutex_lock(&S.QueueLock);
+    --S.Running;
+    for (unsigned i = 0, e = S.Waiting[Index].size(); i != e; ++i)
+      if (--S.Pending[S.Waiting[Index][i]] == 0)
+        S.Ready.push_back(S.Waiting[Index][i]);
+    pthread_cond_broadcast(&S.QueueChanged);
+  }
+  pthread_mutex_unlock(&S.QueueLock);
+
+  return 0;
+}
@@ -0,0 +1,276 @@
+; Check that BU finds the same callees and flags when it calculates
+; independent SCCs on several threads.  Each @workN, its SCC of @evenN and
+; @oddN, and @fillN are independent of the other five groups, so several
+; threads have SCCs to work on at once.  @workN reaches the malloc in @fillN
+; only through an indirect call, so +H on %obj shows the callee graphs were
+; inlined.
+;RUN: dsaopt %s -dsa-bu -analyze -check-callees=main,work1,work2,work3,work4,work5,work6
+;RUN: dsaopt %s -dsa-bu -analyze -check-callees=work3,even3,odd3
+;RUN: dsaopt %s -dsa-cbu -analyze -check-callees=main,work1,work2,work3,work4,work5,work6
+;RUN: dsaopt %s -dsa-bu -analyze -verify-flags "work1:obj+HM-S,work2:obj+HM-S,work3:obj+HM-S,work4:obj+HM-S,work5:obj+HM-S,work6:obj+HM-S"
+;RUN: dsaopt %s -dsa-threads=4 -dsa-bu -analyze -check-callees=main,work1,work2,work3,work4,work5,work6
+;RUN: dsaopt %s -dsa-threads=4 -dsa-bu -analyze -check-callees=work3,even3,odd3
+;RUN: dsaopt %s -dsa-threads=4 -dsa-cbu -analyze -check-callees=main,work1,work2,work3,work4,work5,work6
+;RUN: dsaopt %s -dsa-threads=4 -dsa-bu -analyze -verify-flags "work1:obj+HM-S,work2:obj+HM-S,work3:obj+HM-S,work4:obj+HM-S,work5:obj+HM-S,work6:obj+HM-S"
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+@table = internal global [6 x void (i32)*] [void (i32)* @work1, void (i32)* @work2, void (i32)* @work3, void (i32)* @work4, void (i32)* @work5, void (i32)* @work6]
+
+define internal void @fill1(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even1(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill1(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd1(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd1(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even1(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work1(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd1, void (i32**, i32)* @even1
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define internal void @fill2(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even2(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill2(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd2(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd2(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even2(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work2(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd2, void (i32**, i32)* @even2
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define internal void @fill3(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even3(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill3(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd3(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd3(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even3(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work3(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd3, void (i32**, i32)* @even3
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define internal void @fill4(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even4(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill4(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd4(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd4(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even4(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work4(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd4, void (i32**, i32)* @even4
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define internal void @fill5(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even5(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill5(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd5(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd5(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even5(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work5(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd5, void (i32**, i32)* @even5
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define internal void @fill6(i32** %out) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %c = bitcast i8* %m to i32*
+  store i32* %c, i32** %out
+  ret void
+}
+
+define internal void @even6(i32** %out, i32 %n) nounwind {
+entry:
+  %z = icmp eq i32 %n, 0
+  br i1 %z, label %done, label %more
+
+done:
+  call void @fill6(i32** %out)
+  ret void
+
+more:
+  %n1 = sub i32 %n, 1
+  call void @odd6(i32** %out, i32 %n1)
+  ret void
+}
+
+define internal void @odd6(i32** %out, i32 %n) nounwind {
+entry:
+  %n1 = sub i32 %n, 1
+  call void @even6(i32** %out, i32 %n1)
+  ret void
+}
+
+define void @work6(i32 %n) nounwind {
+entry:
+  %cell = alloca i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32**, i32)* @odd6, void (i32**, i32)* @even6
+  call void %fn(i32** %cell, i32 %n)
+  %obj = load i32** %cell
+  store i32 %n, i32* %obj
+  ret void
+}
+
+define i32 @main(i32 %argc) nounwind {
+entry:
+  %idx = zext i32 %argc to i64
+  %slot = getelementptr [6 x void (i32)*]* @table, i64 0, i64 %idx
+  %fn = load void (i32)** %slot
+  call void %fn(i32 %argc)
+  ret i32 0
+}
+
+declare noalias i8* @malloc(i64) nounwind
@@ -0,0 +1,36 @@
+; Verify that -ds-aa uses the TD graphs to tell that pointers into different
+; complete nodes, or into fields of the same node that do not overlap, do not
+; alias, and that a call cannot touch memory that its callee never reaches.
+; RUN: dsaopt %s -ds-aa -aa-eval -print-all-alias-modref-info -disable-output >& %t.aa
+; RUN: grep "NoAlias:.*%fa, i32\* %fb" %t.aa
+; RUN: grep "NoAlias:.*%fa, i32\* %q" %t.aa
+; RUN: grep "MayAlias:.*%obj, i32\* %fa" %t.aa
+; RUN: grep "NoAlias:.*%obj, %node\* %other" %t.aa
+; RUN: grep "NoModRef:  Ptr: %node\* %other" %t.aa
+; RUN: grep "Both ModRef:  Ptr: %node\* %obj" %t.aa
+
+; Verify that asking about many pairs at once gives the same answers.
+; RUN: dsaopt %s -ds-aa-check -stats -disable-output >& %t.check
+; RUN: grep "ds-aa.*NoAlias by DSA" %t.check
+; RUN: grep "ds-aa.*batch alias answers checked" %t.check
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+%node = type { i32, i32 }
+
+define i32 @f(%node* %obj, i32* %q) {
+  %fa = getelementptr %node* %obj, i32 0, i32 0
+  %fb = getelementptr %node* %obj, i32 0, i32 1
+  store i32 1, i32* %fa
+  store i32 2, i32* %fb
+  %x = load i32* %fa
+  ret i32 %x
+}
+
+define i32 @main() {
+  %obj = alloca %node
+  %other = alloca %node
+  %q = getelementptr %node* %other, i32 0, i32 0
+  %r = call i32 @f(%node* %obj, i32* %q)
+  ret i32 %r
+}
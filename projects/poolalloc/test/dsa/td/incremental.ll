@@ -0,0 +1,44 @@
+; Verify that the incremental mode reuses the graphs of unchanged functions,
+; within a run and from the cache directory of an earlier run, and that the
+; graphs it reuses give the same answers as fresh ones.
+; -instnamer stands in for a change that leaves the functions as they were.
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -disable-output -stats 2>&1 | grep "4 td_dsa.*TD graphs reused"
+
+; The same, with the graphs kept in a cache directory by an earlier run.
+; RUN: rm -rf %t
+; RUN: dsaopt %s -dsa-incremental -dsa-cache-dir=%t -dsa-td -disable-output
+; RUN: dsaopt %s -dsa-incremental -dsa-cache-dir=%t -dsa-td -disable-output -stats 2>&1 | grep "4 td_dsa.*TD graphs reused"
+; RUN: dsaopt %s -dsa-incremental -dsa-cache-dir=%t -dsa-td -analyze -verify-flags=@foo:ptr+G
+
+; These are the same checks as in basic-global.ll, made on the reused graphs.
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -analyze -check-callees=indirect,foo,bar
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -analyze -verify-flags=@main:barptr+G
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -analyze -verify-flags=@main:fooptr2+G
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -analyze -verify-flags=@foo:ptr+G
+; RUN: dsaopt %s -dsa-incremental -dsa-td -instnamer -dsa-td -analyze -verify-flags=@bar:ptr+G
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+@G = global i8 0
+
+define i8* @foo(i8* %ptr) nounwind {
+  ret i8* %ptr
+}
+
+define i8* @bar(i8* %ptr) nounwind {
+  ret i8* @G
+}
+
+define i8* @indirect(i8* (i8*) * %fp, i8* %ptr) {
+  %retptr = call i8* %fp(i8* %ptr)
+  ret i8* %retptr
+}
+
+define i32 @main(i32 %argc, i8** nocapture %argv) nounwind {
+  %ptr = load i8** %argv, align 8
+  %fooptr = call i8* @indirect(i8* (i8*)* @foo, i8* %ptr)
+  %barptr = call i8* @indirect(i8* (i8*)* @bar, i8* %fooptr)
+  %fooptr2 = call i8* @indirect(i8* (i8*)* @foo, i8* %barptr)
+  %barptr2 = call i8* @indirect(i8* (i8*)* @bar, i8* %fooptr2)
+  ret i32 0
+}
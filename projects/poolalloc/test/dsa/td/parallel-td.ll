@@ -0,0 +1,195 @@
+; Check that TD finds the same callees and flags when it inlines callers
+; into independent graphs on several threads.  @main calls six @rootN, and
+; the graphs of each @rootN, @midN, @altN and @leafN are independent of the
+; other five groups, so several threads have graphs to work on at once.
+; %v in @leafN is only known to point to the heap once TD has inlined the
+; callers, which BU has not.
+; RUN: dsaopt %s -dsa-bu -analyze -verify-flags "leaf1:v-H"
+; RUN: dsaopt %s -dsa-td -analyze -check-callees=root3,mid3,alt3
+; RUN: dsaopt %s -dsa-td -analyze -verify-flags "leaf1:v+HM-S,leaf2:v+HM-S,leaf3:v+HM-S,leaf4:v+HM-S,leaf5:v+HM-S,leaf6:v+HM-S"
+; RUN: dsaopt %s -dsa-threads=4 -dsa-td -analyze -check-callees=root3,mid3,alt3
+; RUN: dsaopt %s -dsa-threads=4 -dsa-td -analyze -verify-flags "leaf1:v+HM-S,leaf2:v+HM-S,leaf3:v+HM-S,leaf4:v+HM-S,leaf5:v+HM-S,leaf6:v+HM-S"
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64"
+target triple = "x86_64-unknown-linux-gnu"
+
+define internal void @leaf1(i32* %v) nounwind {
+entry:
+  store i32 1, i32* %v
+  ret void
+}
+
+define internal void @mid1(i32* %v) nounwind {
+entry:
+  call void @leaf1(i32* %v)
+  ret void
+}
+
+define internal void @alt1(i32* %v) nounwind {
+entry:
+  call void @leaf1(i32* %v)
+  ret void
+}
+
+define internal void @root1(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid1, void (i32*)* @alt1
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define internal void @leaf2(i32* %v) nounwind {
+entry:
+  store i32 2, i32* %v
+  ret void
+}
+
+define internal void @mid2(i32* %v) nounwind {
+entry:
+  call void @leaf2(i32* %v)
+  ret void
+}
+
+define internal void @alt2(i32* %v) nounwind {
+entry:
+  call void @leaf2(i32* %v)
+  ret void
+}
+
+define internal void @root2(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid2, void (i32*)* @alt2
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define internal void @leaf3(i32* %v) nounwind {
+entry:
+  store i32 3, i32* %v
+  ret void
+}
+
+define internal void @mid3(i32* %v) nounwind {
+entry:
+  call void @leaf3(i32* %v)
+  ret void
+}
+
+define internal void @alt3(i32* %v) nounwind {
+entry:
+  call void @leaf3(i32* %v)
+  ret void
+}
+
+define internal void @root3(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid3, void (i32*)* @alt3
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define internal void @leaf4(i32* %v) nounwind {
+entry:
+  store i32 4, i32* %v
+  ret void
+}
+
+define internal void @mid4(i32* %v) nounwind {
+entry:
+  call void @leaf4(i32* %v)
+  ret void
+}
+
+define internal void @alt4(i32* %v) nounwind {
+entry:
+  call void @leaf4(i32* %v)
+  ret void
+}
+
+define internal void @root4(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid4, void (i32*)* @alt4
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define internal void @leaf5(i32* %v) nounwind {
+entry:
+  store i32 5, i32* %v
+  ret void
+}
+
+define internal void @mid5(i32* %v) nounwind {
+entry:
+  call void @leaf5(i32* %v)
+  ret void
+}
+
+define internal void @alt5(i32* %v) nounwind {
+entry:
+  call void @leaf5(i32* %v)
+  ret void
+}
+
+define internal void @root5(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid5, void (i32*)* @alt5
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define internal void @leaf6(i32* %v) nounwind {
+entry:
+  store i32 6, i32* %v
+  ret void
+}
+
+define internal void @mid6(i32* %v) nounwind {
+entry:
+  call void @leaf6(i32* %v)
+  ret void
+}
+
+define internal void @alt6(i32* %v) nounwind {
+entry:
+  call void @leaf6(i32* %v)
+  ret void
+}
+
+define internal void @root6(i32 %n) nounwind {
+entry:
+  %m = call i8* @malloc(i64 4)
+  %obj = bitcast i8* %m to i32*
+  %odd = trunc i32 %n to i1
+  %fn = select i1 %odd, void (i32*)* @mid6, void (i32*)* @alt6
+  call void %fn(i32* %obj)
+  ret void
+}
+
+define i32 @main(i32 %argc) nounwind {
+entry:
+  call void @root1(i32 %argc)
+  call void @root2(i32 %argc)
+  call void @root3(i32 %argc)
+  call void @root4(i32 %argc)
+  call void @root5(i32 %argc)
+  call void @root6(i32 %argc)
+  ret i32 0
+}
+
+declare noalias i8* @malloc(i64) nounwind